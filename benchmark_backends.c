@@ -0,0 +1,170 @@
+// Chained table vs hopscotch vs Robin Hood: memory per entry, random-lookup throughput and
+// single-lookup latency.
+//
+// Fills each table with `n` scattered keys, then every thread looks up random keys, half of
+// them present and half absent. The chained table grows at its own load limit (0.7); the
+// hopscotch table is created for `n` entries, so it runs at 0.75 load, and the Robin Hood
+// table at 0.9. Latency percentiles come from a separate single-thread pass that times each
+// lookup on its own.
+//
+// Usage: ./benchmark_backends [elements] [threads] [lookups_per_thread]
+
+#define _GNU_SOURCE
+#include "hashtablescratch.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define LATENCY_SAMPLES 1000000
+
+typedef struct {
+    const char* name;
+    void* table;
+    int (*get)(void* table, int key, int* value);
+} Backend;
+
+typedef struct {
+    const Backend* backend;
+    pthread_t thread;
+    int id;
+    int elements;
+    long lookups;
+    long found;
+} LookupThread;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long now_nanoseconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+// Distinct for distinct i (odd multiplier), and far from sequential
+static int scatter(unsigned i) {
+    return (int)(i * 2654435761u);
+}
+
+// Indices past `elements` were never inserted
+static int random_key(unsigned* seed, int elements) {
+    unsigned index = ((unsigned)rand_r(seed) << 16 ^ (unsigned)rand_r(seed)) % (2u * (unsigned)elements);
+    return scatter(index);
+}
+
+static int chained_get(void* table, int key, int* value) {
+    return ht_get(table, key, value);
+}
+
+static int hop_get(void* table, int key, int* value) {
+    return ht_hop_get(table, key, value);
+}
+
+static int rh_get(void* table, int key, int* value) {
+    return ht_rh_get(table, key, value);
+}
+
+static void* lookup_thread(void* arg) {
+    LookupThread* self = arg;
+    unsigned seed = (unsigned)self->id * 2654435761u + 1;
+    int value;
+
+    for (long i = 0; i < self->lookups; i++) {
+        self->found += self->backend->get(self->backend->table, random_key(&seed, self->elements), &value);
+    }
+    return NULL;
+}
+
+static int compare_long(const void* a, const void* b) {
+    long x = *(const long*)a, y = *(const long*)b;
+    return (x > y) - (x < y);
+}
+
+// Prints lookups/s over all threads, then p50 / p99 / p99.9 / max of single lookups
+static void run_lookups(const Backend* backend, LookupThread* threads, int num_threads, int elements, long lookups) {
+    double start = now_seconds();
+    for (int i = 0; i < num_threads; i++) {
+        threads[i] = (LookupThread){ .backend = backend, .id = i, .elements = elements, .lookups = lookups };
+        pthread_create(&threads[i].thread, NULL, lookup_thread, &threads[i]);
+    }
+    for (int i = 0; i < num_threads; i++) pthread_join(threads[i].thread, NULL);
+    double elapsed = now_seconds() - start;
+    printf(" %14.0f", (double)lookups * num_threads / elapsed);
+
+    long* samples = malloc(LATENCY_SAMPLES * sizeof(long));
+    if (!samples) {
+        printf("\n");
+        return;
+    }
+    unsigned seed = 12345;
+    int value;
+    for (long i = 0; i < LATENCY_SAMPLES; i++) {
+        int key = random_key(&seed, elements);
+        long begin = now_nanoseconds();
+        backend->get(backend->table, key, &value);
+        samples[i] = now_nanoseconds() - begin;
+    }
+    qsort(samples, LATENCY_SAMPLES, sizeof(long), compare_long);
+    printf(" %8ld %8ld %8ld %8ld\n", samples[LATENCY_SAMPLES / 2], samples[LATENCY_SAMPLES / 100 * 99],
+           samples[LATENCY_SAMPLES / 1000 * 999], samples[LATENCY_SAMPLES - 1]);
+    free(samples);
+}
+
+int main(int argc, char** argv) {
+    int elements = argc > 1 ? atoi(argv[1]) : 4000000;
+    int num_threads = argc > 2 ? atoi(argv[2]) : 4;
+    long lookups = argc > 3 ? atol(argv[3]) : 4000000;
+    if (elements < 1) elements = 1;
+    if (num_threads < 1) num_threads = 1;
+
+    printf("=== TABLE BACKEND BENCHMARK: %d elements, %d threads, %ld lookups each (50%% hits) ===\n\n",
+           elements, num_threads, lookups);
+    printf("%-12s %8s %12s %10s %14s %8s %8s %8s %8s\n", "Table", "Load", "Bytes/entry", "Insert s",
+           "Lookups/s", "p50 ns", "p99 ns", "p99.9 ns", "max ns");
+
+    LookupThread* threads = calloc((size_t)num_threads, sizeof(LookupThread));
+
+    HashTable* ht = create_hashtable(19);
+    double start = now_seconds();
+    for (int i = 0; i < elements; i++) ht_insert(ht, scatter((unsigned)i), i);
+    double insert_time = now_seconds() - start;
+    HtStats stats;
+    ht_stats(ht, &stats);
+    printf("%-12s %8.3f %12.1f %10.3f", "chained", stats.load_factor,
+           (double)(stats.bucket_bytes + stats.node_bytes) / elements, insert_time);
+    run_lookups(&(Backend){ "chained", ht, chained_get }, threads, num_threads, elements, lookups);
+    ht_destroy(ht);
+
+    HopscotchTable* hop = ht_hop_create((size_t)elements);
+    if (hop) {
+        start = now_seconds();
+        for (int i = 0; i < elements; i++) ht_hop_insert(hop, scatter((unsigned)i), i);
+        insert_time = now_seconds() - start;
+        printf("%-12s %8.3f %12.1f %10.3f", "hopscotch", ht_hop_load_factor(hop),
+               (double)ht_hop_memory(hop) / elements, insert_time);
+        run_lookups(&(Backend){ "hopscotch", hop, hop_get }, threads, num_threads, elements, lookups);
+        ht_hop_destroy(hop);
+    } else {
+        printf("%-12s %8s\n", "hopscotch", "unavailable");
+    }
+
+    RobinHoodTable* rh = ht_rh_create((size_t)elements);
+    if (rh) {
+        start = now_seconds();
+        for (int i = 0; i < elements; i++) ht_rh_insert(rh, scatter((unsigned)i), i);
+        insert_time = now_seconds() - start;
+        printf("%-12s %8.3f %12.1f %10.3f", "robin hood", ht_rh_load_factor(rh),
+               (double)ht_rh_memory(rh) / elements, insert_time);
+        run_lookups(&(Backend){ "robin hood", rh, rh_get }, threads, num_threads, elements, lookups);
+        ht_rh_destroy(rh);
+    } else {
+        printf("%-12s %8s\n", "robin hood", "unavailable");
+    }
+
+    free(threads);
+    return 0;
+}
@@ -0,0 +1,191 @@
+// Random-lookup throughput of one large table under each memory policy.
+//
+// Inserts `n` keys, then every thread does random ht_get calls. With 4K pages the bucket
+// array and scattered nodes miss the TLB on most lookups; huge pages and the node arena
+// cut those misses. dTLB load misses are read with perf_event_open when the kernel allows
+// it (otherwise "n/a"; VMs without a PMU driver only have software events).
+//
+// Placement is read back from /proc while each table is alive: "Huge MB" is the process
+// memory backed by huge pages (AnonHugePages + hugetlb in smaps_rollup), which shows whether
+// a policy actually got them, and "Top node" is the share of mapped pages on the busiest
+// NUMA node (numa_maps): 100% on one node, ~1/nodes under interleave.
+//
+// Usage: ./benchmark_memory [elements] [threads] [lookups_per_thread]
+
+#define _GNU_SOURCE
+#include "hashtablescratch.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+typedef struct {
+    HashTable* ht;
+    pthread_t thread;
+    int id;
+    int elements;
+    long lookups;
+    long found;
+} LookupThread;
+
+static const struct {
+    const char* name;
+    unsigned flags;
+} policies[] = {
+    { "malloc / 4K pages",            HT_MEM_DEFAULT },
+    { "transparent huge pages",       HT_MEM_HUGE_TRANSPARENT },
+    { "THP + node arena",             HT_MEM_HUGE_TRANSPARENT | HT_MEM_NODE_ARENA },
+    { "explicit huge pages + arena",  HT_MEM_HUGE_EXPLICIT | HT_MEM_NODE_ARENA },
+    { "THP + arena + NUMA interleave", HT_MEM_HUGE_TRANSPARENT | HT_MEM_NODE_ARENA | HT_MEM_NUMA_INTERLEAVE },
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Counts dTLB read misses of this process and its threads; -1 if not permitted
+static int open_dtlb_counter(void) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// kB of huge-page-backed memory in this process, -1 if unreadable
+static long huge_page_kb(void) {
+    FILE* f = fopen("/proc/self/smaps_rollup", "r");
+    if (!f) return -1;
+    char line[256];
+    long total = 0, kb;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1 || sscanf(line, "Private_Hugetlb: %ld kB", &kb) == 1 ||
+            sscanf(line, "Shared_Hugetlb: %ld kB", &kb) == 1) {
+            total += kb;
+        }
+    }
+    fclose(f);
+    return total;
+}
+
+#define MAX_NODES 64
+
+// Share (0..1) of this process's mapped memory on its busiest NUMA node, -1 if unreadable
+static double top_node_share(void) {
+    FILE* f = fopen("/proc/self/numa_maps", "r");
+    if (!f) return -1;
+    double node_kb[MAX_NODES] = {0};
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        long page_kb = 4;
+        char* size = strstr(line, "kernelpagesize_kB=");
+        if (size) page_kb = atol(size + strlen("kernelpagesize_kB="));
+        for (char* token = strtok(line, " \n"); token; token = strtok(NULL, " \n")) {
+            int node;
+            long pages;
+            if (sscanf(token, "N%d=%ld", &node, &pages) == 2 && node >= 0 && node < MAX_NODES) {
+                node_kb[node] += (double)pages * page_kb;
+            }
+        }
+    }
+    fclose(f);
+
+    double total = 0, top = 0;
+    for (int i = 0; i < MAX_NODES; i++) {
+        total += node_kb[i];
+        if (node_kb[i] > top) top = node_kb[i];
+    }
+    return total > 0 ? top / total : -1;
+}
+
+static void* lookup_thread(void* arg) {
+    LookupThread* self = arg;
+    unsigned seed = (unsigned)self->id * 2654435761u + 1;
+    int value;
+
+    for (long i = 0; i < self->lookups; i++) {
+        int key = (int)(((unsigned)rand_r(&seed) << 16 ^ (unsigned)rand_r(&seed)) % (unsigned)self->elements);
+        self->found += ht_get(self->ht, key, &value);
+    }
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    int elements = argc > 1 ? atoi(argv[1]) : 4000000;
+    int num_threads = argc > 2 ? atoi(argv[2]) : 4;
+    long lookups = argc > 3 ? atol(argv[3]) : 4000000;
+    if (elements < 1) elements = 1;
+    if (num_threads < 1) num_threads = 1;
+
+    printf("=== MEMORY PLACEMENT BENCHMARK: %d elements, %d threads, %ld lookups each ===\n\n",
+           elements, num_threads, lookups);
+    printf("%-32s %14s %16s %10s %10s\n", "Policy", "Lookups/s", "dTLB misses/op", "Huge MB", "Top node");
+
+    LookupThread* threads = calloc((size_t)num_threads, sizeof(LookupThread));
+    for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); p++) {
+        // Start small: the bucket arrays that matter are the ones later resizes allocate
+        HashTable* ht = create_hashtable(19);
+        if (!ht || !ht_set_memory_policy(ht, policies[p].flags)) {
+            printf("%-32s %14s\n", policies[p].name, "unavailable");
+            ht_destroy(ht);
+            continue;
+        }
+        for (int i = 0; i < elements; i++) ht_insert(ht, i, i);
+
+        int counter = open_dtlb_counter();
+        if (counter >= 0) {
+            ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+            ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+        }
+
+        double start = now_seconds();
+        for (int i = 0; i < num_threads; i++) {
+            threads[i] = (LookupThread){ .ht = ht, .id = i, .elements = elements, .lookups = lookups };
+            pthread_create(&threads[i].thread, NULL, lookup_thread, &threads[i]);
+        }
+        long found = 0;
+        for (int i = 0; i < num_threads; i++) {
+            pthread_join(threads[i].thread, NULL);
+            found += threads[i].found;
+        }
+        double elapsed = now_seconds() - start;
+
+        long long misses = -1;
+        if (counter >= 0) {
+            ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(counter, &misses, sizeof(misses)) != sizeof(misses)) misses = -1;
+            close(counter);
+        }
+
+        double total = (double)lookups * num_threads;
+        char tlb[32];
+        if (misses >= 0) snprintf(tlb, sizeof(tlb), "%.3f", misses / total);
+        else snprintf(tlb, sizeof(tlb), "n/a");
+        long huge_kb = huge_page_kb();
+        double top_share = top_node_share();
+        char huge[32], top[32];
+        if (huge_kb >= 0) snprintf(huge, sizeof(huge), "%ld", huge_kb >> 10);
+        else snprintf(huge, sizeof(huge), "n/a");
+        if (top_share >= 0) snprintf(top, sizeof(top), "%.0f%%", top_share * 100.0);
+        else snprintf(top, sizeof(top), "n/a");
+        printf("%-32s %14.0f %16s %10s %10s%s\n", policies[p].name, total / elapsed, tlb, huge, top,
+               found == (long)total ? "" : "  (lookups missed!)");
+
+        ht_destroy(ht);
+    }
+
+    free(threads);
+    return 0;
+}
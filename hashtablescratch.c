@@ -7,297 +7,3772 @@
 #include <unistd.h>  // ← Esto es necesario para sleep()
 #include <stdbool.h>  // ← Esto es necesario para usar bool, true, false
 #include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 #include "hashtablescratch.h"
 
+// Built with -DHT_TRACE, every insert, get and delete is appended to the operation trace: the
+// plain, handle, try/timed (unless HT_BUSY) and batched forms, each op of ht_multi_update, and
+// every key ht_remove_if deletes. ht_merge and ht_intersect, which copy whole tables, are not.
+#ifdef HT_TRACE
+#define TRACE_OP(op, key, value) ht_trace_record(op, key, value)
+#else
+#define TRACE_OP(op, key, value) ((void)0)
+#endif
+
+
+// Where a key's chain lives; only stable while the stripe's mutex is held
+typedef struct {
+    Node** head;    // Bucket head pointer (in buckets or, mid-resize, in old_buckets)
+    size_t stripe;  // Index into mutexes[]
+} BucketRef;
+
+// Set by ht_multi_update while it holds its stripes: every write of one transaction must carry
+// the same epoch, or a snapshot could begin between two of them and see half the transaction
+static _Thread_local uint64_t mvcc_pinned_epoch;
+
 
 // Function prototypes for static functions
 static size_t hash_function(int key, size_t table_size);
 static bool is_prime(size_t n);
 static size_t next_prime(size_t n);
 static pthread_mutex_t* get_bucket_mutex(HashTable* table, size_t bucket_index);
+static void locate_bucket(HashTable* table, int key, BucketRef* ref);
+static pthread_mutex_t* lock_bucket(HashTable* table, int key, BucketRef* ref);
+static void stripe_lock(HashTable* table, size_t stripe);
+static void counter_bump(atomic_uint_fast64_t* counter);
+static double clock_ms(void);
+static void lock_all_buckets(HashTable* table);
+static void unlock_all_buckets(HashTable* table);
+static NegFilter* filter_create(size_t expected_keys, unsigned bits_per_key);
+static void filter_add(NegFilter* filter, int key);
+static bool filter_may_contain(const NegFilter* filter, int key);
+static int filter_rebuild_locked(HashTable* table, unsigned bits_per_key);
+static void filter_note_delete(HashTable* table, size_t removed);
+static bool filter_excludes(HashTable* table, int key);
+static void bucket_link(HashTable* table, const BucketRef* ref, Node* node);
+static bool bucket_insert(HashTable* table, const BucketRef* ref, int key, int value);
+static bool bucket_get(HashTable* table, const BucketRef* ref, int key, int* value);
+static bool bucket_delete(HashTable* table, const BucketRef* ref, int key);
+static Node* tier_promote(HashTable* table, const BucketRef* ref, int key);
+static void tier_evict_if_needed(HashTable* table);
+static bool migrate_chunk(HashTable* table);
+static void resize_readers_drain(HashTable* table);
+static Node** bucket_alloc(const HashTable* table, size_t count);
+static void bucket_free(Node** buckets);
+static Node* node_alloc(HashTable* table, size_t stripe);
+static void node_free(HashTable* table, size_t stripe, Node* node);
+static void node_recycle(HashTable* table, size_t stripe, Node* node);
+static void retire_flush(void);
+static void count_add(HashTable* table, int delta);
+static size_t count_load(const HashTable* table);
+static bool mvcc_record(HashTable* table, Node* node);
+static void mvcc_free_versions(HashTable* table, Node* node);
+static void mvcc_collect(HashTable* table);
+// out_stripe/out_version (optional) report the stripe that served the op and its version
+static bool fc_execute(HashTable* table, int op, int key, int value, int* out_value,
+                       size_t* out_stripe, unsigned* out_version);
+
+// Operation codes shared by the flat-combining publication slots
+enum { FC_OP_INSERT, FC_OP_GET, FC_OP_DELETE };
+
+
+
+// ============================================================================================= //
+// ======================================= BUCKET MUTEX ======================================== //
+// ============================================================================================= //
+static pthread_mutex_t* get_bucket_mutex(HashTable* table, size_t bucket_index) {
+    return &table->mutexes[bucket_index % NUM_MUTEXES];
+}
+
+// While a resize is in flight, keys whose old bucket has not been moved yet still live
+// in old_buckets. Bucket i of either array is guarded by mutexes[i % NUM_MUTEXES].
+static void locate_bucket(HashTable* table, int key, BucketRef* ref) {
+    // Callers may get here without a stripe held (lock_bucket re-checks the geometry after
+    // locking), so a finishing migration can clear old_size under us: read it once
+    size_t old_size = table->old_size;
+    if (table->old_buckets && old_size) {
+        size_t old_index = hash_function(key, old_size);
+        if (old_index >= table->migrate_cursor) {
+            ref->head = &table->old_buckets[old_index];
+            ref->stripe = old_index % NUM_MUTEXES;
+            return;
+        }
+    }
+    size_t index = hash_function(key, table->size);
+    ref->head = &table->buckets[index];
+    ref->stripe = index % NUM_MUTEXES;
+}
+
+// Locks the mutex owning key's bucket. The stripe depends on the table geometry, so if a
+// resize step slipped in between hashing and locking we retry with the new geometry.
+// While the returned mutex is held *ref stays valid (resize steps hold every stripe).
+static pthread_mutex_t* lock_bucket(HashTable* table, int key, BucketRef* ref) {
+    for (;;) {
+        unsigned geometry = atomic_load_explicit(&table->geometry, memory_order_acquire);
+        locate_bucket(table, key, ref);
+        pthread_mutex_t* mutex = get_bucket_mutex(table, ref->stripe);
+
+        stripe_lock(table, ref->stripe);
+        if (atomic_load_explicit(&table->geometry, memory_order_relaxed) == geometry) return mutex;
+        pthread_mutex_unlock(mutex); // Table was resized: hash again
+    }
+}
+
+// Locks one stripe for a key operation, counting the acquisition and whether it had to wait
+static void stripe_lock(HashTable* table, size_t stripe) {
+    StripeCounters* counters = &table->stripe_counters[stripe];
+    pthread_mutex_t* mutex = &table->mutexes[stripe];
+    if (pthread_mutex_trylock(mutex) != 0) {
+        pthread_mutex_lock(mutex);
+        counter_bump(&counters->contended);
+    }
+    counter_bump(&counters->acquisitions);
+}
+
+// Caller holds the stripe that owns the counter, so a plain load and store suffice; the
+// atomics only make ht_stats' unlocked reads well-defined
+static void counter_bump(atomic_uint_fast64_t* counter) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+// Always in ascending order so two "stop the world" callers cannot deadlock
+static void lock_all_buckets(HashTable* table) {
+    for (int i = 0; i < NUM_MUTEXES; i++) pthread_mutex_lock(&table->mutexes[i]);
+}
+
+static void unlock_all_buckets(HashTable* table) {
+    for (int i = NUM_MUTEXES - 1; i >= 0; i--) pthread_mutex_unlock(&table->mutexes[i]);
+}
+
+
+// ============================================================================================= //
+// ================================== NEGATIVE-LOOKUP FILTER =================================== //
+// ============================================================================================= //
+// Split-block Bloom filter: every key maps to one 64-byte block and sets one bit in each of
+// its 8 words, so a lookup costs a single cache line. Bits are only ever set (atomic OR), so
+// ht_get can read the filter without any lock. Deleted keys leave their bits behind; the
+// filter is rebuilt from the live nodes on every resize and after too many deletes.
+#define FILTER_BLOCK_WORDS 8
+
+struct NegFilter {
+    atomic_uint_least64_t* words;   // num_blocks * FILTER_BLOCK_WORDS words, 64-byte aligned
+    size_t num_blocks;
+    size_t capacity;                // Keys the filter was sized for
+    unsigned bits_per_key;
+};
+
+static const uint32_t filter_salts[FILTER_BLOCK_WORDS] = {
+    0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+    0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U
+};
+
+static uint64_t filter_hash(int key) {
+    uint64_t h = (uint64_t)(uint32_t)key * 0x9E3779B97F4A7C15ULL;
+    h ^= h >> 32;
+    h *= 0xD6E8FEB86659FD93ULL;
+    return h ^ (h >> 32);
+}
+
+static NegFilter* filter_create(size_t expected_keys, unsigned bits_per_key) {
+    NegFilter* filter = malloc(sizeof(NegFilter));
+    if (!filter) return NULL;
+
+    if (bits_per_key == 0) bits_per_key = FILTER_DEFAULT_BITS_PER_KEY;
+    if (expected_keys == 0) expected_keys = 1;
+
+    size_t bits = expected_keys * bits_per_key;
+    filter->num_blocks = (bits + 511) / 512;
+    filter->capacity = expected_keys;
+    filter->bits_per_key = bits_per_key;
+
+    size_t bytes = filter->num_blocks * FILTER_BLOCK_WORDS * sizeof(uint64_t);
+    filter->words = aligned_alloc(64, bytes);
+    if (!filter->words) {
+        free(filter);
+        return NULL;
+    }
+    memset(filter->words, 0, bytes);
+    return filter;
+}
+
+static void filter_free(NegFilter* filter) {
+    if (!filter) return;
+    free(filter->words);
+    free(filter);
+}
+
+static void filter_add(NegFilter* filter, int key) {
+    uint64_t h = filter_hash(key);
+    size_t block = (size_t)(((h >> 32) * filter->num_blocks) >> 32);
+    atomic_uint_least64_t* words = &filter->words[block * FILTER_BLOCK_WORDS];
+
+    for (int i = 0; i < FILTER_BLOCK_WORDS; i++) {
+        uint64_t bit = 1ULL << (((uint32_t)h * filter_salts[i]) >> 26);
+        atomic_fetch_or_explicit(&words[i], bit, memory_order_release);
+    }
+}
+
+// ht_tier_keys callback
+static void filter_add_key(int key, void* filter) {
+    filter_add(filter, key);
+}
+
+static bool filter_may_contain(const NegFilter* filter, int key) {
+    uint64_t h = filter_hash(key);
+    size_t block = (size_t)(((h >> 32) * filter->num_blocks) >> 32);
+    atomic_uint_least64_t* words = &filter->words[block * FILTER_BLOCK_WORDS];
+
+    for (int i = 0; i < FILTER_BLOCK_WORDS; i++) {
+        uint64_t bit = 1ULL << (((uint32_t)h * filter_salts[i]) >> 26);
+        if (!(atomic_load_explicit(&words[i], memory_order_acquire) & bit)) return false;
+    }
+    return true;
+}
+
+// Lock-free probes count themselves in filter_readers around every use of the filter pointer.
+// Whoever replaces the filter (holding every bucket mutex and resize_mutex) swaps the pointer,
+// then waits for the counts to reach zero before freeing the old one: a reader that entered
+// after the swap can only have loaded the new filter.
+static NegFilter* filter_enter(HashTable* table, unsigned slot) {
+    atomic_fetch_add(&table->filter_readers[slot].active, 1);
+    return atomic_load(&table->filter);
+}
+
+static void filter_leave(HashTable* table, unsigned slot) {
+    atomic_fetch_sub_explicit(&table->filter_readers[slot].active, 1, memory_order_release);
+}
+
+// True if the filter proves key absent. Takes no lock.
+static bool filter_excludes(HashTable* table, int key) {
+    if (!atomic_load_explicit(&table->filter, memory_order_relaxed)) return false;
+
+    unsigned slot = (unsigned)key % NUM_MUTEXES;
+    NegFilter* filter = filter_enter(table, slot);
+    bool absent = filter && !filter_may_contain(filter, key);
+    filter_leave(table, slot);
+    return absent;
+}
+
+// Caller holds every bucket mutex. Publishes `filter` and frees the one it replaces once no
+// probe can still be reading it.
+static void filter_replace_locked(HashTable* table, NegFilter* filter) {
+    NegFilter* old = atomic_exchange(&table->filter, filter);
+    atomic_store(&table->filter_stale, 0);
+    for (int i = 0; i < NUM_MUTEXES; i++) {
+        while (atomic_load(&table->filter_readers[i].active) != 0) sched_yield();
+    }
+    filter_free(old);
+}
+
+// Caller holds every bucket mutex. Builds a fresh filter sized for the current table
+// (0.7 load factor) and publishes it. Returns 1 on success, 0 if the allocation failed
+// (the old filter stays in place: saturated, but still correct).
+static int filter_rebuild_locked(HashTable* table, unsigned bits_per_key) {
+    size_t count = count_load(table);
+    size_t expected = (size_t)((double)table->size * 0.7);
+    NegFilter* filter = filter_create(count > expected ? count : expected, bits_per_key);
+    if (!filter) return 0;
+
+    for (size_t i = 0; i < table->size; i++) {
+        for (Node* current = table->buckets[i]; current; current = current->next) {
+            filter_add(filter, current->key);
+        }
+    }
+    if (table->old_buckets) { // Mid-resize: unmoved chains count too
+        for (size_t i = table->migrate_cursor; i < table->old_size; i++) {
+            for (Node* current = table->old_buckets[i]; current; current = current->next) {
+                filter_add(filter, current->key);
+            }
+        }
+    }
+    if (table->tier) ht_tier_keys(table->tier, filter_add_key, filter); // Spilled keys are still present
+
+    // Already sized for the new array, so the migration's own filter is redundant
+    filter_free(table->next_filter);
+    table->next_filter = NULL;
+
+    filter_replace_locked(table, filter);
+    return 1;
+}
+
+// Turns on the negative-lookup filter (or changes its density) and fills it from the
+// current contents. Returns 1 on success, 0 on allocation failure.
+int ht_enable_filter(HashTable* table, unsigned bits_per_key) {
+    if (!table) return 0;
+
+    pthread_mutex_lock(&table->resize_mutex);
+    lock_all_buckets(table);
+    int ok = filter_rebuild_locked(table, bits_per_key);
+    unlock_all_buckets(table);
+    pthread_mutex_unlock(&table->resize_mutex);
+    return ok;
+}
+
+// Deleted keys keep their bits; once they amount to half the filter's capacity the
+// false-positive rate has roughly doubled, so rebuild from the live nodes.
+static void filter_note_delete(HashTable* table, size_t removed) {
+    if (!atomic_load_explicit(&table->filter, memory_order_relaxed)) return;
+
+    NegFilter* filter = filter_enter(table, 0);
+    size_t capacity = filter ? filter->capacity : 0;
+    filter_leave(table, 0);
+    if (!filter) return;
+
+    size_t stale = atomic_fetch_add(&table->filter_stale, removed) + removed;
+    if (stale <= capacity / 2) return;
+
+    pthread_mutex_lock(&table->resize_mutex);
+    lock_all_buckets(table);
+    filter = atomic_load_explicit(&table->filter, memory_order_relaxed);
+    if (atomic_load(&table->filter_stale) > filter->capacity / 2) { // Another thread may have rebuilt it
+        filter_rebuild_locked(table, filter->bits_per_key);
+    }
+    unlock_all_buckets(table);
+    pthread_mutex_unlock(&table->resize_mutex);
+}
+
+// Rebuilds the filter so bits left behind by deleted keys stop producing false positives
+void ht_filter_rebuild(HashTable* table) {
+    if (!table || !atomic_load(&table->filter)) return;
+
+    pthread_mutex_lock(&table->resize_mutex);
+    lock_all_buckets(table);
+    NegFilter* filter = atomic_load(&table->filter);
+    filter_rebuild_locked(table, filter->bits_per_key);
+    unlock_all_buckets(table);
+    pthread_mutex_unlock(&table->resize_mutex);
+}
+
+
+// ============================================================================================= //
+// ======================================== READ CACHE ========================================= //
+// ============================================================================================= //
+// Small direct-mapped cache of recent ht_get hits, private to each thread. An entry remembers
+// the version of its stripe when it was filled; every insert/delete on that stripe (and every
+// resize, which bumps all stripes) changes the version, so a matching version proves the
+// cached value is still current and the read never touches the bucket array or the mutex.
+typedef struct {
+    uint32_t tag;       // (table id << 8) | stripe, 0 = empty
+    int key;
+    int value;
+    unsigned version;   // stripe_versions[stripe] when the entry was filled
+} ReadCacheEntry;
+
+static _Thread_local ReadCacheEntry read_cache[READ_CACHE_ENTRIES];
+static atomic_uint next_table_id = 1;
+
+static ReadCacheEntry* read_cache_slot(int key) {
+    return &read_cache[((uint32_t)key * 0x9E3779B1U) & (READ_CACHE_ENTRIES - 1)];
+}
+
+static uint32_t read_cache_tag(const HashTable* table, size_t stripe) {
+    return (table->id << 8) | (uint32_t)stripe;
+}
+
+// Caller holds the stripe's mutex
+static void bump_stripe_version(HashTable* table, size_t stripe) {
+    if (!atomic_load_explicit(&table->read_cache, memory_order_relaxed)) return;
+    atomic_fetch_add_explicit(&table->stripe_versions[stripe], 1, memory_order_release);
+}
+
+// Caller holds every bucket mutex; used when keys change stripe
+static void bump_all_stripe_versions(HashTable* table) {
+    if (!atomic_load_explicit(&table->read_cache, memory_order_relaxed)) return;
+    for (int i = 0; i < NUM_MUTEXES; i++) atomic_fetch_add(&table->stripe_versions[i], 1);
+}
+
+static bool read_cache_lookup(HashTable* table, int key, int* value) {
+    ReadCacheEntry* entry = read_cache_slot(key);
+    if (entry->key != key || (entry->tag >> 8) != table->id) return false;
+
+    unsigned version = atomic_load_explicit(&table->stripe_versions[entry->tag & 0xFF], memory_order_acquire);
+    if (version != entry->version) return false;
+
+    *value = entry->value;
+    return true;
+}
+
+// version must have been read while the stripe's mutex was held
+static void read_cache_fill(HashTable* table, size_t stripe, int key, int value, unsigned version) {
+    ReadCacheEntry* entry = read_cache_slot(key);
+    entry->tag = read_cache_tag(table, stripe);
+    entry->key = key;
+    entry->value = value;
+    entry->version = version;
+}
+
+// Turning the cache on bumps every stripe so entries filled before it was last turned
+// off (when writers stopped bumping) can never match again.
+void ht_enable_read_cache(HashTable* table, bool enable) {
+    if (!table) return;
+
+    lock_all_buckets(table);
+    if (enable && !atomic_load_explicit(&table->read_cache, memory_order_relaxed)) {
+        for (int i = 0; i < NUM_MUTEXES; i++) atomic_fetch_add(&table->stripe_versions[i], 1);
+    }
+    atomic_store_explicit(&table->read_cache, enable, memory_order_release);
+    unlock_all_buckets(table);
+}
+
+
+// ============================================================================================= //
+// ======================================== HASH FUNCTION ====================================== //
+// ============================================================================================= //
+static size_t hash_function(int key, size_t table_size) {
+    long long index = (long long)key % (long long)table_size; // One division; fix the sign after
+    return (size_t)(index < 0 ? index + (long long)table_size : index);
+}
+
+
+// ============================================================================================= //
+// ======================================= BATCH HASHING ======================================= //
+// ============================================================================================= //
+// hash_function is a 64-bit division per key, which dominates rehashing and batched lookups.
+// For table sizes below 2^31 the same floored modulo comes out of doubles exactly:
+// q = floor(key * (1/size)) is off by at most one when key is close to a multiple of size, and
+// key - q * size is exact (every product stays below 2^53), so one compare-and-fix each way
+// gives the residue, negative keys included. The kernels below do that 4 or 8 keys per
+// instruction; hash_batch picks the widest the CPU supports the first time it runs, and falls
+// back to hash_function per key without them or for larger sizes. Two keys per instruction
+// (SSE4.1 floor) measured slower than the division (1.44 vs 1.30 ns/key), so there is no
+// SSE kernel.
+#define HASH_BATCH 256              // Keys hashed per kernel call by the batch paths
+#define MIGRATE_PREFETCH 16         // New bucket heads prefetched ahead while relinking
+
+typedef void (*HashBatchKernel)(const int* keys, size_t n, size_t table_size, size_t* buckets);
+
+static void hash_batch_scalar(const int* keys, size_t n, size_t table_size, size_t* buckets) {
+    for (size_t i = 0; i < n; i++) buckets[i] = hash_function(keys[i], table_size);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static void hash_batch_avx2(const int* keys, size_t n, size_t table_size, size_t* buckets) {
+    if (table_size > INT32_MAX) {
+        hash_batch_scalar(keys, n, table_size, buckets);
+        return;
+    }
+    __m256d size = _mm256_set1_pd((double)table_size), inverse = _mm256_set1_pd(1.0 / (double)table_size);
+    __m256d zero = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256d key = _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i*)&keys[i]));
+        __m256d rest = _mm256_sub_pd(key, _mm256_mul_pd(_mm256_floor_pd(_mm256_mul_pd(key, inverse)), size));
+        rest = _mm256_add_pd(rest, _mm256_and_pd(_mm256_cmp_pd(rest, zero, _CMP_LT_OQ), size));
+        rest = _mm256_sub_pd(rest, _mm256_and_pd(_mm256_cmp_pd(rest, size, _CMP_GE_OQ), size));
+        _mm256_storeu_si256((__m256i*)&buckets[i], _mm256_cvtepu32_epi64(_mm256_cvttpd_epi32(rest)));
+    }
+    hash_batch_scalar(keys + i, n - i, table_size, buckets + i);
+}
+
+__attribute__((target("avx512f")))
+static void hash_batch_avx512(const int* keys, size_t n, size_t table_size, size_t* buckets) {
+    if (table_size > INT32_MAX) {
+        hash_batch_scalar(keys, n, table_size, buckets);
+        return;
+    }
+    __m512d size = _mm512_set1_pd((double)table_size), inverse = _mm512_set1_pd(1.0 / (double)table_size);
+    __m512d zero = _mm512_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512d key = _mm512_cvtepi32_pd(_mm256_loadu_si256((const __m256i*)&keys[i]));
+        __m512d floored = _mm512_roundscale_pd(_mm512_mul_pd(key, inverse), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+        __m512d rest = _mm512_sub_pd(key, _mm512_mul_pd(floored, size));
+        rest = _mm512_mask_add_pd(rest, _mm512_cmp_pd_mask(rest, zero, _CMP_LT_OQ), rest, size);
+        rest = _mm512_mask_sub_pd(rest, _mm512_cmp_pd_mask(rest, size, _CMP_GE_OQ), rest, size);
+        _mm512_storeu_si512(&buckets[i], _mm512_cvtepu32_epi64(_mm512_cvttpd_epi32(rest)));
+    }
+    hash_batch_scalar(keys + i, n - i, table_size, buckets + i);
+}
+#endif
+
+static HashBatchKernel hash_batch_select(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return hash_batch_avx512;
+    if (__builtin_cpu_supports("avx2")) return hash_batch_avx2;
+#endif
+    return hash_batch_scalar;
+}
+
+// buckets[i] = hash_function(keys[i], table_size) for i < n, and stripes[i] its stripe if
+// stripes is set
+static void hash_batch(const int* keys, size_t n, size_t table_size, size_t* buckets, uint8_t* stripes) {
+    static _Atomic(HashBatchKernel) kernel;
+    HashBatchKernel run = atomic_load_explicit(&kernel, memory_order_relaxed);
+    if (!run) {
+        run = hash_batch_select();
+        atomic_store_explicit(&kernel, run, memory_order_relaxed);
+    }
+    run(keys, n, table_size, buckets);
+    if (stripes) {
+        for (size_t i = 0; i < n; i++) stripes[i] = (uint8_t)(buckets[i] % NUM_MUTEXES);
+    }
+}
+
+
+// ============================================================================================= //
+// ====================================== MEMORY PLACEMENT ===================================== //
+// ============================================================================================= //
+// Big tables spend most lookups on TLB misses with 4K pages, and on multi-socket hosts half
+// the accesses go to the remote node. Bucket arrays and (optionally) nodes can come from 2 MB
+// aligned mappings backed by huge pages, with pages interleaved across NUMA nodes.
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+#define ARENA_CHUNK_SIZE (4UL * 1024 * 1024)
+
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+
+// Every bucket array starts with this header so it can be freed the way it was allocated
+typedef struct {
+    size_t bytes;   // Whole allocation including this header (0 = calloc)
+    bool mapped;
+} __attribute__((aligned(64))) BucketHeader;
+
+struct NodeArena {
+    pthread_mutex_t mutex;          // Guards the chunk list and bump pointer only
+    void* chunks;                   // Each chunk starts with the pointer to the next one
+    char* bump;
+    char* bump_end;
+    size_t bytes;                   // Total mapped for nodes
+    unsigned flags;
+    Node* free_lists[NUM_MUTEXES];  // Protected by the matching bucket mutex
+};
+
+// Interleaves [addr, addr + bytes) over every online node; a no-op on single-node hosts
+static void mem_interleave(void* addr, size_t bytes) {
+    FILE* f = fopen("/sys/devices/system/node/online", "r");
+    if (!f) return;
+
+    unsigned long mask = 0;
+    int first, last;
+    while (fscanf(f, "%d", &first) == 1) {
+        last = first;
+        int c = fgetc(f);
+        if (c == '-' && fscanf(f, "%d", &last) == 1) c = fgetc(f);
+        for (int n = first; n <= last && n < 64; n++) mask |= 1UL << n;
+        if (c != ',') break;
+    }
+    fclose(f);
+
+    if (mask & (mask - 1)) { // More than one node
+        syscall(SYS_mbind, addr, bytes, MPOL_INTERLEAVE, &mask, 64, 0);
+    }
+}
+
+// Anonymous zero-filled mapping aligned to HUGE_PAGE_SIZE with the requested placement
+static void* mem_map(size_t bytes, unsigned flags) {
+    bytes = (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+    void* addr = MAP_FAILED;
+    if (flags & HT_MEM_HUGE_EXPLICIT) {
+        addr = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+    if (addr == MAP_FAILED) {
+        // Over-map so the region can be trimmed to a huge-page boundary
+        char* raw = mmap(NULL, bytes + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) return NULL;
+
+        char* aligned = (char*)(((uintptr_t)raw + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+        if (aligned > raw) munmap(raw, (size_t)(aligned - raw));
+        size_t tail = (size_t)(raw + bytes + HUGE_PAGE_SIZE - (aligned + bytes));
+        if (tail) munmap(aligned + bytes, tail);
+        addr = aligned;
+
+        if (flags & (HT_MEM_HUGE_TRANSPARENT | HT_MEM_HUGE_EXPLICIT)) madvise(addr, bytes, MADV_HUGEPAGE);
+    }
+    if (flags & HT_MEM_NUMA_INTERLEAVE) mem_interleave(addr, bytes);
+    return addr;
+}
+
+static void mem_unmap(void* addr, size_t bytes) {
+    munmap(addr, (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+}
+
+static Node** bucket_alloc(const HashTable* table, size_t count) {
+    size_t bytes = sizeof(BucketHeader) + count * sizeof(Node*);
+    bool mapped = (table->mem_flags & (HT_MEM_HUGE_TRANSPARENT | HT_MEM_HUGE_EXPLICIT | HT_MEM_NUMA_INTERLEAVE)) != 0;
+
+    BucketHeader* header = mapped ? mem_map(bytes, table->mem_flags) : calloc(1, bytes);
+    if (!header) return NULL;
+    header->bytes = bytes;
+    header->mapped = mapped;
+    return (Node**)(header + 1);
+}
+
+static void bucket_free(Node** buckets) {
+    if (!buckets) return;
+    BucketHeader* header = (BucketHeader*)buckets - 1;
+    if (header->mapped) mem_unmap(header, header->bytes);
+    else free(header);
+}
+
+// Nodes unlinked by this thread, waiting to be reused or freed. A node is unreachable once
+// unlinked under its stripe lock, so it can be handed out again right away; the free() calls
+// themselves happen in retire_flush, after the caller has released its locks.
+static _Thread_local Node* retired_nodes;
+static _Thread_local size_t retired_count;
+static pthread_key_t retire_key; // Its destructor frees what an exiting thread still holds
+static pthread_once_t retire_once = PTHREAD_ONCE_INIT;
+
+static void retire_release(void) {
+    while (retired_nodes) {
+        Node* next = retired_nodes->next;
+        free(retired_nodes);
+        retired_nodes = next;
+    }
+    retired_count = 0;
+}
+
+static void retire_thread_exit(void* unused) {
+    (void)unused;
+    retire_release();
+}
+
+static void retire_key_create(void) {
+    pthread_key_create(&retire_key, retire_thread_exit);
+}
+
+// Called with no lock held. Frees the retired nodes once a batch has built up.
+static void retire_flush(void) {
+    if (retired_count >= RETIRE_BATCH) retire_release();
+}
+
+// Caller holds the stripe's mutex. With the arena, each stripe recycles its own nodes and
+// refills from the shared chunk NODE_SLAB nodes at a time, so the arena mutex is rare.
+// Without it, nodes this thread retired are reused before asking malloc.
+static Node* node_alloc(HashTable* table, size_t stripe) {
+    NodeArena* arena = table->arena;
+    if (!arena) {
+        Node* node = retired_nodes;
+        if (!node) return malloc(sizeof(Node));
+        retired_nodes = node->next;
+        retired_count--;
+        return node;
+    }
+
+    Node* node = arena->free_lists[stripe];
+    if (node) {
+        arena->free_lists[stripe] = node->next;
+        return node;
+    }
+
+    pthread_mutex_lock(&arena->mutex);
+    if (arena->bump + NODE_SLAB * sizeof(Node) > arena->bump_end) {
+        char* chunk = mem_map(ARENA_CHUNK_SIZE, arena->flags);
+        if (!chunk) {
+            pthread_mutex_unlock(&arena->mutex);
+            return NULL;
+        }
+        *(void**)chunk = arena->chunks;
+        arena->chunks = chunk;
+        arena->bump = chunk + 64; // Keep nodes off the chunk link's cache line
+        arena->bump_end = chunk + ARENA_CHUNK_SIZE;
+        arena->bytes += ARENA_CHUNK_SIZE;
+    }
+    Node* slab = (Node*)arena->bump;
+    arena->bump += NODE_SLAB * sizeof(Node);
+    pthread_mutex_unlock(&arena->mutex);
+
+    for (int i = 1; i < NODE_SLAB - 1; i++) slab[i].next = &slab[i + 1];
+    slab[NODE_SLAB - 1].next = NULL;
+    arena->free_lists[stripe] = &slab[1];
+    return &slab[0];
+}
+
+// Caller holds the stripe's mutex. Puts a node without versions back on the free list.
+static void node_recycle(HashTable* table, size_t stripe, Node* node) {
+    NodeArena* arena = table->arena;
+    if (!arena) {
+        if (!retired_nodes) { // Make sure the list is released if this thread exits
+            pthread_once(&retire_once, retire_key_create);
+            pthread_setspecific(retire_key, &retired_nodes);
+        }
+        node->next = retired_nodes;
+        retired_nodes = node;
+        retired_count++;
+        return;
+    }
+    node->next = arena->free_lists[stripe];
+    arena->free_lists[stripe] = node;
+}
+
+// Caller holds the stripe's mutex
+static void node_free(HashTable* table, size_t stripe, Node* node) {
+    mvcc_free_versions(table, node);
+    node_recycle(table, stripe, node);
+}
+
+static void arena_destroy(NodeArena* arena) {
+    if (!arena) return;
+    while (arena->chunks) {
+        void* next = *(void**)arena->chunks;
+        mem_unmap(arena->chunks, ARENA_CHUNK_SIZE);
+        arena->chunks = next;
+    }
+    pthread_mutex_destroy(&arena->mutex);
+    free(arena);
+}
+
+// Chooses where future bucket arrays (from the next resize on) and nodes are allocated.
+// HT_MEM_NODE_ARENA can only be switched while the table is empty, because nodes must be
+// returned to the allocator they came from. Returns 1 on success, 0 on failure.
+int ht_set_memory_policy(HashTable* table, unsigned mem_flags) {
+    if (!table) return 0;
+
+    int ok = 1;
+    pthread_mutex_lock(&table->resize_mutex);
+    lock_all_buckets(table);
+
+    bool want_arena = (mem_flags & HT_MEM_NODE_ARENA) != 0;
+    if (want_arena != (table->arena != NULL)) {
+        if (count_load(table) != 0) {
+            ok = 0;
+        } else if (want_arena) {
+            NodeArena* arena = calloc(1, sizeof(NodeArena));
+            if (arena && pthread_mutex_init(&arena->mutex, NULL) == 0) {
+                arena->flags = mem_flags;
+                table->arena = arena;
+            } else {
+                free(arena);
+                ok = 0;
+            }
+        } else {
+            arena_destroy(table->arena);
+            table->arena = NULL;
+        }
+    }
+    if (ok) {
+        table->mem_flags = mem_flags;
+        if (table->arena) table->arena->flags = mem_flags;
+    }
+
+    unlock_all_buckets(table);
+    pthread_mutex_unlock(&table->resize_mutex);
+    return ok;
+}
+
+
+// ============================================================================================= //
+// ============================================ RESIZE ========================================= //
+// ============================================================================================= //
+// Resizes are incremental: migration_start() swaps in the new array and from then on keys
+// whose old bucket has not been moved yet are found in old_buckets (see locate_bucket).
+// Each migrate_chunk() holds every bucket mutex only long enough to move MIGRATE_CHUNK old
+// buckets, so other threads keep working between steps. Callers hold resize_mutex.
+static bool migration_start(HashTable* table, size_t new_size) {
+    Node** new_buckets = bucket_alloc(table, new_size);
+    if (!new_buckets) return false;
+
+    // Moved nodes and new inserts fill a fresh filter, which replaces the old one
+    // (and its stale bits) when the last chunk is done
+    NegFilter* filter = atomic_load(&table->filter);
+    NegFilter* next_filter = filter ? filter_create((size_t)((double)new_size * 0.7), filter->bits_per_key) : NULL;
+
+    double start = clock_ms();
+    lock_all_buckets(table);
+    table->old_buckets = table->buckets;
+    table->old_size = table->size;
+    table->migrate_cursor = 0;
+    table->buckets = new_buckets;
+    table->size = new_size;
+    table->next_filter = next_filter;
+    if (next_filter && table->tier) ht_tier_keys(table->tier, filter_add_key, next_filter);
+    atomic_fetch_add_explicit(&table->geometry, 1, memory_order_release);
+    bump_all_stripe_versions(table);
+    unlock_all_buckets(table);
+    table->resizes++;
+    table->resize_ms += clock_ms() - start;
+    return true;
+}
+
+// Links nodes (keys[i] == nodes[i]->key) at the head of their new buckets. Returns 0, the
+// number of nodes left pending.
+static size_t migrate_link(HashTable* table, Node** nodes, const int* keys, size_t n) {
+    size_t indices[HASH_BATCH];
+    hash_batch(keys, n, table->size, indices, NULL);
+    for (size_t i = 0; i < n; i++) {
+        // With every index known up front, the scattered head writes can be prefetched
+        if (i + MIGRATE_PREFETCH < n) __builtin_prefetch(&table->buckets[indices[i + MIGRATE_PREFETCH]], 1, 1);
+        nodes[i]->next = table->buckets[indices[i]]; // Set to NULL if empty or current head
+        __atomic_store_n(&table->buckets[indices[i]], nodes[i], __ATOMIC_RELEASE); // resize_read walks it
+        if (table->next_filter) filter_add(table->next_filter, keys[i]);
+    }
+    return 0;
+}
+
+// Lock-free readers (resize_read) may be walking old_buckets[migrate_busy ..) and the new
+// array while a step runs: busy is raised before a batch is relinked, done after
+static void migrate_publish(atomic_size_t* progress, size_t value) {
+    atomic_store_explicit(progress, value, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+// Returns true while old buckets remain
+static bool migrate_chunk(HashTable* table) {
+    double start = clock_ms();
+    lock_all_buckets(table);
+    if (!table->old_buckets) {
+        unlock_all_buckets(table);
+        return false;
+    }
+
+    size_t end = table->migrate_cursor + MIGRATE_CHUNK;
+    if (end > table->old_size) end = table->old_size;
+    atomic_store_explicit(&table->migrate_done, table->migrate_cursor, memory_order_relaxed);
+    atomic_store_explicit(&table->migrate_busy, table->migrate_cursor, memory_order_relaxed);
+    atomic_store_explicit(&table->migrating, true, memory_order_release);
+
+    // Rehash the chunk's keys into new buckets, HASH_BATCH nodes per hash_batch call. Old
+    // chains stay intact until their batch is relinked, and heads are cleared at the end.
+    Node* nodes[HASH_BATCH];
+    int keys[HASH_BATCH];
+    size_t pending = 0;
+    for (size_t i = table->migrate_cursor; i < end; i++) {
+        Node* current = table->old_buckets[i];
+        while (current) { // Traverse linked list until NULL
+            nodes[pending] = current;
+            keys[pending++] = current->key;
+            current = current->next; // Read before the node is re-linked
+            if (pending == HASH_BATCH) {
+                migrate_publish(&table->migrate_busy, i + 1);
+                pending = migrate_link(table, nodes, keys, pending);
+                migrate_publish(&table->migrate_done, i); // Bucket i may still have nodes to go
+            }
+        }
+    }
+    migrate_publish(&table->migrate_busy, end);
+    migrate_link(table, nodes, keys, pending);
+    migrate_publish(&table->migrate_done, end);
+    memset(&table->old_buckets[table->migrate_cursor], 0, (end - table->migrate_cursor) * sizeof(Node*));
+    table->migrate_cursor = end;
+
+    // Nothing below may be freed or changed under a lock-free reader
+    atomic_store(&table->migrating, false);
+    resize_readers_drain(table);
+
+    bool more = end < table->old_size;
+    if (!more) {
+        // Free old buckets and switch to the filter built during the migration
+        bucket_free(table->old_buckets);
+        table->old_buckets = NULL;
+        table->old_size = 0;
+        table->migrate_cursor = 0;
+
+        if (table->next_filter) {
+            filter_replace_locked(table, table->next_filter);
+            table->next_filter = NULL;
+        }
+    }
+
+    atomic_fetch_add_explicit(&table->geometry, 1, memory_order_release);
+    bump_all_stripe_versions(table); // Moved keys changed stripe
+    unlock_all_buckets(table);
+    table->resize_ms += clock_ms() - start;
+    return more;
+}
+
+// Callers serialize on resize_mutex. Finishes any resize already in flight, then grows to
+// new_size. Bucket mutexes are only held one chunk at a time, so other threads keep
+// inserting and reading while the calling thread moves the nodes.
+void ht_resize(HashTable* table, size_t new_size) {
+    if (!table || new_size == 0) return;
+
+    while (migrate_chunk(table)) {}
+    if (new_size <= table->size) return;
+
+    if (!migration_start(table, new_size)) return;
+    while (migrate_chunk(table)) {}
+}
+
+
+// ============================================================================================= //
+// ==================================== READS DURING RESIZE ==================================== //
+// ============================================================================================= //
+// A resize step holds every stripe while it relinks MIGRATE_CHUNK old buckets, which on a big
+// table would stall every ht_get for the whole step. A reader that finds its stripe taken by a
+// step reads around it instead, without the lock:
+// - No writer can run while the step holds every stripe, and the step only relinks nodes.
+//   Per old bucket, migrate_busy and migrate_done say whether its chain is still whole (read
+//   it there), already relinked (read the new array, where nodes are only ever prepended),
+//   or being relinked right now (retry; that is one batch of HASH_BATCH nodes).
+// - Readers count themselves in resize_readers, and the step waits for them to leave before
+//   it releases the stripes or frees the old array, so nothing they see is freed or changed
+//   by a writer under them.
+
+// Caller holds every stripe and has cleared migrating, so no new reader starts
+static void resize_readers_drain(HashTable* table) {
+    for (int i = 0; i < NUM_MUTEXES; i++) {
+        while (atomic_load(&table->resize_readers[i].active) != 0) sched_yield();
+    }
+}
+
+// Walks a chain the step may be relinking: in the old array the caller validates against
+// migrate_busy after, so the race is left to that check
+__attribute__((no_sanitize_thread))
+static bool resize_chain_get(Node** head, int key, int* value) {
+    for (Node* current = __atomic_load_n(head, __ATOMIC_ACQUIRE); current; current = current->next) {
+        if (current->key != key) continue;
+        if (current->flags & NODE_DEAD) return false;
+        *value = current->value;
+        return true;
+    }
+    return false;
+}
+
+// 1 = found, 0 = not found, -1 if no step is running (then take the stripe as usual). Tiered
+// tables always get -1: a miss there needs a promotion, which needs the stripe.
+static int resize_read(HashTable* table, int key, int* value) {
+    StripeReaders* readers = &table->resize_readers[(unsigned)key % NUM_MUTEXES];
+    atomic_fetch_add(&readers->active, 1);
+
+    int result = -1;
+    if (atomic_load(&table->migrating) && !table->tier) {
+        size_t old_index = hash_function(key, table->old_size);
+        int found_value = 0;
+        while (result < 0) {
+            size_t busy = atomic_load_explicit(&table->migrate_busy, memory_order_acquire);
+            if (old_index >= busy) { // Chain untouched so far
+                bool found = resize_chain_get(&table->old_buckets[old_index], key, &found_value);
+                atomic_thread_fence(memory_order_acquire);
+                if (atomic_load_explicit(&table->migrate_busy, memory_order_relaxed) <= old_index) result = found;
+            } else if (old_index < atomic_load_explicit(&table->migrate_done, memory_order_acquire)) {
+                result = resize_chain_get(&table->buckets[hash_function(key, table->size)], key, &found_value);
+            } else {
+                sched_yield(); // Its batch is being relinked
+            }
+        }
+        if (result) *value = found_value;
+    }
+
+    atomic_fetch_sub_explicit(&readers->active, 1, memory_order_release);
+    return result;
+}
+
+// lock_bucket for ht_get: returns NULL instead of waiting when a resize step holds the stripe
+static pthread_mutex_t* lock_bucket_for_read(HashTable* table, int key, BucketRef* ref) {
+    for (;;) {
+        unsigned geometry = atomic_load_explicit(&table->geometry, memory_order_acquire);
+        locate_bucket(table, key, ref);
+        pthread_mutex_t* mutex = get_bucket_mutex(table, ref->stripe);
+
+        if (pthread_mutex_trylock(mutex) == 0) {
+            counter_bump(&table->stripe_counters[ref->stripe].acquisitions);
+        } else if (atomic_load_explicit(&table->migrating, memory_order_acquire)) {
+            return NULL;
+        } else {
+            stripe_lock(table, ref->stripe);
+        }
+        if (atomic_load_explicit(&table->geometry, memory_order_relaxed) == geometry) return mutex;
+        pthread_mutex_unlock(mutex); // Table was resized: hash again
+    }
+}
+
+
+// ============================================================================================= //
+// ====================================== BACKGROUND RESIZE ==================================== //
+// ============================================================================================= //
+// With a maintenance thread, the insert that crosses the soft threshold only signals it; the
+// thread grows the table chunk by chunk while writers carry on. Writers only grow the table
+// themselves past the hard threshold, as a safety valve if the thread falls behind.
+static void background_grow(HashTable* table) {
+    pthread_mutex_lock(&table->resize_mutex);
+    float load_factor = (float)count_load(table) / (float)table->size;
+    if (!table->old_buckets && load_factor > table->maint.soft_threshold) {
+        size_t new_size = next_prime(table->size * 2 + 1);
+        migration_start(table, new_size);
+    }
+    pthread_mutex_unlock(&table->resize_mutex);
+
+    // Release resize_mutex between chunks so a writer past the hard threshold can help
+    for (;;) {
+        pthread_mutex_lock(&table->resize_mutex);
+        bool more = migrate_chunk(table);
+        pthread_mutex_unlock(&table->resize_mutex);
+        if (!more) break;
+        sched_yield();
+    }
+}
+
+static void* maintenance_main(void* arg) {
+    HashTable* table = arg;
+    Maintenance* maint = &table->maint;
+
+    pthread_mutex_lock(&maint->mutex);
+    for (;;) {
+        while (!maint->pending && !maint->stop) pthread_cond_wait(&maint->cond, &maint->mutex);
+        if (maint->stop) break;
+        maint->pending = false;
+        pthread_mutex_unlock(&maint->mutex);
+
+        // Inserts during a migration can cross the threshold again: keep going until below it
+        do {
+            background_grow(table);
+        } while ((float)count_load(table) / (float)table->size > maint->soft_threshold);
+        atomic_store(&maint->grow_requested, false);
+
+        pthread_mutex_lock(&maint->mutex);
+    }
+    pthread_mutex_unlock(&maint->mutex);
+    return NULL;
+}
+
+static void maintenance_request(HashTable* table) {
+    Maintenance* maint = &table->maint;
+    if (atomic_exchange(&maint->grow_requested, true)) return; // Already signalled
+
+    pthread_mutex_lock(&maint->mutex);
+    maint->pending = true;
+    pthread_cond_signal(&maint->cond);
+    pthread_mutex_unlock(&maint->mutex);
+}
+
+static void maintenance_stop(HashTable* table) {
+    Maintenance* maint = &table->maint;
+    if (!maint->running) return;
+
+    pthread_mutex_lock(&maint->mutex);
+    maint->stop = true;
+    pthread_cond_signal(&maint->cond);
+    pthread_mutex_unlock(&maint->mutex);
+
+    pthread_join(maint->thread, NULL);
+    pthread_cond_destroy(&maint->cond);
+    pthread_mutex_destroy(&maint->mutex);
+    maint->running = false;
+}
+
+// Starts the maintenance thread. soft_threshold must be below hard_threshold (e.g. 0.7 and
+// 2.0). Call before sharing the table between threads. Returns 1 on success, 0 on failure.
+int ht_enable_background_resize(HashTable* table, float soft_threshold, float hard_threshold) {
+    if (!table || table->maint.running || soft_threshold <= 0.0f || hard_threshold <= soft_threshold) return 0;
+
+    Maintenance* maint = &table->maint;
+    maint->soft_threshold = soft_threshold;
+    maint->hard_threshold = hard_threshold;
+    maint->pending = false;
+    maint->stop = false;
+    atomic_store(&maint->grow_requested, false);
+
+    if (pthread_mutex_init(&maint->mutex, NULL) != 0) return 0;
+    if (pthread_cond_init(&maint->cond, NULL) != 0) {
+        pthread_mutex_destroy(&maint->mutex);
+        return 0;
+    }
+    if (pthread_create(&maint->thread, NULL, maintenance_main, table) != 0) {
+        pthread_cond_destroy(&maint->cond);
+        pthread_mutex_destroy(&maint->mutex);
+        return 0;
+    }
+    maint->running = true;
+    return 1;
+}
+
+
+// ============================================================================================= //
+// =========================================== CREATE ========================================== //
+// ============================================================================================= //
+HashTable* create_hashtable(size_t size) {
+    HashTable* table = aligned_alloc(64, sizeof(HashTable)); // Stripe counters are cache-line aligned
+    if (!table) return NULL;
+
+    table->size = size;
+    table->mem_flags = HT_MEM_DEFAULT;
+    table->arena = NULL;
+    table->buckets = bucket_alloc(table, table->size);
+    
+    
+    // If calloc fails then it frees the memory allocated for the table
+    if (!table->buckets) {
+        free(table);
+        return NULL;
+    }
+
+    atomic_init(&table->count, 0);
+    atomic_init(&table->filter, NULL);
+    atomic_init(&table->filter_stale, 0);
+    atomic_init(&table->exec_mode, HT_EXEC_LOCKING);
+    table->fc_slots = NULL;
+    table->id = atomic_fetch_add(&next_table_id, 1) & 0xFFFFFF; // 24 bits in the cache tag
+    if (table->id == 0) table->id = atomic_fetch_add(&next_table_id, 1) & 0xFFFFFF;
+    atomic_init(&table->read_cache, false);
+    for (int i = 0; i < NUM_MUTEXES; i++) atomic_init(&table->stripe_versions[i], 0);
+    table->old_buckets = NULL;
+    table->old_size = 0;
+    table->migrate_cursor = 0;
+    atomic_init(&table->migrating, false);
+    atomic_init(&table->migrate_done, 0);
+    atomic_init(&table->migrate_busy, 0);
+    for (int i = 0; i < NUM_MUTEXES; i++) {
+        atomic_init(&table->resize_readers[i].active, 0);
+        atomic_init(&table->filter_readers[i].active, 0);
+    }
+    atomic_init(&table->geometry, 0);
+    table->next_filter = NULL;
+    table->maint.running = false;
+    atomic_init(&table->epoch, 1);
+    atomic_init(&table->snapshots_active, 0);
+    atomic_init(&table->versions_live, 0);
+    atomic_init(&table->versions_lost, 0);
+    table->snapshots = NULL;
+    table->checkpoint_pid = 0;
+    table->checkpoint_pipe = -1;
+    table->tier = NULL;
+    table->tier_budget = 0;
+    table->evict_cursor = 0;
+    for (int i = 0; i < NUM_MUTEXES; i++) {
+        atomic_init(&table->stripe_counters[i].acquisitions, 0);
+        atomic_init(&table->stripe_counters[i].contended, 0);
+        atomic_init(&table->stripe_counters[i].busy, 0);
+    }
+    table->resizes = 0;
+    table->resize_ms = 0.0;
+
+    // Initialize mutexes
+    for (int i = 0; i < NUM_MUTEXES; i++) {
+        if (pthread_mutex_init(&table->mutexes[i], NULL) != 0) {
+            // Limpieza parcial
+            for (int j = 0; j < i; j++) pthread_mutex_destroy(&table->mutexes[j]);
+            bucket_free(table->buckets);
+            free(table);
+            return NULL;
+        }
+    }
+
+    // Initialize resize mutex
+    if (pthread_mutex_init(&table->resize_mutex, NULL) != 0) {
+        for (int i = 0; i < NUM_MUTEXES; i++) pthread_mutex_destroy(&table->mutexes[i]);
+        bucket_free(table->buckets);
+        free(table);
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&table->snapshot_mutex, NULL) != 0) {
+        for (int i = 0; i < NUM_MUTEXES; i++) pthread_mutex_destroy(&table->mutexes[i]);
+        pthread_mutex_destroy(&table->resize_mutex);
+        bucket_free(table->buckets);
+        free(table);
+        return NULL;
+    }
+
+    if (pthread_mutex_init(&table->checkpoint_mutex, NULL) != 0) {
+        for (int i = 0; i < NUM_MUTEXES; i++) pthread_mutex_destroy(&table->mutexes[i]);
+        pthread_mutex_destroy(&table->resize_mutex);
+        pthread_mutex_destroy(&table->snapshot_mutex);
+        bucket_free(table->buckets);
+        free(table);
+        return NULL;
+    }
+
+    return table;
+}
+
+
+// ============================================================================================= //
+// ============================================= INSERT ======================================== //
+// ============================================================================================= //
+// Caller holds the bucket's mutex. Returns key's node (possibly a tombstone), bringing it
+// back from the disk tier if it was evicted, or NULL if the key is nowhere.
+static Node* bucket_find(HashTable* table, const BucketRef* ref, int key) {
+    for (Node* current = *ref->head; current; current = current->next) {
+        if (current->key == key) return current;
+    }
+    return tier_promote(table, ref, key);
+}
+
+// Caller holds the bucket's mutex and knows the key is absent. Links `node` (key and value
+// set) at the head of the chain.
+static void bucket_link(HashTable* table, const BucketRef* ref, Node* node) {
+    node->versions = NULL;
+    node->flags = NODE_DEAD; // "Absent" is the state open snapshots must keep seeing
+    mvcc_record(table, node);
+    node->flags = 0;
+
+    // Publish to the filter before the node becomes reachable
+    NegFilter* filter = atomic_load_explicit(&table->filter, memory_order_relaxed);
+    if (filter) filter_add(filter, node->key);
+    if (table->next_filter) filter_add(table->next_filter, node->key);
+
+    node->next = *ref->head;
+    *ref->head = node;
+    bump_stripe_version(table, ref->stripe);
+
+    count_add(table, 1);
+}
+
+// Caller holds the bucket's mutex. Updates the value in place if the key exists,
+// otherwise links a new node at the head. Returns true if a node was added.
+static bool bucket_insert(HashTable* table, const BucketRef* ref, int key, int value) {
+    // Search if key already exists and update value if so
+    Node* current = bucket_find(table, ref, key);
+    if (current) {
+        mvcc_record(table, current);
+        current->value = value;
+        current->flags |= NODE_ACCESSED;
+        bump_stripe_version(table, ref->stripe);
+        if (!(current->flags & NODE_DEAD)) return false;
+
+        // Tombstone kept for a snapshot: the key comes back to life
+        NegFilter* filter = atomic_load_explicit(&table->filter, memory_order_relaxed);
+        if (filter) filter_add(filter, key);
+        if (table->next_filter) filter_add(table->next_filter, key);
+        current->flags &= ~NODE_DEAD;
+        count_add(table, 1);
+        return true;
+    }
+
+    // Key does not exist: create new node
+    Node* new_node = node_alloc(table, ref->stripe);
+    if (!new_node) return false;
+    if (table->tier) ht_tier_remove(table->tier, key); // A promotion that ran out of memory left it there
+    new_node->key = key;
+    new_node->value = value;
+    bucket_link(table, ref, new_node);
+    return true;
+}
+
+// Called after an insert added a node, with no bucket mutex held
+static void check_load_factor(HashTable* table) {
+    float load_factor = (float)count_load(table) / (float)table->size;
+    float threshold = 0.7f;
+
+    if (table->maint.running) {
+        if (load_factor > table->maint.soft_threshold) maintenance_request(table);
+        threshold = table->maint.hard_threshold; // Safety valve only
+    }
+    if (load_factor <= threshold) return;
+
+    pthread_mutex_lock(&table->resize_mutex);  // Acquire resize lock
+
+    // Double-check load factor (in case another thread resized)
+    if ((float)count_load(table) / (float)table->size > threshold) {
+        size_t candidate = table->size * 2 + 1;
+        size_t new_size = next_prime(candidate);
+        printf("Resizing table from %zu to %zu due to load factor %.2f\n", table->size, new_size, load_factor);
+        ht_resize(table, new_size);
+    }
+
+    pthread_mutex_unlock(&table->resize_mutex);  // Release resize lock
+}
+
+void ht_insert(HashTable* table, int key, int value) {
+    if (!table) return;
+    TRACE_OP(HT_TRACE_INSERT, key, value);
+
+    bool added;
+    if (atomic_load_explicit(&table->exec_mode, memory_order_acquire) == HT_EXEC_FLAT_COMBINING) {
+        added = fc_execute(table, FC_OP_INSERT, key, value, NULL, NULL, NULL);
+    } else {
+        BucketRef ref;
+        pthread_mutex_t* bucket_mutex = lock_bucket(table, key, &ref);
+        added = bucket_insert(table, &ref, key, value);
+        pthread_mutex_unlock(bucket_mutex);
+    }
+
+    if (added) check_load_factor(table);
+    tier_evict_if_needed(table);
+}
+
+
+// ============================================================================================= //
+// ============================================= GET =========================================== //
+// ============================================================================================= //
+// Caller holds the bucket's mutex
+static bool bucket_get(HashTable* table, const BucketRef* ref, int key, int* value) {
+    Node* current = bucket_find(table, ref, key);
+    if (!current || (current->flags & NODE_DEAD)) return false;
+    *value = current->value;
+    current->flags |= NODE_ACCESSED;
+    return true;
+}
+
+int ht_get(HashTable* table, int key_to_seek, int* seeked_value) {
+    if (!table || !table->buckets) return 0;
+    TRACE_OP(HT_TRACE_GET, key_to_seek, 0);
+
+    // Repeat reads of hot keys are served from this thread's cache
+    bool cached = atomic_load_explicit(&table->read_cache, memory_order_acquire);
+    if (cached && read_cache_lookup(table, key_to_seek, seeked_value)) return 1;
+
+    // Most misses end here without touching the bucket array or any mutex
+    if (filter_excludes(table, key_to_seek)) return 0;
+
+    if (atomic_load_explicit(&table->exec_mode, memory_order_acquire) == HT_EXEC_FLAT_COMBINING) {
+        size_t stripe;
+        unsigned version;
+        int value;
+        bool found = fc_execute(table, FC_OP_GET, key_to_seek, 0, &value, &stripe, &version);
+        tier_evict_if_needed(table);
+        if (!found) return 0;
+        if (cached) read_cache_fill(table, stripe, key_to_seek, value, version);
+        *seeked_value = value;
+        return 1;
+    }
+
+    BucketRef ref;
+    pthread_mutex_t* mutex = lock_bucket_for_read(table, key_to_seek, &ref);
+    if (!mutex) { // A resize step holds the stripe: read around it
+        int found = resize_read(table, key_to_seek, seeked_value);
+        if (found >= 0) return found;
+        mutex = lock_bucket(table, key_to_seek, &ref);
+    }
+    bool found = bucket_get(table, &ref, key_to_seek, seeked_value);
+    if (found && atomic_load_explicit(&table->read_cache, memory_order_relaxed)) { // Stripe held
+        unsigned version = atomic_load_explicit(&table->stripe_versions[ref.stripe], memory_order_relaxed);
+        read_cache_fill(table, ref.stripe, key_to_seek, *seeked_value, version);
+    }
+    pthread_mutex_unlock(mutex);
+
+    tier_evict_if_needed(table); // A promotion may have pushed memory over budget
+
+    return found ? 1 : 0; // 1 = found, 0 = not found
+}
+
+
+// ============================================================================================= //
+// ========================================= BATCH GET ========================================= //
+// ============================================================================================= //
+// Asynchronous memory access chaining (AMAC): a batch of lookups runs as AMAC_WINDOW small
+// state machines. Each step issues a prefetch for the lookup's next hop (bucket slot, then
+// each chain node) and moves on to another lookup, so one thread keeps a window of cache
+// misses in flight instead of waiting for them one at a time.
+//
+// A lookup holds its stripe mutex from the bucket read to the end of its chain walk, so
+// several stripes can be held at once. They are only ever taken with trylock (a stripe the
+// batch already holds is shared by reference count); a lookup blocks on a mutex only when
+// the batch holds nothing, so it cannot deadlock against other batches or a resize.
+#define AMAC_WINDOW 16
+
+typedef enum {
+    AMAC_IDLE,
+    AMAC_LOCK,      // Bucket slot prefetched, waiting for the stripe
+    AMAC_WALK       // Stripe held, current node prefetched
+} AmacState;
+
+typedef struct {
+    AmacState state;
+    size_t index;       // Position in the batch
+    int key;
+    unsigned geometry;  // Table geometry the bucket was located with
+    BucketRef ref;
+    Node* current;
+} AmacLookup;
+
+// Takes the lookup's stripe. Returns false if it is busy (try again on a later round).
+static bool amac_lock(HashTable* table, AmacLookup* lookup, uint8_t* held, size_t* held_total) {
+    size_t stripe = lookup->ref.stripe;
+    if (held[stripe] == 0) {
+        if (*held_total == 0) {
+            stripe_lock(table, stripe);
+        } else {
+            if (pthread_mutex_trylock(get_bucket_mutex(table, stripe)) != 0) return false;
+            counter_bump(&table->stripe_counters[stripe].acquisitions);
+        }
+    }
+    held[stripe]++;
+    (*held_total)++;
+    return true;
+}
+
+static void amac_unlock(HashTable* table, size_t stripe, uint8_t* held, size_t* held_total) {
+    (*held_total)--;
+    if (--held[stripe] == 0) pthread_mutex_unlock(get_bucket_mutex(table, stripe));
+}
+
+static void amac_locate(HashTable* table, AmacLookup* lookup) {
+    lookup->geometry = atomic_load_explicit(&table->geometry, memory_order_acquire);
+    locate_bucket(table, lookup->key, &lookup->ref);
+    __builtin_prefetch(lookup->ref.head, 0, 1);
+    lookup->state = AMAC_LOCK;
+}
+
+// Bucket indices for keys[from..from+n), hashed in one hash_batch call. Only used while the
+// table's geometry still matches and no resize was in flight when they were computed; the
+// lock step re-checks the geometry as for any lookup.
+typedef struct {
+    size_t from;
+    size_t to;
+    unsigned geometry;
+    Node** buckets;     // NULL: a resize was in flight, locate each key on its own
+    size_t indices[HASH_BATCH];
+    uint8_t stripes[HASH_BATCH];
+} AmacHashed;
+
+static void amac_hash(HashTable* table, const int* keys, size_t from, size_t n, AmacHashed* hashed) {
+    hashed->from = from;
+    hashed->to = from + (n - from < HASH_BATCH ? n - from : HASH_BATCH);
+    hashed->geometry = atomic_load_explicit(&table->geometry, memory_order_acquire);
+    hashed->buckets = table->old_buckets ? NULL : table->buckets;
+    size_t size = table->size;
+    if (hashed->buckets) hash_batch(keys + from, hashed->to - from, size, hashed->indices, hashed->stripes);
+}
+
+static void amac_start(HashTable* table, AmacLookup* lookup, const AmacHashed* hashed) {
+    if (!hashed->buckets) {
+        amac_locate(table, lookup);
+        return;
+    }
+    size_t j = lookup->index - hashed->from;
+    lookup->geometry = hashed->geometry;
+    lookup->ref.head = &hashed->buckets[hashed->indices[j]];
+    lookup->ref.stripe = hashed->stripes[j];
+    __builtin_prefetch(lookup->ref.head, 0, 1);
+    lookup->state = AMAC_LOCK;
+}
+
+// Looks up keys[0..n). values[i] is set and found[i] = 1 for every key present, found[i] = 0
+// otherwise. Same results as n calls to ht_get, but with the cache misses overlapped.
+// Returns the number of keys found.
+size_t ht_get_batch(HashTable* table, const int* keys, int* values, int* found, size_t n) {
+    if (!table || !table->buckets) return 0;
+
+    // Flat combining serializes per stripe anyway; nothing to interleave
+    if (atomic_load_explicit(&table->exec_mode, memory_order_acquire) == HT_EXEC_FLAT_COMBINING) {
+        size_t hits = 0;
+        for (size_t i = 0; i < n; i++) hits += (size_t)(found[i] = ht_get(table, keys[i], &values[i]));
+        return hits;
+    }
+#ifdef HT_TRACE
+    for (size_t i = 0; i < n; i++) TRACE_OP(HT_TRACE_GET, keys[i], 0);
+#endif
+
+    AmacLookup window[AMAC_WINDOW];
+    AmacHashed hashed = { .from = 0, .to = 0 };
+    uint8_t held[NUM_MUTEXES] = {0};
+    size_t held_total = 0;
+    size_t next = 0, active = 0, hits = 0;
+    bool cached = atomic_load_explicit(&table->read_cache, memory_order_acquire);
+
+    for (int w = 0; w < AMAC_WINDOW; w++) window[w].state = AMAC_IDLE;
+
+    while (next < n || active > 0) {
+        for (int w = 0; w < AMAC_WINDOW; w++) {
+            AmacLookup* lookup = &window[w];
+
+            switch (lookup->state) {
+                case AMAC_IDLE:
+                    // Start the next key, answering it right away if the cache or filter can
+                    while (next < n) {
+                        if (next == hashed.to) amac_hash(table, keys, next, n, &hashed);
+                        size_t i = next++;
+                        found[i] = 0;
+                        if (cached && read_cache_lookup(table, keys[i], &values[i])) {
+                            found[i] = 1;
+                            hits++;
+                            continue;
+                        }
+                        if (filter_excludes(table, keys[i])) continue;
+
+                        lookup->index = i;
+                        lookup->key = keys[i];
+                        amac_start(table, lookup, &hashed);
+                        active++;
+                        break;
+                    }
+                    break;
+
+                case AMAC_LOCK:
+                    if (!amac_lock(table, lookup, held, &held_total)) break;
+                    if (atomic_load_explicit(&table->geometry, memory_order_relaxed) != lookup->geometry) {
+                        amac_unlock(table, lookup->ref.stripe, held, &held_total); // Resized: locate again
+                        amac_locate(table, lookup);
+                        break;
+                    }
+                    lookup->current = *lookup->ref.head;
+                    __builtin_prefetch(lookup->current, 0, 1);
+                    lookup->state = AMAC_WALK;
+                    break;
+
+                case AMAC_WALK: {
+                    Node* current = lookup->current;
+                    if (current && current->key != lookup->key) {
+                        lookup->current = current->next;
+                        __builtin_prefetch(lookup->current, 0, 1);
+                        break;
+                    }
+
+                    size_t i = lookup->index;
+                    if (!current) current = tier_promote(table, &lookup->ref, lookup->key);
+                    if (current && !(current->flags & NODE_DEAD)) {
+                        current->flags |= NODE_ACCESSED;
+                        values[i] = current->value;
+                        found[i] = 1;
+                        hits++;
+                        if (cached) {
+                            unsigned version = atomic_load_explicit(&table->stripe_versions[lookup->ref.stripe], memory_order_relaxed);
+                            read_cache_fill(table, lookup->ref.stripe, lookup->key, current->value, version);
+                        }
+                    }
+                    amac_unlock(table, lookup->ref.stripe, held, &held_total);
+                    lookup->state = AMAC_IDLE;
+                    active--;
+                    break;
+                }
+            }
+        }
+    }
+
+    tier_evict_if_needed(table);
+    return hits;
+}
+
+
+// ============================================================================================= //
+// ============================================ PRINT ========================================== //
+// ============================================================================================= //
+void print_hashtable(HashTable* table) {
+    if (!table) return;
+
+    pthread_mutex_lock(&table->resize_mutex); // Lock during print to avoid resizing
+    while (migrate_chunk(table)) {} // Finish a resize in flight so every key is in buckets
+
+    for (size_t i = 0; i < table->size; i++) {
+        printf("Bucket[%zu]: ", i);
+        Node* current = table->buckets[i];
+        while (current) {
+            if (!(current->flags & NODE_DEAD)) printf("-> ( %d, %d) ", current->key, current->value);
+            current = current->next;
+        }
+        printf("-> NULL\n");
+    }
+    if (table->tier) printf("Disk tier: %zu entries\n", ht_tier_count(table->tier));
+
+    pthread_mutex_unlock(&table->resize_mutex); // Unlock after printing
+}
+
+
+// ============================================================================================= //
+// Caller holds the bucket's mutex. Returns true if the key was removed.
+static bool bucket_delete(HashTable* table, const BucketRef* ref, int key) {
+    Node* current = *ref->head;
+    Node* prev = NULL;
+    // Search for the key in the linked list
+    while (current) {
+        if (current->key == key) {
+            if (current->flags & NODE_DEAD) return false;
+
+            if (mvcc_record(table, current)) {
+                current->flags |= NODE_DEAD; // An open snapshot may still read it
+            } else {
+                if (prev) prev->next = current->next;
+                else *ref->head = current->next; // Update head
+                node_free(table, ref->stripe, current);
+            }
+            bump_stripe_version(table, ref->stripe);
+
+            count_add(table, -1);
+            return true;
+        }
+        prev = current;
+        current = current->next;
+    }
+
+    // Evicted keys are deleted like any other, so snapshots keep the right history
+    if (tier_promote(table, ref, key)) return bucket_delete(table, ref, key);
+    return false;
+}
+
+void ht_delete(HashTable* table, int key) {
+    if (!table) return;
+    TRACE_OP(HT_TRACE_DELETE, key, 0);
+
+    bool removed;
+    if (atomic_load_explicit(&table->exec_mode, memory_order_acquire) == HT_EXEC_FLAT_COMBINING) {
+        removed = fc_execute(table, FC_OP_DELETE, key, 0, NULL, NULL, NULL);
+    } else {
+        BucketRef ref;
+        pthread_mutex_t* mutex = lock_bucket(table, key, &ref);
+        removed = bucket_delete(table, &ref, key);
+        pthread_mutex_unlock(mutex);
+    }
+
+    retire_flush();
+    if (removed) filter_note_delete(table, 1);
+}
+
+
+// ============================================================================================= //
+// ======================================= TRY VARIANTS ======================================== //
+// ============================================================================================= //
+// For callers that must not block: the stripe is only ever taken with trylock, spinning until
+// the deadline (no spinning for the try_ forms), and HT_BUSY comes back instead of a wait.
+// A resize step holds every stripe, so it shows up as HT_BUSY too. The follow-up work a
+// blocking call may do on the caller's thread is handed off: growth is only signalled
+// (try_grow), a due filter rebuild waits for the next blocking delete, and eviction for the
+// next blocking call. With tiering, a key on disk is still read with one pread under the
+// stripe.
+#define TRY_SPINS_PER_CLOCK 16  // Spins between deadline checks
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// Like lock_bucket, but gives up (returning NULL) once timeout_us has passed
+static pthread_mutex_t* try_lock_bucket(HashTable* table, int key, BucketRef* ref, unsigned timeout_us) {
+    double deadline = timeout_us ? clock_ms() + timeout_us / 1000.0 : 0.0;
+
+    for (unsigned spins = 1;; spins++) {
+        unsigned geometry = atomic_load_explicit(&table->geometry, memory_order_acquire);
+        locate_bucket(table, key, ref);
+        pthread_mutex_t* mutex = get_bucket_mutex(table, ref->stripe);
+
+        if (pthread_mutex_trylock(mutex) == 0) {
+            if (atomic_load_explicit(&table->geometry, memory_order_relaxed) == geometry) {
+                counter_bump(&table->stripe_counters[ref->stripe].acquisitions);
+                return mutex;
+            }
+            pthread_mutex_unlock(mutex); // Table was resized: hash again
+        }
+
+        if (!timeout_us || (spins % TRY_SPINS_PER_CLOCK == 0 && clock_ms() >= deadline)) {
+            atomic_fetch_add_explicit(&table->stripe_counters[ref->stripe].busy, 1, memory_order_relaxed);
+            return NULL;
+        }
+        cpu_relax();
+    }
+}
+
+// Growth without blocking: it is only ever signalled, never run here, since starting or
+// stepping a migration takes every stripe with a blocking lock and allocates the new array.
+// With a maintenance thread the signal wakes it; without one the growth is left to the next
+// blocking insert, whose check_load_factor sees the same load. Tables used mostly through the
+// try forms should enable background resize.
+static void try_grow(HashTable* table) {
+    if (table->maint.running && (float)count_load(table) / (float)table->size > table->maint.soft_threshold) {
+        maintenance_request(table);
+    }
+}
+
+HtStatus ht_timed_get(HashTable* table, int key_to_seek, int* seeked_value, unsigned timeout_us) {
+    if (!table || !table->buckets) return HT_NOT_FOUND;
+
+    bool cached = atomic_load_explicit(&table->read_cache, memory_order_acquire);
+    if (cached && read_cache_lookup(table, key_to_seek, seeked_value)) {
+        TRACE_OP(HT_TRACE_GET, key_to_seek, 0);
+        return HT_OK;
+    }
+
+    if (filter_excludes(table, key_to_seek)) {
+        TRACE_OP(HT_TRACE_GET, key_to_seek, 0);
+        return HT_NOT_FOUND;
+    }
+
+    BucketRef ref;
+    pthread_mutex_t* mutex = try_lock_bucket(table, key_to_seek, &ref, timeout_us);
+    if (!mutex) return HT_BUSY; // Not traced: nothing happened
+    TRACE_OP(HT_TRACE_GET, key_to_seek, 0);
+    bool found = bucket_get(table, &ref, key_to_seek, seeked_value);
+    if (found && cached) {
+        unsigned version = atomic_load_explicit(&table->stripe_versions[ref.stripe], memory_order_relaxed);
+        read_cache_fill(table, ref.stripe, key_to_seek, *seeked_value, version);
+    }
+    pthread_mutex_unlock(mutex);
+    return found ? HT_OK : HT_NOT_FOUND;
+}
+
+HtStatus ht_timed_insert(HashTable* table, int key, int value, unsigned timeout_us) {
+    if (!table) return HT_NOT_FOUND;
+
+    BucketRef ref;
+    pthread_mutex_t* mutex = try_lock_bucket(table, key, &ref, timeout_us);
+    if (!mutex) return HT_BUSY;
+    TRACE_OP(HT_TRACE_INSERT, key, value);
+    bool added = bucket_insert(table, &ref, key, value);
+    // false means either an update or a failed allocation; only the update left a live node
+    Node* current = *ref.head;
+    while (current && current->key != key) current = current->next;
+    bool stored = added || (current && !(current->flags & NODE_DEAD));
+    pthread_mutex_unlock(mutex);
+
+    if (added) try_grow(table);
+    return stored ? HT_OK : HT_NOT_FOUND;
+}
+
+HtStatus ht_timed_delete(HashTable* table, int key, unsigned timeout_us) {
+    if (!table) return HT_NOT_FOUND;
+
+    BucketRef ref;
+    pthread_mutex_t* mutex = try_lock_bucket(table, key, &ref, timeout_us);
+    if (!mutex) return HT_BUSY;
+    TRACE_OP(HT_TRACE_DELETE, key, 0);
+    bool removed = bucket_delete(table, &ref, key);
+    pthread_mutex_unlock(mutex);
+
+    retire_flush();
+    // Count the stale filter bits; the next blocking delete rebuilds once there are enough
+    if (removed && atomic_load_explicit(&table->filter, memory_order_relaxed)) atomic_fetch_add(&table->filter_stale, 1);
+    return removed ? HT_OK : HT_NOT_FOUND;
+}
+
+// Single attempt: HT_BUSY as soon as the stripe is taken
+HtStatus ht_try_get(HashTable* table, int key_to_seek, int* seeked_value) {
+    return ht_timed_get(table, key_to_seek, seeked_value, 0);
+}
+
+HtStatus ht_try_insert(HashTable* table, int key, int value) {
+    return ht_timed_insert(table, key, value, 0);
+}
+
+HtStatus ht_try_delete(HashTable* table, int key) {
+    return ht_timed_delete(table, key, 0);
+}
+
+
+// ============================================================================================= //
+// ======================================= THREAD HANDLES ====================================== //
+// ============================================================================================= //
+// Every plain call reads buckets/size/old_buckets and bumps count, all on the table's first
+// cache line, which every writer on every core keeps stealing. A handle keeps that state
+// per thread instead:
+// - geometry: buckets and size are cached together with the geometry counter. Geometry only
+//   changes with every stripe held, so once the key's stripe is locked one load tells
+//   whether the cache still holds; if not (a resize ran) the handle rereads it.
+// - count: inserts and deletes add to a local delta, published every HANDLE_COUNT_BATCH
+//   entries (and on release), which is also when growth is checked.
+// - nodes come from the thread's retire list first (see node_alloc).
+// - stats are plain counters only the owning thread writes.
+// While a resize is in flight the handle takes the shared path, which knows old_buckets.
+struct HtHandle {
+    HashTable* table;
+    Node** buckets;         // NULL: not cached (resize in flight or first use)
+    size_t size;
+    unsigned geometry;
+    long count_delta;       // Entries added minus removed, not yet in table->count
+    HtHandleStats stats;
+};
+
+// Handle whose operation this thread is running (inside the stripe lock), NULL otherwise
+static _Thread_local HtHandle* active_handle;
+
+// Count changes of single-key operations go to the running handle, if any
+static void count_add(HashTable* table, int delta) {
+    HtHandle* handle = active_handle;
+    if (handle && handle->table == table) {
+        handle->count_delta += delta;
+    } else if (delta > 0) {
+        atomic_fetch_add(&table->count, (size_t)delta);
+    } else {
+        atomic_fetch_sub(&table->count, (size_t)-delta);
+    }
+}
+
+// table->count read as a signed sum clamped at zero. The additions are modular, so the value
+// is exact once every handle has published; until then a handle that removed keys another
+// path added can leave it transiently below zero, which must not read as a huge count.
+static size_t count_load(const HashTable* table) {
+    size_t raw = atomic_load(&table->count);
+    return (ptrdiff_t)raw < 0 ? 0 : raw;
+}
+
+static void handle_publish(HtHandle* handle) {
+    if (handle->count_delta == 0) return;
+    if (handle->count_delta > 0) atomic_fetch_add(&handle->table->count, (size_t)handle->count_delta);
+    else atomic_fetch_sub(&handle->table->count, (size_t)-handle->count_delta);
+    handle->count_delta = 0;
+    handle->stats.count_flushes++;
+}
+
+// Like lock_bucket, from the cached geometry when it is still current
+static pthread_mutex_t* handle_lock_bucket(HtHandle* handle, int key, BucketRef* ref) {
+    HashTable* table = handle->table;
+    if (handle->buckets) {
+        size_t index = hash_function(key, handle->size);
+        size_t stripe = index % NUM_MUTEXES;
+        stripe_lock(table, stripe);
+        if (atomic_load_explicit(&table->geometry, memory_order_relaxed) == handle->geometry) {
+            ref->head = &handle->buckets[index];
+            ref->stripe = stripe;
+            return &table->mutexes[stripe];
+        }
+        pthread_mutex_unlock(&table->mutexes[stripe]);
+        handle->stats.geometry_misses++;
+    }
+
+    // Any stripe held pins the geometry, so it can be reread here consistently
+    pthread_mutex_t* mutex = lock_bucket(table, key, ref);
+    handle->geometry = atomic_load_explicit(&table->geometry, memory_order_relaxed);
+    handle->buckets = table->old_buckets ? NULL : table->buckets;
+    handle->size = table->size;
+    return mutex;
+}
+
+// Returns a handle for the calling thread. It must only be used by that thread, and
+// released (ht_handle_release) before the thread exits or the table is destroyed.
+// Returns NULL on failure.
+HtHandle* ht_thread_handle(HashTable* table) {
+    if (!table) return NULL;
+    HtHandle* handle = calloc(1, sizeof(HtHandle));
+    if (!handle) return NULL;
+    handle->table = table;
+    return handle;
+}
+
+void ht_handle_insert(HtHandle* handle, int key, int value) {
+    if (!handle) return;
+    HashTable* table = handle->table;
+    handle->stats.inserts++;
+    if (atomic_load_explicit(&table->exec_mode, memory_order_acquire) == HT_EXEC_FLAT_COMBINING) {
+        ht_insert(table, key, value);
+        return;
+    }
+    TRACE_OP(HT_TRACE_INSERT, key, value);
+
+    BucketRef ref;
+    pthread_mutex_t* mutex = handle_lock_bucket(handle, key, &ref);
+    active_handle = handle;
+    bucket_insert(table, &ref, key, value);
+    active_handle = NULL;
+    pthread_mutex_unlock(mutex);
+
+    if (handle->count_delta >= HANDLE_COUNT_BATCH) {
+        handle_publish(handle);
+        check_load_factor(table);
+    }
+    tier_evict_if_needed(table);
+}
+
+// Same result as ht_get: 1 = found, 0 = not found
+int ht_handle_get(HtHandle* handle, int key_to_seek, int* seeked_value) {
+    if (!handle) return 0;
+    HashTable* table = handle->table;
+    handle->stats.gets++;
+
+    bool cached = atomic_load_explicit(&table->read_cache, memory_order_acquire);
+    bool found;
+    if (cached && read_cache_lookup(table, key_to_seek, seeked_value)) {
+        TRACE_OP(HT_TRACE_GET, key_to_seek, 0);
+        found = true;
+    } else if (atomic_load_explicit(&table->exec_mode, memory_order_acquire) == HT_EXEC_FLAT_COMBINING) {
+        found = ht_get(table, key_to_seek, seeked_value); // Traced by ht_get
+    } else {
+        TRACE_OP(HT_TRACE_GET, key_to_seek, 0);
+        if (filter_excludes(table, key_to_seek)) return 0;
+
+        BucketRef ref;
+        pthread_mutex_t* mutex = handle_lock_bucket(handle, key_to_seek, &ref);
+        active_handle = handle;
+        found = bucket_get(table, &ref, key_to_seek, seeked_value);
+        active_handle = NULL;
+        if (found && cached) {
+            unsigned version = atomic_load_explicit(&table->stripe_versions[ref.stripe], memory_order_relaxed);
+            read_cache_fill(table, ref.stripe, key_to_seek, *seeked_value, version);
+        }
+        pthread_mutex_unlock(mutex);
+        tier_evict_if_needed(table); // A promotion may have pushed memory over budget
+    }
+
+    if (found) handle->stats.hits++;
+    return found ? 1 : 0;
+}
+
+void ht_handle_delete(HtHandle* handle, int key) {
+    if (!handle) return;
+    HashTable* table = handle->table;
+    handle->stats.deletes++;
+    if (atomic_load_explicit(&table->exec_mode, memory_order_acquire) == HT_EXEC_FLAT_COMBINING) {
+        ht_delete(table, key);
+        return;
+    }
+    TRACE_OP(HT_TRACE_DELETE, key, 0);
+
+    BucketRef ref;
+    pthread_mutex_t* mutex = handle_lock_bucket(handle, key, &ref);
+    active_handle = handle;
+    bool removed = bucket_delete(table, &ref, key);
+    active_handle = NULL;
+    pthread_mutex_unlock(mutex);
+
+    if (handle->count_delta <= -HANDLE_COUNT_BATCH) handle_publish(handle);
+    retire_flush();
+    if (removed) filter_note_delete(table, 1);
+}
+
+void ht_handle_stats(const HtHandle* handle, HtHandleStats* out) {
+    if (!handle || !out) return;
+    *out = handle->stats;
+}
+
+// Publishes the handle's pending count and frees it
+void ht_handle_release(HtHandle* handle) {
+    if (!handle) return;
+    handle_publish(handle);
+    check_load_factor(handle->table);
+    free(handle);
+}
+
+
+// ============================================================================================= //
+// ====================================== MULTI-KEY UPDATE ===================================== //
+// ============================================================================================= //
+_Static_assert(NUM_MUTEXES <= 64, "transaction stripe sets are a 64-bit mask");
+
+// Adds the stripe of every key the transaction touches to *stripes (one bit per stripe)
+static void txn_collect_stripes(HashTable* table, const HtTxnOp* ops, size_t n, uint64_t* stripes) {
+    BucketRef ref;
+    *stripes = 0;
+    for (size_t i = 0; i < n; i++) {
+        locate_bucket(table, ops[i].key, &ref);
+        *stripes |= 1ULL << ref.stripe;
+        if (ops[i].op == HT_TXN_SET_FROM) {
+            locate_bucket(table, ops[i].value, &ref);
+            *stripes |= 1ULL << ref.stripe;
+        }
+    }
+}
+
+// Caller holds key's stripe. Brings key back from the disk tier, if it is there. Returns false
+// if it is but no node could be allocated for it.
+static bool txn_promote(HashTable* table, int key) {
+    if (!table->tier) return true;
+    BucketRef ref;
+    locate_bucket(table, key, &ref);
+    return bucket_find(table, &ref, key) || !ht_tier_contains(table->tier, key);
+}
+
+// Caller holds every stripe the transaction touches. Promotes every key the ops touch out of
+// the disk tier, then makes sure every op that may add a key finds a node on its stripe's free
+// list (or this thread's retired list), so once the ops start no allocation can fail. Returns
+// false, with nothing applied, if memory ran out.
+static bool txn_reserve_nodes(HashTable* table, const HtTxnOp* ops, size_t n) {
+    Node* reserved[NUM_MUTEXES] = { NULL };
+    BucketRef ref;
+    bool ok = true;
+
+    for (size_t i = 0; i < n && ok; i++) {
+        ok = txn_promote(table, ops[i].key) && (ops[i].op != HT_TXN_SET_FROM || txn_promote(table, ops[i].value));
+    }
+    for (size_t i = 0; i < n && ok; i++) {
+        if (ops[i].op == HT_TXN_GET || ops[i].op == HT_TXN_DELETE) continue;
+        locate_bucket(table, ops[i].key, &ref);
+        Node* node = node_alloc(table, ref.stripe);
+        if (!node) {
+            ok = false;
+            break;
+        }
+        node->next = reserved[ref.stripe];
+        reserved[ref.stripe] = node;
+    }
+
+    // Hand them back: node_alloc pops them again as the ops insert
+    for (size_t stripe = 0; stripe < NUM_MUTEXES; stripe++) {
+        while (reserved[stripe]) {
+            Node* next = reserved[stripe]->next;
+            node_recycle(table, stripe, reserved[stripe]);
+            reserved[stripe] = next;
+        }
+    }
+    return ok;
+}
+
+// Records an applied op as the single-key operation it amounts to (a copy whose source was
+// missing only read it)
+static void txn_trace(const HtTxnOp* op) {
+    switch (op->op) {
+        case HT_TXN_GET:
+            TRACE_OP(HT_TRACE_GET, op->key, 0);
+            break;
+        case HT_TXN_DELETE:
+            TRACE_OP(HT_TRACE_DELETE, op->key, 0);
+            break;
+        case HT_TXN_SET_FROM:
+            if (!op->found) {
+                TRACE_OP(HT_TRACE_GET, op->value, 0); // value still holds the source key
+                break;
+            }
+            // fall through
+        case HT_TXN_SET:
+        case HT_TXN_ADD:
+            TRACE_OP(HT_TRACE_INSERT, op->key, op->value);
+            break;
+    }
+}
+
+// Caller holds every stripe the op touches and has reserved its node. Returns false only if a
+// node could not be allocated.
+static bool txn_apply(HashTable* table, HtTxnOp* op, size_t* added, size_t* removed) {
+    BucketRef ref;
+    int current;
+    bool existed = false;
+
+    if (op->op == HT_TXN_SET_FROM) { // value holds the source key on entry
+        locate_bucket(table, op->value, &ref);
+        op->found = bucket_get(table, &ref, op->value, &current);
+        if (!op->found) return true; // Nothing to copy
+        op->value = current;
+    }
+
+    locate_bucket(table, op->key, &ref);
+    switch (op->op) {
+        case HT_TXN_GET:
+            op->found = bucket_get(table, &ref, op->key, &op->value);
+            return true;
+
+        case HT_TXN_DELETE:
+            op->found = bucket_delete(table, &ref, op->key);
+            *removed += (size_t)op->found;
+            return true;
+
+        case HT_TXN_ADD:
+            op->found = existed = bucket_get(table, &ref, op->key, &current);
+            op->value = (int)((unsigned)(op->found ? current : 0) + (unsigned)op->value); // Wraps, no UB
+            break;
+
+        case HT_TXN_SET:
+            op->found = existed = bucket_get(table, &ref, op->key, &current);
+            break;
+
+        case HT_TXN_SET_FROM: // found reports the source, so look the destination up here
+            existed = bucket_get(table, &ref, op->key, &current);
+            break;
+    }
+
+    if (bucket_insert(table, &ref, op->key, op->value)) (*added)++;
+    else if (!existed) return false; // Out of memory
+    return true;
+}
+
+// Runs ops[0..n) as one atomic step: every stripe any op touches is locked (in ascending
+// order, so concurrent transactions cannot deadlock) before the first op and released after
+// the last, and holding them also keeps resize steps out. Ops run in order and see the
+// effects of earlier ops. Each op reports through its own value/found fields:
+//   HT_TXN_GET       value = value read, found = key present
+//   HT_TXN_SET       stores value; found = key existed before
+//   HT_TXN_DELETE    found = key was removed
+//   HT_TXN_ADD       adds value to the key (missing counts as 0); value = new value
+//   HT_TXN_SET_FROM  copies the value of key `value` into key; found = source existed
+// Returns 1 on success, 0 if the nodes the ops may need could not be allocated; the table is
+// then left unchanged and no op reports a result.
+int ht_multi_update(HashTable* table, HtTxnOp* ops, size_t n) {
+    if (!table || (!ops && n > 0)) return 0;
+
+    uint64_t stripes;
+    for (;;) {
+        unsigned geometry = atomic_load_explicit(&table->geometry, memory_order_acquire);
+        txn_collect_stripes(table, ops, n, &stripes);
+        for (int i = 0; i < NUM_MUTEXES; i++) {
+            if (stripes & (1ULL << i)) stripe_lock(table, (size_t)i);
+        }
+        if (atomic_load_explicit(&table->geometry, memory_order_relaxed) == geometry) break;
+
+        for (int i = NUM_MUTEXES - 1; i >= 0; i--) { // Table was resized: stripes may differ
+            if (stripes & (1ULL << i)) pthread_mutex_unlock(&table->mutexes[i]);
+        }
+    }
+
+    size_t added = 0, removed = 0;
+    int ok = txn_reserve_nodes(table, ops, n);
+    mvcc_pinned_epoch = atomic_load(&table->epoch);
+    for (size_t i = 0; i < n && ok; i++) {
+        ok = txn_apply(table, &ops[i], &added, &removed);
+        if (ok) txn_trace(&ops[i]); // Stripes still held: the trace keeps the transaction's order
+    }
+    mvcc_pinned_epoch = 0;
+
+    for (int i = NUM_MUTEXES - 1; i >= 0; i--) {
+        if (stripes & (1ULL << i)) pthread_mutex_unlock(&table->mutexes[i]);
+    }
+
+    retire_flush();
+    if (removed) filter_note_delete(table, removed);
+    if (added) check_load_factor(table);
+    tier_evict_if_needed(table);
+    return ok;
+}
+
+
+// ============================================================================================= //
+// ======================================= FLAT COMBINING ====================================== //
+// ============================================================================================= //
+// Instead of every thread taking the stripe mutex in turn, a thread publishes its operation
+// in one of the stripe's slots and tries the lock once. Whoever gets it becomes the combiner
+// and applies every pending operation of that stripe in one critical section, so the chains
+// and the mutex stay in the combiner's cache instead of bouncing between cores. Threads that
+// lose the race spin on their own slot until the combiner marks it done.
+#define FC_SLOTS 16              // Publication slots per stripe
+#define FC_PASSES 2              // Scans of the slot array per combining session
+#define FC_SPINS_BEFORE_YIELD 64
+
+enum { FC_EMPTY, FC_CLAIMED, FC_PENDING, FC_DONE, FC_RETRY };
+
+struct FcSlot {
+    atomic_int state;
+    int op;
+    int key;
+    int value;      // Input for inserts, output for gets
+    unsigned version; // Stripe version after the op, for the owner's read cache
+    bool result;
+} __attribute__((aligned(64))); // One slot per cache line: owners spin on their own line
+
+static _Thread_local unsigned fc_thread_id = 0; // 0 = not assigned yet
+static atomic_uint fc_next_thread_id = 1;
+
+// Caller holds the bucket's mutex
+static bool bucket_apply(HashTable* table, const BucketRef* ref, int op, int key, int* value) {
+    switch (op) {
+        case FC_OP_INSERT: return bucket_insert(table, ref, key, *value);
+        case FC_OP_GET:    return bucket_get(table, ref, key, value);
+        case FC_OP_DELETE: return bucket_delete(table, ref, key);
+    }
+    return false;
+}
+
+// Combiner holds the stripe mutex
+static void fc_combine(HashTable* table, int stripe) {
+    FcSlot* slots = &table->fc_slots[stripe * FC_SLOTS];
+
+    for (int pass = 0; pass < FC_PASSES; pass++) {
+        for (int i = 0; i < FC_SLOTS; i++) {
+            FcSlot* slot = &slots[i];
+            if (atomic_load_explicit(&slot->state, memory_order_acquire) != FC_PENDING) continue;
+
+            BucketRef ref;
+            locate_bucket(table, slot->key, &ref);
+            if ((int)ref.stripe != stripe) {
+                // Published before a resize moved the key to another stripe
+                atomic_store_explicit(&slot->state, FC_RETRY, memory_order_release);
+                continue;
+            }
+            slot->result = bucket_apply(table, &ref, slot->op, slot->key, &slot->value);
+            slot->version = atomic_load_explicit(&table->stripe_versions[stripe], memory_order_relaxed);
+            atomic_store_explicit(&slot->state, FC_DONE, memory_order_release);
+        }
+    }
+}
+
+static bool fc_execute(HashTable* table, int op, int key, int value, int* out_value,
+                       size_t* out_stripe, unsigned* out_version) {
+    if (fc_thread_id == 0) fc_thread_id = atomic_fetch_add(&fc_next_thread_id, 1);
+
+    for (;;) {
+        BucketRef ref;
+        locate_bucket(table, key, &ref); // Unlocked guess; the combiner re-checks it
+        int stripe = (int)ref.stripe;
+        pthread_mutex_t* mutex = &table->mutexes[stripe];
+        FcSlot* slots = &table->fc_slots[stripe * FC_SLOTS];
+
+        // Claim a free slot, starting from a per-thread position to spread threads out
+        FcSlot* slot = NULL;
+        for (int i = 0; i < FC_SLOTS && !slot; i++) {
+            FcSlot* candidate = &slots[(fc_thread_id + i) % FC_SLOTS];
+            int expected = FC_EMPTY;
+            if (atomic_compare_exchange_strong(&candidate->state, &expected, FC_CLAIMED)) slot = candidate;
+        }
+
+        if (!slot) { // Every slot busy: fall back to plain locking
+            mutex = lock_bucket(table, key, &ref);
+            bool result = bucket_apply(table, &ref, op, key, &value);
+            if (out_stripe) *out_stripe = ref.stripe;
+            if (out_version) {
+                *out_version = atomic_load_explicit(&table->stripe_versions[ref.stripe], memory_order_relaxed);
+            }
+            pthread_mutex_unlock(mutex);
+            if (out_value && result) *out_value = value;
+            return result;
+        }
+
+        slot->op = op;
+        slot->key = key;
+        slot->value = value;
+        atomic_store_explicit(&slot->state, FC_PENDING, memory_order_release);
+
+        int state;
+        unsigned spins = 0;
+        while ((state = atomic_load_explicit(&slot->state, memory_order_acquire)) == FC_PENDING) {
+            if (pthread_mutex_trylock(mutex) == 0) {
+                counter_bump(&table->stripe_counters[stripe].acquisitions);
+                fc_combine(table, stripe);
+                pthread_mutex_unlock(mutex);
+            } else if (++spins % FC_SPINS_BEFORE_YIELD == 0) {
+                sched_yield();
+            }
+        }
+
+        bool result = state == FC_DONE && slot->result; // Retried slots carry no result
+        if (out_value && result) *out_value = slot->value;
+        if (out_stripe) *out_stripe = (size_t)stripe;
+        if (out_version) *out_version = slot->version;
+        atomic_store_explicit(&slot->state, FC_EMPTY, memory_order_release);
+        retire_flush(); // Nodes this thread unlinked while combining for others
+
+        if (state == FC_DONE) return result;
+        // FC_RETRY: hash again with the new table size
+    }
+}
+
+// Switches how operations reach their stripe. Both modes use the same stripe mutexes, so
+// the switch is safe while other threads are running. Returns 1 on success, 0 on failure.
+int ht_set_exec_mode(HashTable* table, HtExecMode mode) {
+    if (!table) return 0;
+
+    pthread_mutex_lock(&table->resize_mutex);
+    if (mode == HT_EXEC_FLAT_COMBINING && !table->fc_slots) {
+        FcSlot* slots = aligned_alloc(64, sizeof(FcSlot) * NUM_MUTEXES * FC_SLOTS);
+        if (!slots) {
+            pthread_mutex_unlock(&table->resize_mutex);
+            return 0;
+        }
+        for (int i = 0; i < NUM_MUTEXES * FC_SLOTS; i++) atomic_init(&slots[i].state, FC_EMPTY);
+        table->fc_slots = slots;
+    }
+    atomic_store_explicit(&table->exec_mode, mode, memory_order_release); // Publishes fc_slots
+    pthread_mutex_unlock(&table->resize_mutex);
+    return 1;
+}
+
+
+// ============================================================================================= //
+// ============================================ COUNT ========================================= //
+// ============================================================================================= //
+size_t ht_count(const HashTable* table) {
+    if (!table) return 0;
+
+    // Keep a background resize from moving chains under the walk
+    pthread_mutex_t* resize_mutex = (pthread_mutex_t*)&table->resize_mutex;
+    pthread_mutex_lock(resize_mutex);
+
+    size_t count = 0;
+    for (size_t i = 0; i < table->size; i++) {
+        Node* current = table->buckets[i];
+        while (current) {
+            if (!(current->flags & NODE_DEAD)) count++;
+            current = current->next;
+        }
+    }
+    if (table->old_buckets) { // Resize in flight: chains not moved yet
+        for (size_t i = table->migrate_cursor; i < table->old_size; i++) {
+            for (Node* current = table->old_buckets[i]; current; current = current->next) {
+                if (!(current->flags & NODE_DEAD)) count++;
+            }
+        }
+    }
+    count += ht_tier_count(table->tier);
+    pthread_mutex_unlock(resize_mutex);
+    return count;
+}
+
+
+// ============================================================================================= //
+// ======================================= TIERED STORAGE ====================================== //
+// ============================================================================================= //
+// With tiering on, the table keeps at most tier_budget entries in memory. Past that, a CLOCK
+// hand sweeps the buckets: a node read or written since the last sweep (NODE_ACCESSED) gets a
+// second chance, any other node is appended to the disk tier and unlinked. A lookup that
+// misses its chain asks the tier, and a key found there is promoted back into the chain
+// under the same stripe lock, so every key lives in exactly one place. Spilled keys stay in
+// the negative-lookup filter, so misses still skip the tier.
+//
+// Nodes with versions, tombstones, and everything while a snapshot is open stay in memory:
+// the tier only holds current values. Lock order: resize_mutex, stripes, tier.
+
+// Caller holds the bucket's mutex and found no node for key in its chain
+static Node* tier_promote(HashTable* table, const BucketRef* ref, int key) {
+    int value;
+    if (!table->tier || !ht_tier_get(table->tier, key, &value)) return NULL;
+
+    // Node first: if memory ran out, the key simply stays on disk
+    Node* node = node_alloc(table, ref->stripe);
+    if (!node) return NULL;
+    node->key = key;
+    node->value = value;
+    node->versions = NULL;
+    node->flags = NODE_ACCESSED;
+    node->next = *ref->head;
+    *ref->head = node;
+    ht_tier_remove(table->tier, key);
+    count_add(table, 1);
+    return node;
+}
+
+// Called with no lock held. Evicts down to 90% of the budget so a table at the limit does
+// not evict on every insert. Skipped if another thread is resizing or evicting already.
+static void tier_evict_if_needed(HashTable* table) {
+    if (!table->tier || count_load(table) <= table->tier_budget) return;
+    if (atomic_load(&table->snapshots_active) > 0) return;
+    if (pthread_mutex_trylock(&table->resize_mutex) != 0) return;
+
+    // resize_mutex keeps buckets and size fixed; old_buckets, if any, are left alone
+    size_t target = table->tier_budget - table->tier_budget / 10;
+    bool failed = false;
+    for (size_t swept = 0; swept < 2 * table->size && count_load(table) > target && !failed; swept++) {
+        size_t index = table->evict_cursor++ % table->size;
+        pthread_mutex_t* mutex = get_bucket_mutex(table, index);
+        stripe_lock(table, index % NUM_MUTEXES);
+        if (atomic_load(&table->snapshots_active) > 0) { // Opened meanwhile: it may need these nodes
+            pthread_mutex_unlock(mutex);
+            break;
+        }
+
+        Node** link = &table->buckets[index];
+        while (*link) {
+            Node* node = *link;
+            if (node->flags & NODE_ACCESSED) {
+                node->flags &= ~NODE_ACCESSED; // Second chance
+            } else if (!node->versions && !(node->flags & NODE_DEAD)) {
+                if (!ht_tier_put(table->tier, node->key, node->value)) {
+                    failed = true; // Disk full or unwritable: keep everything in memory
+                    break;
+                }
+                // Same value, just elsewhere: cached reads of it stay valid
+                *link = node->next;
+                node_free(table, index % NUM_MUTEXES, node);
+                count_add(table, -1);
+                continue;
+            }
+            link = &node->next;
+        }
+        pthread_mutex_unlock(mutex);
+    }
+    pthread_mutex_unlock(&table->resize_mutex);
+    retire_flush();
+}
+
+// Keeps at most about memory_entries entries in memory and spills the coldest ones to
+// segment files in `dir` (deleted again by ht_destroy). Call before sharing the table
+// between threads. Returns 1 on success, 0 on failure or if tiering is already on.
+int ht_enable_tiering(HashTable* table, const char* dir, size_t memory_entries) {
+    if (!table || table->tier || memory_entries == 0) return 0;
+
+    TierStore* tier = ht_tier_open(dir);
+    if (!tier) return 0;
+
+    pthread_mutex_lock(&table->resize_mutex);
+    lock_all_buckets(table);
+    table->tier = tier;
+    table->tier_budget = memory_entries;
+    unlock_all_buckets(table);
+    pthread_mutex_unlock(&table->resize_mutex);
+
+    tier_evict_if_needed(table);
+    return 1;
+}
+
+
+// ============================================================================================= //
+// ========================================== SNAPSHOTS ======================================== //
+// ============================================================================================= //
+// MVCC: every write is tagged with the current epoch (read under its stripe lock), and
+// ht_snapshot_begin advances the epoch, so a snapshot taken at epoch S sees exactly the
+// writes tagged <= S. While any snapshot is open, a write first saves the node's previous
+// state as a NodeVersion tagged with the write's epoch, and deletes leave the node in its
+// chain as a NODE_DEAD tombstone. A snapshot read takes the current state and rolls it
+// back through the versions newer than S. Versions travel with their node through resizes.
+// Once no open snapshot needs them, ht_snapshot_end trims them and unlinks tombstones.
+struct NodeVersion {
+    uint64_t epoch;     // Epoch of the write that replaced this state
+    int value;
+    bool existed;
+    struct NodeVersion* next; // Older
+};
+
+struct HtSnapshot {
+    HashTable* table;
+    uint64_t epoch;
+    struct HtSnapshot* next;
+};
+
+// Caller holds the node's stripe. Saves the node's current state before a write if an open
+// snapshot may need it. Returns true if snapshots are open (the node must not be freed).
+static bool mvcc_record(HashTable* table, Node* node) {
+    // Epoch before the active count: a snapshot that this write misses counting began after
+    // the load below, so its epoch is >= this one and it already includes the write
+    uint64_t epoch = mvcc_pinned_epoch ? mvcc_pinned_epoch : atomic_load(&table->epoch);
+    if (atomic_load(&table->snapshots_active) == 0) return false;
+
+    // Only the state before the epoch's first write matters
+    if (node->versions && node->versions->epoch == epoch) return true;
+
+    NodeVersion* version = malloc(sizeof(NodeVersion));
+    if (!version) { // Snapshots older than this write can no longer be exact: ht_snapshot_valid says so
+        uint64_t lost = atomic_load(&table->versions_lost);
+        while (lost < epoch && !atomic_compare_exchange_weak(&table->versions_lost, &lost, epoch)) {}
+        return true;
+    }
+    version->epoch = epoch;
+    version->value = node->value;
+    version->existed = !(node->flags & NODE_DEAD);
+    version->next = node->versions;
+    node->versions = version;
+    atomic_fetch_add(&table->versions_live, 1);
+    return true;
+}
+
+static void mvcc_free_versions(HashTable* table, Node* node) {
+    while (node->versions) {
+        NodeVersion* next = node->versions->next;
+        free(node->versions);
+        node->versions = next;
+        atomic_fetch_sub(&table->versions_live, 1);
+    }
+}
+
+// State of the node as of `epoch`. Returns true if the key existed then.
+static bool mvcc_resolve(const Node* node, uint64_t epoch, int* value) {
+    bool existed = !(node->flags & NODE_DEAD);
+    int current = node->value;
+    for (const NodeVersion* version = node->versions; version && version->epoch > epoch; version = version->next) {
+        existed = version->existed;
+        current = version->value;
+    }
+    if (existed) *value = current;
+    return existed;
+}
+
+// Caller holds the chain's stripe. Drops versions no snapshot needs (epoch <= oldest) and
+// unlinks tombstones left with no versions.
+static void mvcc_collect_chain(HashTable* table, Node** head, size_t stripe, uint64_t oldest) {
+    Node** link = head;
+    while (*link) {
+        Node* node = *link;
+
+        NodeVersion** cut = &node->versions;
+        while (*cut && (*cut)->epoch > oldest) cut = &(*cut)->next;
+        while (*cut) { // Older versions are sorted after this one
+            NodeVersion* next = (*cut)->next;
+            free(*cut);
+            *cut = next;
+            atomic_fetch_sub(&table->versions_live, 1);
+        }
+
+        if ((node->flags & NODE_DEAD) && !node->versions) {
+            *link = node->next;
+            node_free(table, stripe, node);
+        } else {
+            link = &node->next;
+        }
+    }
+}
+
+// Garbage-collects versions one stripe at a time, so writers only wait for their own stripe
+static void mvcc_collect(HashTable* table) {
+    // Snapshots that open later get an epoch >= the current one, so that bound is safe too
+    pthread_mutex_lock(&table->snapshot_mutex);
+    uint64_t oldest = atomic_load(&table->epoch);
+    for (HtSnapshot* snapshot = table->snapshots; snapshot; snapshot = snapshot->next) {
+        if (snapshot->epoch < oldest) oldest = snapshot->epoch;
+    }
+    pthread_mutex_unlock(&table->snapshot_mutex);
+
+    // A resize step between two stripes can move unvisited chains into visited ones; such
+    // leftovers are only delayed to the next collection, but try a few passes first
+    for (int pass = 0; pass < 4 && atomic_load(&table->versions_live) > 0; pass++) {
+        unsigned geometry = atomic_load(&table->geometry);
+        for (size_t stripe = 0; stripe < NUM_MUTEXES; stripe++) {
+            pthread_mutex_lock(&table->mutexes[stripe]);
+            for (size_t i = stripe; i < table->size; i += NUM_MUTEXES) {
+                mvcc_collect_chain(table, &table->buckets[i], stripe, oldest);
+            }
+            if (table->old_buckets) {
+                for (size_t i = stripe; i < table->old_size; i += NUM_MUTEXES) {
+                    if (i >= table->migrate_cursor) mvcc_collect_chain(table, &table->old_buckets[i], stripe, oldest);
+                }
+            }
+            pthread_mutex_unlock(&table->mutexes[stripe]);
+        }
+        if (atomic_load(&table->geometry) == geometry) break;
+    }
+    retire_flush();
+}
+
+// Opens a snapshot: reads through it see the table exactly as it is now, while writers keep
+// going. Each open snapshot makes writes keep old versions, so end it when done; if memory
+// runs out for one, ht_snapshot_valid turns 0.
+// Returns NULL on failure.
+HtSnapshot* ht_snapshot_begin(HashTable* table) {
+    if (!table) return NULL;
+
+    HtSnapshot* snapshot = malloc(sizeof(HtSnapshot));
+    if (!snapshot) return NULL;
+    snapshot->table = table;
+
+    pthread_mutex_lock(&table->snapshot_mutex);
+    atomic_fetch_add(&table->snapshots_active, 1);
+    snapshot->epoch = atomic_fetch_add(&table->epoch, 1);
+    snapshot->next = table->snapshots;
+    table->snapshots = snapshot;
+    pthread_mutex_unlock(&table->snapshot_mutex);
+
+    // A write that read the old epoch may still be running; it belongs to the snapshot, so
+    // wait for it by passing through every stripe once
+    for (int i = 0; i < NUM_MUTEXES; i++) {
+        pthread_mutex_lock(&table->mutexes[i]);
+        pthread_mutex_unlock(&table->mutexes[i]);
+    }
+    return snapshot;
+}
+
+// Like ht_get, as of the snapshot's instant. 1 = found, 0 = not found.
+int ht_snapshot_get(HtSnapshot* snapshot, int key_to_seek, int* seeked_value) {
+    if (!snapshot) return 0;
+
+    BucketRef ref;
+    pthread_mutex_t* mutex = lock_bucket(snapshot->table, key_to_seek, &ref);
+    Node* current = *ref.head;
+    while (current && current->key != key_to_seek) current = current->next;
+    // Nothing is evicted while a snapshot is open, so a spilled value predates it
+    bool found = current ? mvcc_resolve(current, snapshot->epoch, seeked_value)
+                         : ht_tier_get(snapshot->table->tier, key_to_seek, seeked_value);
+    pthread_mutex_unlock(mutex);
+    return found ? 1 : 0;
+}
+
+typedef struct {
+    int key;
+    int value;
+} StripeEntry;
+
+typedef struct {
+    HashTable* table;
+    size_t stripe;          // Only keys of this stripe are collected (NUM_MUTEXES: every key)
+    StripeEntry* entries;
+    size_t n;
+    size_t capacity;
+} StripeBatch;
+
+static void stripe_collect(int key, int value, void* arg) {
+    StripeBatch* batch = arg;
+    if (batch->stripe < NUM_MUTEXES && hash_function(key, batch->table->size) % NUM_MUTEXES != batch->stripe) return;
+    if (batch->n == batch->capacity) {
+        size_t grown = batch->capacity ? batch->capacity * 2 : 1024;
+        StripeEntry* bigger = realloc(batch->entries, grown * sizeof(StripeEntry));
+        if (!bigger) return; // Out of memory: report what fits
+        batch->entries = bigger;
+        batch->capacity = grown;
+    }
+    batch->entries[batch->n++] = (StripeEntry){ key, value };
+}
+
+// Spilled entries of a table grouped by stripe, so a walk over every stripe scans the tier
+// once instead of once per stripe. Built and used with resize_mutex held: nothing is evicted
+// meanwhile, and entries promoted or deleted since the scan are dropped by tier_spill_collect.
+typedef struct {
+    StripeEntry* entries;
+    size_t starts[NUM_MUTEXES + 1];     // Stripe s owns entries[starts[s]..starts[s + 1])
+} TierSpill;
+
+static void tier_spill_load(HashTable* table, TierSpill* spill) {
+    memset(spill, 0, sizeof(*spill));
+    if (ht_tier_count(table->tier) == 0) return;
+
+    StripeBatch all = { table, NUM_MUTEXES, NULL, 0, 0 };
+    ht_tier_foreach(table->tier, stripe_collect, &all);
+    spill->entries = malloc(all.n * sizeof(StripeEntry) + 1);
+    if (!spill->entries) { // Out of memory: walk as if nothing were spilled
+        free(all.entries);
+        return;
+    }
+
+    for (size_t i = 0; i < all.n; i++) spill->starts[hash_function(all.entries[i].key, table->size) % NUM_MUTEXES + 1]++;
+    for (size_t s = 0; s < NUM_MUTEXES; s++) spill->starts[s + 1] += spill->starts[s];
+    size_t next[NUM_MUTEXES];
+    memcpy(next, spill->starts, sizeof(next));
+    for (size_t i = 0; i < all.n; i++) {
+        spill->entries[next[hash_function(all.entries[i].key, table->size) % NUM_MUTEXES]++] = all.entries[i];
+    }
+    free(all.entries);
+}
+
+// Caller holds the stripe's mutex, so its spilled keys cannot be promoted while they are copied
+static void tier_spill_collect(HashTable* table, const TierSpill* spill, size_t stripe, StripeBatch* batch) {
+    for (size_t i = spill->starts[stripe]; i < spill->starts[stripe + 1]; i++) {
+        if (ht_tier_contains(table->tier, spill->entries[i].key)) {
+            stripe_collect(spill->entries[i].key, spill->entries[i].value, batch);
+        }
+    }
+}
+
+// Calls visit(key, value, arg) for every key in the snapshot. Each stripe is read under its
+// own lock, and visit runs with no stripe held. Resizes wait until the walk ends, so visit
+// must not insert into this table. Returns the number of keys visited.
+size_t ht_snapshot_foreach(HtSnapshot* snapshot, void (*visit)(int key, int value, void* arg), void* arg) {
+    if (!snapshot || !visit) return 0;
+    HashTable* table = snapshot->table;
+
+    // Bucket -> stripe must stay fixed for the walk, or a key could be seen twice or not at all
+    pthread_mutex_lock(&table->resize_mutex);
+    while (migrate_chunk(table)) {}
+
+    TierSpill spill;
+    tier_spill_load(table, &spill);
+    StripeBatch batch = { table, 0, NULL, 0, 0 };
+    size_t visited = 0;
+    for (size_t stripe = 0; stripe < NUM_MUTEXES; stripe++) {
+        batch.stripe = stripe;
+        batch.n = 0;
+        pthread_mutex_lock(&table->mutexes[stripe]);
+        for (size_t i = stripe; i < table->size; i += NUM_MUTEXES) {
+            for (Node* current = table->buckets[i]; current; current = current->next) {
+                int value;
+                if (mvcc_resolve(current, snapshot->epoch, &value)) stripe_collect(current->key, value, &batch);
+            }
+        }
+        tier_spill_collect(table, &spill, stripe, &batch);
+        pthread_mutex_unlock(&table->mutexes[stripe]);
+
+        for (size_t i = 0; i < batch.n; i++) visit(batch.entries[i].key, batch.entries[i].value, arg);
+        visited += batch.n;
+    }
+    pthread_mutex_unlock(&table->resize_mutex);
+
+    free(spill.entries);
+    free(batch.entries);
+    return visited;
+}
+
+// 1 while every read through the snapshot is exact. 0 once a write it must not see could not
+// save the state it replaced (out of memory): reads may then return newer values, so results
+// gathered since the snapshot began should be discarded.
+int ht_snapshot_valid(HtSnapshot* snapshot) {
+    if (!snapshot) return 0;
+    return atomic_load(&snapshot->table->versions_lost) > snapshot->epoch ? 0 : 1;
+}
+
+// Closes the snapshot and frees the versions that only it needed
+void ht_snapshot_end(HtSnapshot* snapshot) {
+    if (!snapshot) return;
+    HashTable* table = snapshot->table;
+
+    pthread_mutex_lock(&table->snapshot_mutex);
+    HtSnapshot** link = &table->snapshots;
+    while (*link != snapshot) link = &(*link)->next;
+    *link = snapshot->next;
+    atomic_fetch_sub(&table->snapshots_active, 1);
+    pthread_mutex_unlock(&table->snapshot_mutex);
+    free(snapshot);
+
+    if (atomic_load(&table->versions_live) > 0) mvcc_collect(table);
+}
+
+
+// ============================================================================================= //
+// ========================================= STATISTICS ======================================== //
+// ============================================================================================= //
+// ht_stats reads chains one bucket at a time under that bucket's stripe, so writers only ever
+// wait for a single chain walk. Tables above HT_STATS_FULL_SCAN buckets are sampled: runs of
+// NUM_MUTEXES consecutive buckets (one per stripe) spread evenly over the array. Large scans
+// are split over several threads.
+#define STATS_SAMPLE_RUNS 4096
+#define STATS_MAX_THREADS 8
+#define STATS_PARALLEL_MIN (1u << 16)  // Buckets below which one thread does the scan
+
+typedef struct {
+    HashTable* table;
+    size_t first_run;
+    size_t end_run;
+    size_t run_stride;          // Distance between the starts of two runs
+    size_t scanned;
+    size_t empty;
+    size_t nodes;
+    size_t max_chain;
+    size_t histogram[HT_STATS_CHAIN_HISTOGRAM];
+    size_t stripe_nodes[NUM_MUTEXES];
+    pthread_t thread;
+} StatsRange;
+
+static double clock_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+static void* stats_scan(void* arg) {
+    StatsRange* range = arg;
+    HashTable* table = range->table;
+
+    for (size_t run = range->first_run; run < range->end_run; run++) {
+        size_t start = run * range->run_stride;
+        size_t end = start + NUM_MUTEXES < table->size ? start + NUM_MUTEXES : table->size;
+        for (size_t i = start; i < end; i++) {
+            size_t stripe = i % NUM_MUTEXES;
+            size_t length = 0;
+            pthread_mutex_lock(&table->mutexes[stripe]);
+            for (Node* current = table->buckets[i]; current; current = current->next) length++;
+            pthread_mutex_unlock(&table->mutexes[stripe]);
+
+            range->scanned++;
+            range->nodes += length;
+            range->stripe_nodes[stripe] += length;
+            if (length == 0) range->empty++;
+            if (length > range->max_chain) range->max_chain = length;
+            range->histogram[length < HT_STATS_CHAIN_HISTOGRAM ? length : HT_STATS_CHAIN_HISTOGRAM - 1]++;
+        }
+    }
+    return NULL;
+}
+
+static size_t filter_bytes(const NegFilter* filter) {
+    return filter ? filter->num_blocks * FILTER_BLOCK_WORDS * sizeof(uint64_t) : 0;
+}
+
+// Fills *out with the table's current shape and counters. Writers keep running (resizes
+// wait until it returns), so the figures are a close estimate rather than one instant.
+// Returns 1 on success, 0 on failure.
+int ht_stats(HashTable* table, HtStats* out) {
+    if (!table || !out) return 0;
+    memset(out, 0, sizeof(*out));
+
+    pthread_mutex_lock(&table->resize_mutex); // Keeps the bucket arrays in place
+    size_t size = table->size;
+    size_t runs = (size + NUM_MUTEXES - 1) / NUM_MUTEXES;
+    size_t run_stride = NUM_MUTEXES;
+    if (size > HT_STATS_FULL_SCAN) {
+        runs = STATS_SAMPLE_RUNS;
+        run_stride = size / runs;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = cpus > 1 ? (size_t)cpus : 1;
+    if (threads > STATS_MAX_THREADS) threads = STATS_MAX_THREADS;
+    if (runs * NUM_MUTEXES < STATS_PARALLEL_MIN) threads = 1;
 
+    StatsRange* ranges = calloc(threads, sizeof(StatsRange));
+    if (!ranges) {
+        pthread_mutex_unlock(&table->resize_mutex);
+        return 0;
+    }
+    size_t per_thread = (runs + threads - 1) / threads;
+    for (size_t t = 0; t < threads; t++) {
+        ranges[t].table = table;
+        ranges[t].first_run = t * per_thread < runs ? t * per_thread : runs;
+        ranges[t].end_run = (t + 1) * per_thread < runs ? (t + 1) * per_thread : runs;
+        ranges[t].run_stride = run_stride;
+        // The last range runs here, as does any range whose thread could not start
+        if (t + 1 == threads || pthread_create(&ranges[t].thread, NULL, stats_scan, &ranges[t]) != 0) {
+            stats_scan(&ranges[t]);
+            ranges[t].table = NULL; // Nothing to join
+        }
+    }
 
+    size_t nodes = 0, empty = 0;
+    for (size_t t = 0; t < threads; t++) {
+        if (ranges[t].table) pthread_join(ranges[t].thread, NULL);
+        out->buckets_scanned += ranges[t].scanned;
+        nodes += ranges[t].nodes;
+        empty += ranges[t].empty;
+        if (ranges[t].max_chain > out->max_chain) out->max_chain = ranges[t].max_chain;
+        for (int i = 0; i < HT_STATS_CHAIN_HISTOGRAM; i++) out->chain_histogram[i] += ranges[t].histogram[i];
+        for (int i = 0; i < NUM_MUTEXES; i++) out->stripe_entries[i] += ranges[t].stripe_nodes[i];
+    }
+    free(ranges);
 
-// ============================================================================================= //
-// ======================================= BUCKET MUTEX ======================================== //
-// ============================================================================================= //
-static pthread_mutex_t* get_bucket_mutex(HashTable* table, size_t bucket_index) {
-    return &table->mutexes[bucket_index % NUM_MUTEXES];
+    // Sampled: scale per-stripe and node totals up to the whole array
+    double scale = out->buckets_scanned ? (double)size / (double)out->buckets_scanned : 0.0;
+    if (out->buckets_scanned < size) {
+        for (int i = 0; i < NUM_MUTEXES; i++) out->stripe_entries[i] = (size_t)(out->stripe_entries[i] * scale);
+    }
+
+    out->buckets = size;
+    out->entries = count_load(table);
+    out->tier_entries = ht_tier_count(table->tier);
+    out->load_factor = size ? (double)out->entries / (double)size : 0.0;
+    out->empty_ratio = out->buckets_scanned ? (double)empty / (double)out->buckets_scanned : 0.0;
+    out->mean_chain = out->buckets_scanned > empty ? (double)nodes / (double)(out->buckets_scanned - empty) : 0.0;
+
+    for (int i = 0; i < NUM_MUTEXES; i++) {
+        out->stripe_acquisitions[i] = atomic_load_explicit(&table->stripe_counters[i].acquisitions, memory_order_relaxed);
+        out->stripe_contended[i] = atomic_load_explicit(&table->stripe_counters[i].contended, memory_order_relaxed);
+        out->stripe_busy[i] = atomic_load_explicit(&table->stripe_counters[i].busy, memory_order_relaxed);
+    }
+    out->resizes = table->resizes;
+    out->resize_ms = table->resize_ms;
+    out->resizing = table->old_buckets != NULL;
+
+    out->bucket_bytes = ((BucketHeader*)table->buckets - 1)->bytes;
+    if (table->old_buckets) out->bucket_bytes += ((BucketHeader*)table->old_buckets - 1)->bytes;
+    if (table->arena) {
+        pthread_mutex_lock(&table->arena->mutex);
+        out->node_bytes = table->arena->bytes;
+        pthread_mutex_unlock(&table->arena->mutex);
+    } else {
+        out->node_bytes = (size_t)(nodes * scale) * sizeof(Node);
+    }
+    out->node_bytes += atomic_load(&table->versions_live) * sizeof(NodeVersion);
+    out->filter_bytes = filter_bytes(atomic_load(&table->filter)) + filter_bytes(table->next_filter);
+    pthread_mutex_unlock(&table->resize_mutex);
+    return 1;
 }
 
 
 // ============================================================================================= //
-// ======================================== HASH FUNCTION ====================================== //
+// ======================================= SET OPERATIONS ====================================== //
 // ============================================================================================= //
-static size_t hash_function(int key, size_t table_size) {
-    return ((long long)key % (long long)table_size + table_size) % table_size;
+// ht_merge, ht_diff and ht_intersect split the work into parts taken by worker threads
+// from a shared counter. ht_merge holds every source stripe and hands out contiguous bucket
+// ranges; ht_diff and ht_intersect leave the tables live and hand out whole stripes of the
+// walked table. Keys are probed or inserted in the other table under its own stripe locks.
+// Both resize mutexes are held throughout (lower address first), which keeps the geometry
+// fixed, so a destination sized once up front takes every key without growing on the way.
+#define SETOP_MAX_THREADS 8
+#define SETOP_PARALLEL_MIN (1u << 16)  // Buckets below which one thread does the walk
+#define MERGE_RANGE (1u << 16)         // Source buckets per ht_merge part
+#define MERGE_PREFETCH 16              // Nodes ahead whose destination bucket is prefetched
+
+typedef struct {
+    void (*work)(size_t part, void* arg);
+    void* arg;
+    size_t parts;
+    atomic_size_t next_part;
+} SetopJobs;
+
+static void* setop_jobs_run(void* arg) {
+    SetopJobs* jobs = arg;
+    size_t part;
+    while ((part = atomic_fetch_add(&jobs->next_part, 1)) < jobs->parts) jobs->work(part, jobs->arg);
+    return NULL;
 }
 
+// Threads worth using on a table of `buckets` buckets
+static size_t setop_threads(size_t buckets) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = cpus > 1 ? (size_t)cpus : 1;
+    if (threads > SETOP_MAX_THREADS) threads = SETOP_MAX_THREADS;
+    return buckets < SETOP_PARALLEL_MIN ? 1 : threads;
+}
 
-// ============================================================================================= //
-// ============================================ RESIZE ========================================= //
-// ============================================================================================= //
-void ht_resize(HashTable* table, size_t new_size) {
-    if (!table || new_size == 0 || new_size <= table->size) return;
+// Calls work(part, arg) once for every part in [0, parts), on up to `threads` threads
+// (at most SETOP_MAX_THREADS), the calling thread included
+static void setop_run(size_t parts, size_t threads, void (*work)(size_t part, void* arg), void* arg) {
+    SetopJobs jobs = { work, arg, parts, 0 };
+    pthread_t workers[SETOP_MAX_THREADS];
+    if (threads > SETOP_MAX_THREADS) threads = SETOP_MAX_THREADS;
+    if (threads > parts) threads = parts;
 
-    Node** new_buckets = calloc(new_size, sizeof(Node*));
-    if (!new_buckets) return;
-    
-    // Rehash all existing keys into new buckets
-    for (size_t i = 0; i < table->size; i++) {
-        Node* current = table->buckets[i];
-        while (current) { // Traverse linked list until NULL
-            Node* next_node = current->next; // Set next node before re-linking, setting to NULL
-            
-            size_t new_index = hash_function(current->key, new_size);
-            
-            // Insert at the beginning of the new bucket
-            current->next = new_buckets[new_index]; // Set to NULL if empty or current head
-            
-            new_buckets[new_index] = current; // Update head to current node
+    size_t started = 0;
+    while (started + 1 < threads && pthread_create(&workers[started], NULL, setop_jobs_run, &jobs) == 0) started++;
+    setop_jobs_run(&jobs); // This thread works too, alone if no thread could start
+    for (size_t t = 0; t < started; t++) pthread_join(workers[t], NULL);
+}
+
+// Takes both resize mutexes in address order, so calls with the tables swapped cannot
+// deadlock, and finishes any migration in flight
+static void setop_lock(HashTable* a, HashTable* b) {
+    HashTable* first = (uintptr_t)a < (uintptr_t)b ? a : b;
+    HashTable* second = first == a ? b : a;
+    pthread_mutex_lock(&first->resize_mutex);
+    if (second != first) pthread_mutex_lock(&second->resize_mutex);
+    while (migrate_chunk(a)) {}
+    while (migrate_chunk(b)) {}
+}
+
+static void setop_unlock(HashTable* a, HashTable* b) {
+    pthread_mutex_unlock(&a->resize_mutex);
+    if (b != a) pthread_mutex_unlock(&b->resize_mutex);
+}
+
+// Caller holds the bucket's mutex. Like bucket_get, but spilled keys stay on disk and access
+// bits are left alone, so comparing tables does not change what is kept in memory.
+static bool bucket_peek(HashTable* table, const BucketRef* ref, int key, int* value) {
+    for (Node* current = *ref->head; current; current = current->next) {
+        if (current->key != key) continue;
+        if (current->flags & NODE_DEAD) return false;
+        *value = current->value;
+        return true;
+    }
+    return ht_tier_get(table->tier, key, value);
+}
 
-            current = next_node; // Move to next node
+// Live entries of one stripe, from its chains and the table's spill, read under its lock
+static void stripe_entries(HashTable* table, const TierSpill* spill, size_t stripe, StripeBatch* batch) {
+    batch->stripe = stripe;
+    batch->n = 0;
+    pthread_mutex_lock(&table->mutexes[stripe]);
+    for (size_t i = stripe; i < table->size; i += NUM_MUTEXES) {
+        for (Node* current = table->buckets[i]; current; current = current->next) {
+            if (!(current->flags & NODE_DEAD)) stripe_collect(current->key, current->value, batch);
         }
     }
-    // Free old buckets and update table
-    free(table->buckets);
+    tier_spill_collect(table, spill, stripe, batch);
+    pthread_mutex_unlock(&table->mutexes[stripe]);
+}
 
-    table->buckets = new_buckets;
-    table->size = new_size;
+// Caller holds the bucket's mutex in dst. Merges key/value under policy; a key new to dst
+// takes *spare (a node unlinked from the source) if set, and *spare is cleared once used.
+// Returns false only if a node could not be allocated.
+static bool merge_entry(HashTable* dst, const BucketRef* ref, int key, int value, HtMergePolicy policy, Node** spare) {
+    Node* current = bucket_find(dst, ref, key);
+    if (!current) {
+        Node* node = *spare ? *spare : node_alloc(dst, ref->stripe);
+        if (!node) return false;
+        *spare = NULL;
+        node->key = key;
+        node->value = value;
+        bucket_link(dst, ref, node);
+        return true;
+    }
 
+    if (!(current->flags & NODE_DEAD)) {
+        if (policy == HT_MERGE_KEEP_DST) return true;
+        if (policy == HT_MERGE_SUM) value = (int)((unsigned)current->value + (unsigned)value); // Wraps, no UB
+    }
+    bucket_insert(dst, ref, key, value); // Updates or revives the node found above
+    return true;
 }
 
+typedef struct {
+    HashTable* dst;
+    HashTable* src;
+    HtMergePolicy policy;
+    bool relink;        // Source nodes move over as they are instead of being copied
+    pthread_mutex_t mutex;
+    Node* leftovers;    // Source arena nodes to free once the workers are done
+    atomic_bool incomplete; // Out of memory: some entries stayed in the source
+} MergeJob;
 
-// ============================================================================================= //
-// =========================================== CREATE ========================================== //
-// ============================================================================================= //
-HashTable* create_hashtable(size_t size) {
-    HashTable* table = malloc(sizeof(HashTable));
-    if (!table) return NULL;
+typedef struct {
+    Node** nodes;
+    size_t n;
+    size_t capacity;
+} MergeList;
 
-    table->size = size;
-    table->buckets = calloc(table->size, sizeof(Node*));
-    
-    
-    // If calloc fails then it frees the memory allocated for the table
-    if (!table->buckets) {
-        free(table);
-        return NULL;
+// Source stripes' arena free lists are shared by every range, so arena nodes wait for
+// ht_merge to free them; malloc'd nodes go to this thread's retire list right away
+static void merge_discard(MergeJob* job, Node** leftovers, Node* node) {
+    if (job->src->arena) {
+        node->next = *leftovers;
+        *leftovers = node;
+    } else {
+        node_free(job->src, 0, node);
     }
+}
 
-    atomic_init(&table->count, 0);
+static void merge_range(size_t part, void* arg) {
+    MergeJob* job = arg;
+    HashTable* dst = job->dst;
+    HashTable* src = job->src;
+    size_t from = part * MERGE_RANGE;
+    size_t to = from + MERGE_RANGE < src->size ? from + MERGE_RANGE : src->size;
+    Node* leftovers = NULL;
 
-    // Initialize mutexes
-    for (int i = 0; i < NUM_MUTEXES; i++) {
-        if (pthread_mutex_init(&table->mutexes[i], NULL) != 0) {
-            // Limpieza parcial
-            for (int j = 0; j < i; j++) pthread_mutex_destroy(&table->mutexes[j]);
-            free(table->buckets);
-            free(table);
-            return NULL;
+    // ht_merge holds every source stripe, and this range is only ours. Unlink its chains,
+    // sorting the nodes by destination stripe so that each is locked once.
+    MergeList lists[NUM_MUTEXES] = { { NULL, 0, 0 } };
+    for (size_t i = from; i < to; i++) {
+        if (i + MERGE_PREFETCH < to) __builtin_prefetch(src->buckets[i + MERGE_PREFETCH], 0, 1);
+        Node* current = src->buckets[i];
+        while (current) {
+            Node* next = current->next;
+            if (current->flags & NODE_DEAD) {
+                merge_discard(job, &leftovers, current); // Tombstone no snapshot needs any more
+                current = next;
+                continue;
+            }
+            MergeList* list = &lists[hash_function(current->key, dst->size) % NUM_MUTEXES];
+            if (list->n == list->capacity) {
+                size_t grown = list->capacity ? list->capacity * 2 : 256;
+                Node** bigger = realloc(list->nodes, grown * sizeof(Node*));
+                if (!bigger) { // Out of memory: the rest of the chain stays in the source
+                    atomic_store(&job->incomplete, true);
+                    break;
+                }
+                list->nodes = bigger;
+                list->capacity = grown;
+            }
+            list->nodes[list->n++] = current;
+            current = next;
         }
+        src->buckets[i] = current;
     }
 
-    // Initialize resize mutex
-    if (pthread_mutex_init(&table->resize_mutex, NULL) != 0) {
-        for (int i = 0; i < NUM_MUTEXES; i++) pthread_mutex_destroy(&table->mutexes[i]);
-        free(table->buckets);
-        free(table);
-        return NULL;
+    // Destination buckets are random accesses. Each hop is prefetched ahead of its use:
+    // the source node, then its destination bucket slot, then that bucket's first node.
+    size_t moved = 0;
+    for (size_t target = 0; target < NUM_MUTEXES; target++) {
+        MergeList* list = &lists[target];
+        if (list->n == 0) continue;
+        stripe_lock(dst, target);
+        for (size_t j = 0; j < list->n; j++) {
+            if (j + 2 * MERGE_PREFETCH < list->n) __builtin_prefetch(list->nodes[j + 2 * MERGE_PREFETCH], 0, 1);
+            if (j + MERGE_PREFETCH < list->n) {
+                __builtin_prefetch(&dst->buckets[hash_function(list->nodes[j + MERGE_PREFETCH]->key, dst->size)], 0, 1);
+            }
+            if (j + MERGE_PREFETCH / 2 < list->n) {
+                __builtin_prefetch(dst->buckets[hash_function(list->nodes[j + MERGE_PREFETCH / 2]->key, dst->size)], 0, 1);
+            }
+
+            Node* current = list->nodes[j];
+            BucketRef ref = { &dst->buckets[hash_function(current->key, dst->size)], target };
+            Node* spare = NULL;
+            if (job->relink) {
+                mvcc_free_versions(src, current);
+                spare = current;
+            }
+
+            if (merge_entry(dst, &ref, current->key, current->value, job->policy, &spare)) {
+                moved++;
+                if (!job->relink || spare) merge_discard(job, &leftovers, current); // Not relinked
+            } else {
+                // Out of memory: the entry stays in the source
+                atomic_store(&job->incomplete, true);
+                Node** head = &src->buckets[hash_function(current->key, src->size)];
+                current->next = *head;
+                *head = current;
+            }
+        }
+        pthread_mutex_unlock(&dst->mutexes[target]);
+        free(list->nodes);
     }
+    atomic_fetch_sub(&src->count, moved);
+    retire_flush();
 
-    return table;
+    if (leftovers) {
+        Node* last = leftovers;
+        while (last->next) last = last->next;
+        pthread_mutex_lock(&job->mutex);
+        last->next = job->leftovers;
+        job->leftovers = leftovers;
+        pthread_mutex_unlock(&job->mutex);
+    }
 }
 
+// Moves every entry of src into dst, settling keys present in both by policy; src is left
+// empty and can be reused. dst grows once up front and keeps serving throughout, while
+// src's users wait until the merge ends. When neither table uses a node arena, src's nodes
+// are relinked into dst rather than copied. Fails if src has an open snapshot.
+// Returns 1 on success, 0 on failure (entries that could not be moved stay in src).
+int ht_merge(HashTable* dst, HashTable* src, HtMergePolicy policy) {
+    if (!dst || !src || dst == src) return 0;
 
-// ============================================================================================= //
-// ============================================= INSERT ======================================== //
-// ============================================================================================= //
-void ht_insert(HashTable* table, int key, int value) {
-    if (!table) return;
+    setop_lock(dst, src);
+    lock_all_buckets(src);
+    // A snapshot registers before it waits on the stripes, so none can begin past this check
+    if (atomic_load(&src->snapshots_active) > 0) {
+        unlock_all_buckets(src);
+        setop_unlock(dst, src);
+        return 0;
+    }
 
-    size_t bucket_index = hash_function(key, table->size);
-    pthread_mutex_t* bucket_mutex = get_bucket_mutex(table, bucket_index);
+    // One growth for everything that is coming
+    size_t incoming = count_load(src) + ht_tier_count(src->tier);
+    double needed = (double)(count_load(dst) + incoming) / 0.7;
+    if (needed > (double)dst->size) ht_resize(dst, next_prime((size_t)needed + 1));
 
-    pthread_mutex_lock(bucket_mutex);
+    MergeJob job = { dst, src, policy, !src->arena && !dst->arena, PTHREAD_MUTEX_INITIALIZER, NULL, false };
+    setop_run((src->size + MERGE_RANGE - 1) / MERGE_RANGE, setop_threads(src->size), merge_range, &job);
+    pthread_mutex_destroy(&job.mutex);
+    while (job.leftovers) {
+        Node* next = job.leftovers->next;
+        node_free(src, hash_function(job.leftovers->key, src->size) % NUM_MUTEXES, job.leftovers);
+        job.leftovers = next;
+    }
 
-    // Search if key already exists and update value if so
-    Node* current = table->buckets[bucket_index];
-    while (current) {
-        if (current->key == key) {
-            current->value = value;
-            pthread_mutex_unlock(bucket_mutex);
-            return;
+    // Spilled source entries are copied; the stripes held keep them from being promoted
+    if (ht_tier_count(src->tier) > 0) {
+        StripeBatch batch = { src, NUM_MUTEXES, NULL, 0, 0 };
+        ht_tier_foreach(src->tier, stripe_collect, &batch);
+        for (size_t i = 0; i < batch.n; i++) {
+            BucketRef ref;
+            Node* spare = NULL;
+            pthread_mutex_t* mutex = lock_bucket(dst, batch.entries[i].key, &ref);
+            bool merged = merge_entry(dst, &ref, batch.entries[i].key, batch.entries[i].value, policy, &spare);
+            pthread_mutex_unlock(mutex);
+            if (merged) ht_tier_remove(src->tier, batch.entries[i].key);
         }
-        current = current->next;
+        free(batch.entries);
     }
+    bool complete = !atomic_load(&job.incomplete) && ht_tier_count(src->tier) == 0;
 
-    // Key does not exist: create new node
-    Node* new_node = malloc(sizeof(Node));
-    if (!new_node) {
-        pthread_mutex_unlock(bucket_mutex);
-        return;
+    bump_all_stripe_versions(src); // Cached reads of src keys are stale now
+    unlock_all_buckets(src);
+    setop_unlock(dst, src);
+
+    tier_evict_if_needed(dst);
+    return complete ? 1 : 0;
+}
+
+typedef struct {
+    HashTable* a;
+    HashTable* b;
+    void (*visit)(int key, const int* a_value, const int* b_value, void* arg);
+    void* arg;
+    bool b_side;                // Second pass: walking b for keys a lacks
+    TierSpill spills[2];        // Spilled entries of a and b
+    pthread_mutex_t visit_mutex;
+    atomic_size_t differences;
+} DiffJob;
+
+static void diff_stripe(size_t stripe, void* arg) {
+    DiffJob* job = arg;
+    HashTable* walked = job->b_side ? job->b : job->a;
+    HashTable* probed = job->b_side ? job->a : job->b;
+    StripeBatch batch = { walked, 0, NULL, 0, 0 };
+    stripe_entries(walked, &job->spills[job->b_side], stripe, &batch);
+
+    for (size_t i = 0; i < batch.n; i++) {
+        int key = batch.entries[i].key;
+        int other;
+        BucketRef ref;
+        pthread_mutex_t* mutex = lock_bucket(probed, key, &ref);
+        bool found = bucket_peek(probed, &ref, key, &other);
+        pthread_mutex_unlock(mutex);
+        // Keys in both tables were settled by the first pass
+        if (job->b_side ? found : found && other == batch.entries[i].value) continue;
+
+        pthread_mutex_lock(&job->visit_mutex);
+        if (job->b_side) job->visit(key, NULL, &batch.entries[i].value, job->arg);
+        else job->visit(key, &batch.entries[i].value, found ? &other : NULL, job->arg);
+        pthread_mutex_unlock(&job->visit_mutex);
+        atomic_fetch_add(&job->differences, 1);
     }
-    new_node->key = key;
-    new_node->value = value;
-    new_node->next = table->buckets[bucket_index];
-    table->buckets[bucket_index] = new_node;
+    free(batch.entries);
+}
 
-    table->count++;
-    
-    // Check load factor
-    float load_factor = (float)table->count / (float)table->size;
-    if (load_factor > 0.7f) {
-        pthread_mutex_unlock(bucket_mutex);  // Release bucket lock
+// Calls visit(key, a_value, b_value, arg) for every key whose presence or value differs
+// between a and b, with NULL for the side that lacks it. Both tables keep serving (resizes
+// wait), so under concurrent writes the result is not one instant. visit calls come from
+// several threads, one at a time and with no stripe held; visit must not insert into
+// either table. Returns the number of keys reported.
+size_t ht_diff(HashTable* a, HashTable* b, void (*visit)(int key, const int* a_value, const int* b_value, void* arg), void* arg) {
+    if (!a || !b || !visit) return 0;
 
-        pthread_mutex_lock(&table->resize_mutex);  // Acquire resize lock
+    DiffJob job = { a, b, visit, arg, false, { { NULL, { 0 } }, { NULL, { 0 } } }, PTHREAD_MUTEX_INITIALIZER, 0 };
+    setop_lock(a, b);
+    tier_spill_load(a, &job.spills[0]);
+    setop_run(NUM_MUTEXES, setop_threads(a->size), diff_stripe, &job);
+    job.b_side = true;
+    tier_spill_load(b, &job.spills[1]);
+    setop_run(NUM_MUTEXES, setop_threads(b->size), diff_stripe, &job);
+    setop_unlock(a, b);
+    free(job.spills[0].entries);
+    free(job.spills[1].entries);
 
-        // Double-check load factor (in case another thread resized)
-        if ((float)table->count / (float)table->size > 0.7f) {
-            size_t candidate = table->size * 2 + 1;
-            size_t new_size = next_prime(candidate);
-            printf("Resizing table from %zu to %zu due to load factor %.2f\n", table->size, new_size, load_factor);
-            ht_resize(table, new_size);
-        }
+    pthread_mutex_destroy(&job.visit_mutex);
+    return atomic_load(&job.differences);
+}
 
-        pthread_mutex_unlock(&table->resize_mutex);  // Release resize lock
-    } else {
-        pthread_mutex_unlock(bucket_mutex);  // Release bucket lock if no resize
+typedef struct {
+    HashTable* walked;      // The smaller table
+    HashTable* probed;
+    TierSpill spill;        // Spilled entries of walked
+    bool walked_is_a;
+    HtMergePolicy policy;
+    HashTable* out;
+    atomic_bool failed;
+} IntersectJob;
+
+static void intersect_stripe(size_t stripe, void* arg) {
+    IntersectJob* job = arg;
+    StripeBatch batch = { job->walked, 0, NULL, 0, 0 };
+    stripe_entries(job->walked, &job->spill, stripe, &batch);
+
+    for (size_t i = 0; i < batch.n; i++) {
+        int key = batch.entries[i].key;
+        int other;
+        BucketRef ref;
+        pthread_mutex_t* mutex = lock_bucket(job->probed, key, &ref);
+        bool found = bucket_peek(job->probed, &ref, key, &other);
+        pthread_mutex_unlock(mutex);
+        if (!found) continue;
+
+        int a_value = job->walked_is_a ? batch.entries[i].value : other;
+        int b_value = job->walked_is_a ? other : batch.entries[i].value;
+        int value = job->policy == HT_MERGE_KEEP_DST ? a_value
+                  : job->policy == HT_MERGE_TAKE_SRC ? b_value
+                  : (int)((unsigned)a_value + (unsigned)b_value);
+
+        // Every key arrives once, so a false return can only mean out of memory
+        mutex = lock_bucket(job->out, key, &ref);
+        if (!bucket_insert(job->out, &ref, key, value)) atomic_store(&job->failed, true);
+        pthread_mutex_unlock(mutex);
+    }
+    free(batch.entries);
+}
+
+// Returns a new table with the keys present in both a and b, valued by policy (a plays dst
+// and b src). The smaller table is walked and the other probed, and the result is sized
+// once for the smaller one. Same consistency as ht_diff. Returns NULL on failure.
+HashTable* ht_intersect(HashTable* a, HashTable* b, HtMergePolicy policy) {
+    if (!a || !b) return NULL;
+
+    setop_lock(a, b);
+    size_t a_count = count_load(a) + ht_tier_count(a->tier);
+    size_t b_count = count_load(b) + ht_tier_count(b->tier);
+    bool walk_a = a_count <= b_count;
+    size_t expected = walk_a ? a_count : b_count;
+
+    HashTable* out = create_hashtable(next_prime((size_t)((double)expected / 0.7) + INITIAL_TABLE_SIZE));
+    if (!out) {
+        setop_unlock(a, b);
+        return NULL;
+    }
+
+    IntersectJob job = { walk_a ? a : b, walk_a ? b : a, { NULL, { 0 } }, walk_a, policy, out, false };
+    tier_spill_load(job.walked, &job.spill);
+    setop_run(NUM_MUTEXES, setop_threads(job.walked->size), intersect_stripe, &job);
+    setop_unlock(a, b);
+    free(job.spill.entries);
+
+    if (atomic_load(&job.failed)) {
+        ht_destroy(out);
+        return NULL;
     }
+    return out;
 }
 
 
 // ============================================================================================= //
-// ============================================= GET =========================================== //
+// ======================================== BULK DELETE ======================================== //
 // ============================================================================================= //
-int ht_get(HashTable* table, int key_to_seek, int* seeked_value) {
-    if (!table || !table->buckets) return 0;
+// ht_remove_if hands out batches of REMOVE_BATCH consecutive buckets. Within a batch each
+// stripe is locked once for all of its buckets, so a purge costs one lock per stripe and
+// batch rather than a hash and a lock per key. Unlinked nodes go to the retire list and are
+// freed in bulk after the stripe is released.
+#define REMOVE_BATCH 4096
 
-    size_t bucket_index = hash_function(key_to_seek, table->size);
-    pthread_mutex_t* mutex = &table->mutexes[bucket_index % NUM_MUTEXES];
+typedef struct {
+    HashTable* table;
+    bool (*predicate)(int key, int value, void* ctx);
+    void* ctx;
+    atomic_size_t removed;
+} RemoveJob;
 
-    pthread_mutex_lock(mutex);
-    
-    Node* current = table->buckets[bucket_index];
-    while (current) {
-        if (current->key == key_to_seek) {
-            *seeked_value = current->value;
+static void remove_batch(size_t part, void* arg) {
+    RemoveJob* job = arg;
+    HashTable* table = job->table;
+    size_t from = part * REMOVE_BATCH;
+    size_t to = from + REMOVE_BATCH < table->size ? from + REMOVE_BATCH : table->size;
+
+    size_t removed = 0;
+    for (size_t stripe = 0; stripe < NUM_MUTEXES; stripe++) {
+        size_t first = from + (stripe + NUM_MUTEXES - from % NUM_MUTEXES) % NUM_MUTEXES;
+        if (first >= to) continue;
+
+        size_t stripe_removed = 0;
+        stripe_lock(table, stripe);
+        for (size_t i = first; i < to; i += NUM_MUTEXES) {
+            Node** link = &table->buckets[i];
+            while (*link) {
+                Node* current = *link;
+                if ((current->flags & NODE_DEAD) || !job->predicate(current->key, current->value, job->ctx)) {
+                    link = &current->next;
+                    continue;
+                }
+                TRACE_OP(HT_TRACE_DELETE, current->key, 0);
+                if (mvcc_record(table, current)) {
+                    current->flags |= NODE_DEAD; // An open snapshot may still read it
+                    link = &current->next;
+                } else {
+                    *link = current->next;
+                    node_free(table, stripe, current);
+                }
+                stripe_removed++;
+            }
+        }
+        if (stripe_removed) bump_stripe_version(table, stripe);
+        pthread_mutex_unlock(&table->mutexes[stripe]);
+        retire_flush();
+        removed += stripe_removed;
+    }
+
+    atomic_fetch_sub(&table->count, removed);
+    atomic_fetch_add(&job->removed, removed);
+}
+
+// Removes every key for which predicate(key, value, ctx) returns true, walking the buckets
+// on `nthreads` threads (0 = one per CPU, at most SETOP_MAX_THREADS). Other threads keep
+// using the table; resizes wait until the purge ends. predicate runs with a stripe held and
+// may be called twice for a spilled key, so it must be a pure function of key, value and
+// ctx that does not call into the table. Returns the number of keys removed.
+size_t ht_remove_if(HashTable* table, bool (*predicate)(int key, int value, void* ctx), void* ctx, size_t nthreads) {
+    if (!table || !predicate) return 0;
+
+    RemoveJob job = { table, predicate, ctx, 0 };
+    pthread_mutex_lock(&table->resize_mutex);
+    while (migrate_chunk(table)) {}
+    setop_run((table->size + REMOVE_BATCH - 1) / REMOVE_BATCH, nthreads ? nthreads : setop_threads(table->size),
+              remove_batch, &job);
+    size_t removed = atomic_load(&job.removed);
+
+    // Spilled keys. Only eviction writes to the tier and it needs resize_mutex, so a key
+    // still on disk has the value read here; one promoted since is re-checked in memory.
+    // With a snapshot open, deleting brings the key back first so the snapshot keeps it.
+    if (ht_tier_count(table->tier) > 0) {
+        StripeBatch batch = { table, NUM_MUTEXES, NULL, 0, 0 };
+        ht_tier_foreach(table->tier, stripe_collect, &batch);
+        for (size_t i = 0; i < batch.n; i++) {
+            int key = batch.entries[i].key;
+            if (!predicate(key, batch.entries[i].value, ctx)) continue;
+
+            BucketRef ref;
+            pthread_mutex_t* mutex = lock_bucket(table, key, &ref);
+            Node* current = *ref.head;
+            while (current && current->key != key) current = current->next;
+            bool gone = false;
+            if (current) {
+                if (!(current->flags & NODE_DEAD) && predicate(key, current->value, ctx)) {
+                    gone = bucket_delete(table, &ref, key);
+                }
+            } else if (atomic_load(&table->snapshots_active) == 0) {
+                gone = ht_tier_remove(table->tier, key);
+            } else {
+                gone = bucket_delete(table, &ref, key);
+            }
+            if (gone) TRACE_OP(HT_TRACE_DELETE, key, 0);
+            removed += gone;
             pthread_mutex_unlock(mutex);
-            return 1; // Found
+            retire_flush();
         }
-        current = current->next;
+        free(batch.entries);
     }
-    
-    pthread_mutex_unlock(mutex);
-    return 0; // Not found
+    pthread_mutex_unlock(&table->resize_mutex);
+
+    if (removed) filter_note_delete(table, removed);
+    return removed;
 }
 
 
 // ============================================================================================= //
-// ============================================ PRINT ========================================== //
+// ========================================= CHECKPOINT ======================================== //
 // ============================================================================================= //
-void print_hashtable(HashTable* table) {
-    if (!table) return;
+// ht_checkpoint_async holds every stripe just long enough to fork. The child gets a frozen
+// copy-on-write image of the table and streams it to disk while the parent keeps serving;
+// the kernel only copies the pages the parent writes in the meantime.
+//
+// File: CheckpointHeader, then `count` (int32 key, int32 value) pairs in host byte order.
+#define CHECKPOINT_MAGIC 0x4b435448u    // "HTCK"
+#define CHECKPOINT_VERSION 1u
+#define CHECKPOINT_BUFFER 65536
 
-    pthread_mutex_lock(&table->resize_mutex); // Lock during print to avoid resizing
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+    uint64_t buckets;       // Table size when written, reused on load
+    uint64_t checksum;      // FNV-1a over the pairs
+} CheckpointHeader;
 
-    for (size_t i = 0; i < table->size; i++) {
-        printf("Bucket[%zu]: ", i);
-        Node* current = table->buckets[i];
-        while (current) {
-            printf("-> ( %d, %d) ", current->key, current->value);
-            current = current->next;
+static double checkpoint_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool checkpoint_write_all(int fd, const void* data, size_t len) {
+    const char* p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
         }
-        printf("-> NULL\n");
+        p += n;
+        len -= (size_t)n;
     }
+    return true;
+}
 
-    pthread_mutex_unlock(&table->resize_mutex); // Unlock after printing
+static uint64_t checkpoint_fnv(uint64_t hash, const void* data, size_t len) {
+    const unsigned char* p = data;
+    for (size_t i = 0; i < len; i++) hash = (hash ^ p[i]) * 0x100000001b3ULL;
+    return hash;
 }
 
+// Private (copied) memory of this process in bytes, from /proc/self/smaps_rollup; 0 if unknown.
+// Runs in the forked child too, so it sticks to open/read: another thread of the parent may
+// have held a stdio or malloc lock at the fork.
+static size_t checkpoint_private_bytes(void) {
+    int fd = open("/proc/self/smaps_rollup", O_RDONLY);
+    if (fd < 0) return 0;
+    char text[4096];
+    size_t len = 0;
+    ssize_t n;
+    while (len < sizeof(text) - 1 && (n = read(fd, text + len, sizeof(text) - 1 - len)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        len += (size_t)n;
+    }
+    close(fd);
+    text[len] = '\0';
+
+    size_t total = 0;
+    for (char* line = text; *line; ) {
+        char* field = NULL;
+        if (strncmp(line, "Private_Clean:", 14) == 0 || strncmp(line, "Private_Dirty:", 14) == 0) field = line + 14;
+        if (field) {
+            while (*field == ' ') field++;
+            size_t kb = 0;
+            while (*field >= '0' && *field <= '9') kb = kb * 10 + (size_t)(*field++ - '0');
+            total += kb;
+        }
+        char* end = strchr(line, '\n');
+        if (!end) break;
+        line = end + 1;
+    }
+    return total * 1024;
+}
 
-// ============================================================================================= //
-void ht_delete(HashTable* table, int key) {
-    if (!table) return;
+typedef struct {
+    int fd;
+    char* buffer;
+    size_t used;
+    CheckpointHeader header;
+    bool ok;
+} CheckpointWriter;
 
-    size_t bucket_index = hash_function(key, table->size);
-    pthread_mutex_t* mutex = get_bucket_mutex(table, bucket_index);
+static void checkpoint_write_pair(int key, int value, void* arg) {
+    CheckpointWriter* writer = arg;
+    if (!writer->ok) return;
+    int32_t pair[2] = { key, value };
+    if (writer->used + sizeof(pair) > CHECKPOINT_BUFFER) {
+        writer->ok = checkpoint_write_all(writer->fd, writer->buffer, writer->used);
+        writer->used = 0;
+    }
+    memcpy(writer->buffer + writer->used, pair, sizeof(pair));
+    writer->used += sizeof(pair);
+    writer->header.checksum = checkpoint_fnv(writer->header.checksum, pair, sizeof(pair));
+    writer->header.count++;
+}
 
-    pthread_mutex_lock(mutex);
+static void checkpoint_write_chain(CheckpointWriter* writer, const Node* current) {
+    for (; current; current = current->next) {
+        if (!(current->flags & NODE_DEAD)) checkpoint_write_pair(current->key, current->value, writer);
+    }
+}
 
+// Runs in the forked child: only this thread exists and nothing changes under it
+static void checkpoint_child(const HashTable* table, const char* path, int report_fd) {
+    HtCheckpointStats stats = {0};
+    char tmp_path[4096];
+    static char buffer[CHECKPOINT_BUFFER];
+    size_t before = checkpoint_private_bytes();
 
-    Node* current = table->buckets[bucket_index];
-    Node* prev = NULL;
-    // If first node is the one to delete
-    while (current && current->key == key) {
-        Node* temp = current;
-        current = current->next;
-        free(temp);
-        
-        table->count--;
-        
-        table->buckets[bucket_index] = current; // Update head
-        pthread_mutex_unlock(mutex);
-        return;
+    size_t path_len = strlen(path);
+    int fd = -1;
+    if (path_len + sizeof(".tmp") <= sizeof(tmp_path)) { // No stdio in the child
+        memcpy(tmp_path, path, path_len);
+        memcpy(tmp_path + path_len, ".tmp", sizeof(".tmp"));
+        fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
     }
-    // Search for the key in the linked list
-    while (current) {
-        if (current->key == key) {
-            prev->next = current->next;
-            free(current);
-            
-            table->count--;
-            
-            pthread_mutex_unlock(mutex);
-            return;
+    CheckpointWriter writer = { fd, buffer, 0,
+                                { CHECKPOINT_MAGIC, CHECKPOINT_VERSION, 0, table->size, 0xcbf29ce484222325ULL }, true };
+    CheckpointHeader* header = &writer.header;
+    writer.ok = fd >= 0 && checkpoint_write_all(fd, header, sizeof(*header)); // Placeholder, rewritten below
+
+    for (size_t i = 0; writer.ok && i < table->size; i++) checkpoint_write_chain(&writer, table->buckets[i]);
+    if (table->old_buckets) { // Resize in flight: chains not moved yet
+        for (size_t i = table->migrate_cursor; writer.ok && i < table->old_size; i++) {
+            checkpoint_write_chain(&writer, table->old_buckets[i]);
         }
-        prev = current;
-        current = current->next;
     }
-    pthread_mutex_unlock(mutex);
+    if (table->tier) { // Inherited paused by the forking thread, which this one continues
+        ht_tier_resume(table->tier);
+        if (!ht_tier_foreach(table->tier, checkpoint_write_pair, &writer)) writer.ok = false;
+    }
+    bool ok = writer.ok && checkpoint_write_all(fd, buffer, writer.used);
+    ok = ok && pwrite(fd, header, sizeof(*header), 0) == (ssize_t)sizeof(*header);
+    ok = ok && fsync(fd) == 0;
+    if (fd >= 0 && close(fd) != 0) ok = false;
+    ok = ok && rename(tmp_path, path) == 0;
+    if (!ok && fd >= 0) unlink(tmp_path);
+
+    // Pages that stopped being shared were copied because the parent wrote them
+    size_t after = checkpoint_private_bytes();
+    stats.ok = ok;
+    stats.entries = header->count;
+    stats.bytes = sizeof(*header) + header->count * 2 * sizeof(int32_t);
+    stats.cow_bytes = after > before ? after - before : 0;
+    checkpoint_write_all(report_fd, &stats, sizeof(stats));
+    _exit(ok ? 0 : 1);
+}
+
+// Starts writing the table to `path` in a forked child. Writers are blocked only for the
+// fork itself; the file appears (atomically, via rename) when the child is done. Returns 1
+// if the checkpoint started, 0 on failure or if one is already running.
+int ht_checkpoint_async(HashTable* table, const char* path) {
+    if (!table || !path) return 0;
+
+    pthread_mutex_lock(&table->checkpoint_mutex);
+    int report[2];
+    if (table->checkpoint_pid || pipe(report) != 0) {
+        pthread_mutex_unlock(&table->checkpoint_mutex);
+        return 0;
+    }
+
+    double start = checkpoint_now();
+    pthread_mutex_lock(&table->resize_mutex); // No resize step mid-fork
+    lock_all_buckets(table);
+    ht_tier_pause(table->tier); // Nor a compaction half-way through the tier index
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(report[0]);
+        checkpoint_child(table, path, report[1]);
+    }
+
+    ht_tier_resume(table->tier);
+    unlock_all_buckets(table);
+    pthread_mutex_unlock(&table->resize_mutex);
+    double forked = checkpoint_now();
+
+    close(report[1]);
+    if (pid < 0) {
+        close(report[0]);
+        pthread_mutex_unlock(&table->checkpoint_mutex);
+        return 0;
+    }
+    table->checkpoint_pid = pid;
+    table->checkpoint_pipe = report[0];
+    table->checkpoint_start = start;
+    table->checkpoint_pause_ms = (forked - start) * 1000.0;
+    pthread_mutex_unlock(&table->checkpoint_mutex);
+    return 1;
+}
+
+// Waits for the running checkpoint and fills *stats (may be NULL). Returns 1 if the file
+// was written, 0 if it failed or no checkpoint was running. Concurrent callers queue on
+// checkpoint_mutex; only the first sees the checkpoint.
+int ht_checkpoint_wait(HashTable* table, HtCheckpointStats* stats) {
+    if (!table) return 0;
+
+    pthread_mutex_lock(&table->checkpoint_mutex);
+    if (!table->checkpoint_pid) {
+        pthread_mutex_unlock(&table->checkpoint_mutex);
+        return 0;
+    }
+
+    HtCheckpointStats result = {0};
+    size_t got = 0;
+    while (got < sizeof(result)) {
+        ssize_t n = read(table->checkpoint_pipe, (char*)&result + got, sizeof(result) - got);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        got += (size_t)n;
+    }
+    if (got < sizeof(result)) memset(&result, 0, sizeof(result)); // Child died early
+
+    int status;
+    while (waitpid(table->checkpoint_pid, &status, 0) < 0 && errno == EINTR) {}
+    close(table->checkpoint_pipe);
+
+    result.ok = result.ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    result.pause_ms = table->checkpoint_pause_ms;
+    result.duration_ms = (checkpoint_now() - table->checkpoint_start) * 1000.0;
+    table->checkpoint_pid = 0;
+    table->checkpoint_pipe = -1;
+    pthread_mutex_unlock(&table->checkpoint_mutex);
+
+    if (stats) *stats = result;
+    return result.ok;
+}
+
+// Creates a table holding the contents of a checkpoint file. Returns NULL if it is missing,
+// truncated or corrupt.
+HashTable* ht_checkpoint_load(const char* path) {
+    if (!path) return NULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    CheckpointHeader header;
+    struct stat st;
+    bool ok = read(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) && fstat(fd, &st) == 0 &&
+              header.magic == CHECKPOINT_MAGIC && header.version == CHECKPOINT_VERSION &&
+              header.count <= (SIZE_MAX - sizeof(header)) / (2 * sizeof(int32_t)) && // Size below cannot wrap
+              (uint64_t)st.st_size == sizeof(header) + header.count * 2 * sizeof(int32_t);
+
+    HashTable* table = NULL;
+    if (ok) {
+        // The saved size is only a hint: past twice the keys (a corrupt header, or a table
+        // that lost most of its keys) size for the keys instead and let inserts grow it
+        size_t limit = (size_t)header.count * 2 + INITIAL_TABLE_SIZE;
+        size_t size = header.buckets > 0 ? (size_t)header.buckets : INITIAL_TABLE_SIZE;
+        if (header.buckets > limit) size = limit;
+        table = create_hashtable(size);
+        ok = table != NULL;
+    }
+
+    int32_t* buffer = malloc(CHECKPOINT_BUFFER);
+    if (!buffer) ok = false;
+    uint64_t checksum = 0xcbf29ce484222325ULL;
+    uint64_t remaining = ok ? header.count : 0;
+    while (ok && remaining > 0) {
+        size_t pairs = remaining < CHECKPOINT_BUFFER / 8 ? (size_t)remaining : CHECKPOINT_BUFFER / 8;
+        ssize_t n = read(fd, buffer, pairs * 8);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0 || n % 8 != 0) { // Regular file: whole pairs unless truncated
+            ok = false;
+            break;
+        }
+        pairs = (size_t)n / 8;
+        checksum = checkpoint_fnv(checksum, buffer, (size_t)n);
+        for (size_t i = 0; i < pairs; i++) ht_insert(table, buffer[2 * i], buffer[2 * i + 1]);
+        remaining -= pairs;
+    }
+    close(fd);
+    free(buffer);
+
+    if (ok && checksum != header.checksum) ok = false;
+    if (!ok) {
+        ht_destroy(table);
+        return NULL;
+    }
+    return table;
 }
 
 
 // ============================================================================================= //
-// ============================================ COUNT ========================================= //
+// ============================================ FREEZE ========================================= //
 // ============================================================================================= //
-size_t ht_count(const HashTable* table) {
-    if (!table) return 0;
+typedef struct {
+    int* keys;
+    int* values;
+    size_t n;
+    size_t capacity;
+} FreezeBatch;
 
-    size_t count = 0;
+static void freeze_collect(int key, int value, void* arg) {
+    FreezeBatch* batch = arg;
+    if (batch->n == batch->capacity) return;
+    batch->keys[batch->n] = key;
+    batch->values[batch->n] = value;
+    batch->n++;
+}
+
+// Snapshots the current contents into a frozen table (see hashtablescratch_frozen.c). The
+// table stays usable; later writes are not reflected in the snapshot. Returns NULL on failure.
+FrozenTable* ht_freeze(HashTable* table) {
+    if (!table) return NULL;
+
+    pthread_mutex_lock(&table->resize_mutex);
+    while (migrate_chunk(table)) {} // Every key in the current buckets
+    lock_all_buckets(table);
+
+    // Counted here rather than taken from table->count, which lags behind thread handles
+    size_t count = ht_tier_count(table->tier);
     for (size_t i = 0; i < table->size; i++) {
-        Node* current = table->buckets[i];
-        while (current) {
-            count++;
-            current = current->next;
+        for (Node* current = table->buckets[i]; current; current = current->next) count += !(current->flags & NODE_DEAD);
+    }
+    FreezeBatch batch = { malloc(sizeof(int) * (count ? count : 1)), malloc(sizeof(int) * (count ? count : 1)), 0, count };
+    int* keys = batch.keys;
+    int* values = batch.values;
+    size_t n = 0;
+    if (keys && values) {
+        for (size_t i = 0; i < table->size; i++) {
+            for (Node* current = table->buckets[i]; current; current = current->next) {
+                if (current->flags & NODE_DEAD) continue;
+                keys[n] = current->key;
+                values[n] = current->value;
+                n++;
+            }
         }
+        batch.n = n;
+        if (table->tier) ht_tier_foreach(table->tier, freeze_collect, &batch); // Stripes held: the tier is fixed too
+        n = batch.n;
     }
-    return count;
+
+    unlock_all_buckets(table);
+    pthread_mutex_unlock(&table->resize_mutex);
+
+    FrozenTable* frozen = keys && values ? ht_frozen_build(keys, values, n, 0) : NULL;
+    free(keys);
+    free(values);
+    return frozen;
 }
 
 
 // ============================================================================================= //
 // =========================================== DESTROY ======================================== //
 // ============================================================================================= //
-void ht_destroy(HashTable* table) {
-    if (!table) return;
+// Freeing a big table node by node is dominated by cache misses on the chains, so large
+// tables are walked by several threads, each taking a contiguous range of buckets.
+#define TEARDOWN_MIN_BUCKETS (1u << 20)  // Below this one thread is faster than starting more
+#define TEARDOWN_MAX_THREADS 8
 
-    for (size_t i = 0; i < table->size; i++) {
-        Node* current = table->buckets[i];
+typedef struct {
+    HashTable* table;
+    Node** buckets;
+    size_t from;
+    size_t to;
+    pthread_t thread;
+} TeardownRange;
+
+static void* teardown_range(void* arg) {
+    TeardownRange* range = arg;
+    for (size_t i = range->from; i < range->to; i++) {
+        Node* current = range->buckets[i];
         while (current) {
             Node* temp = current;
             current = current->next;
-            free(temp);
+            mvcc_free_versions(range->table, temp);
+            if (!range->table->arena) free(temp);
         }
     }
+    return NULL;
+}
+
+// Frees every chain in buckets[from, to); the table is no longer shared
+static void teardown_chains(HashTable* table, Node** buckets, size_t from, size_t to) {
+    TeardownRange ranges[TEARDOWN_MAX_THREADS];
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t threads = cpus > 1 ? (size_t)cpus : 1;
+    if (threads > TEARDOWN_MAX_THREADS) threads = TEARDOWN_MAX_THREADS;
+    if (to - from < TEARDOWN_MIN_BUCKETS) threads = 1;
+
+    size_t per_thread = (to - from + threads - 1) / threads;
+    size_t started = 0;
+    for (size_t t = 0; t < threads; t++) {
+        size_t begin = from + t * per_thread;
+        size_t end = begin + per_thread < to ? begin + per_thread : to;
+        ranges[t] = (TeardownRange){ table, buckets, begin, end, 0 };
+        // The last range runs here, as does any range whose thread could not start
+        if (t + 1 < threads && pthread_create(&ranges[t].thread, NULL, teardown_range, &ranges[t]) == 0) {
+            started |= (size_t)1 << t;
+        } else {
+            teardown_range(&ranges[t]);
+        }
+    }
+    for (size_t t = 0; t < threads; t++) {
+        if (started & ((size_t)1 << t)) pthread_join(ranges[t].thread, NULL);
+    }
+}
+
+void ht_destroy(HashTable* table) {
+    if (!table) return;
+
+    maintenance_stop(table);
+    if (table->checkpoint_pid) ht_checkpoint_wait(table, NULL);
+    ht_tier_close(table->tier);
+
+    // Arena nodes go away with their chunks, so chains only need walking for malloc'd nodes
+    // or to release versions left by snapshots
+    if (!table->arena || atomic_load(&table->versions_live) > 0) {
+        if (table->old_buckets) { // Resize in flight: chains not moved yet
+            teardown_chains(table, table->old_buckets, table->migrate_cursor, table->old_size);
+        }
+        teardown_chains(table, table->buckets, 0, table->size);
+    }
+    bucket_free(table->old_buckets);
+    filter_free(table->next_filter);
 
-    free(table->buckets);
+    bucket_free(table->buckets);
     table->buckets = NULL;
+    arena_destroy(table->arena);
+
+    free(table->fc_slots);
+
+    filter_free(atomic_load(&table->filter));
     
     for (int i = 0; i < NUM_MUTEXES; i++) {
         pthread_mutex_destroy(&table->mutexes[i]);
     }
 
     pthread_mutex_destroy(&table->resize_mutex); // Destroy resize mutex
+    pthread_mutex_destroy(&table->snapshot_mutex);
+    pthread_mutex_destroy(&table->checkpoint_mutex);
 
     free(table);
     table = NULL;
@@ -4,20 +4,172 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include <pthread.h>
 #include <stdatomic.h>
+#include <sys/types.h>
 
 #define INITIAL_TABLE_SIZE 19
 #define NUM_MUTEXES 64  // Number of mutexes for finer-grained locking
+#define FILTER_DEFAULT_BITS_PER_KEY 10  // ~1% false positives with the blocked layout
+#define READ_CACHE_ENTRIES 1024  // Per-thread hot-key cache slots (16 bytes each, power of two)
+#define MIGRATE_CHUNK 4096       // Old buckets moved per step of an incremental resize
+#define NODE_SLAB 256            // Nodes a stripe takes from the node arena at a time
+#define RETIRE_BATCH 256         // Unlinked nodes a thread keeps for reuse before freeing them
+#define HANDLE_COUNT_BATCH 64    // Entries a thread handle adds or removes before publishing the count
+#define HT_STATS_CHAIN_HISTOGRAM 16     // Chain lengths 0..14, then 15 or more
+#define HT_STATS_FULL_SCAN (1u << 20)   // Bigger tables are sampled by ht_stats
+
+// Negative-lookup filter (blocked Bloom filter, defined in hashtablescratch.c)
+typedef struct NegFilter NegFilter;
+
+// Node arena (defined in hashtablescratch.c)
+typedef struct NodeArena NodeArena;
+
+// Where bucket arrays and nodes come from (ht_set_memory_policy), combinable
+typedef enum {
+    HT_MEM_DEFAULT = 0,                 // calloc/malloc
+    HT_MEM_HUGE_TRANSPARENT = 1 << 0,   // mmap + madvise(MADV_HUGEPAGE), 2 MB aligned
+    HT_MEM_HUGE_EXPLICIT = 1 << 1,      // MAP_HUGETLB (falls back to transparent if none reserved)
+    HT_MEM_NUMA_INTERLEAVE = 1 << 2,    // Spread pages round-robin over all online NUMA nodes
+    HT_MEM_NODE_ARENA = 1 << 3          // Carve nodes from large mapped chunks instead of malloc
+} HtMemFlags;
+
+// One operation of an ht_multi_update transaction
+typedef enum {
+    HT_TXN_GET,
+    HT_TXN_SET,
+    HT_TXN_DELETE,
+    HT_TXN_ADD,         // value is a delta
+    HT_TXN_SET_FROM     // value is the source key
+} HtTxnOpKind;
+
+typedef struct {
+    HtTxnOpKind op;
+    int key;
+    int value;  // In: see HtTxnOpKind. Out: value read or written
+    int found;  // Out: key (SET_FROM: source key) was present
+} HtTxnOp;
+
+// Result of the non-blocking variants (ht_try_get, ht_timed_insert, ...). Found/not found
+// keep the 1/0 of ht_get.
+typedef enum {
+    HT_BUSY = -1,       // The stripe stayed locked past the deadline; nothing was done
+    HT_NOT_FOUND = 0,   // get/delete: key absent. insert: out of memory
+    HT_OK = 1           // get: found. insert/delete: done
+} HtStatus;
+
+// What ht_merge keeps for a key present in both tables (ht_intersect: a is dst, b is src)
+typedef enum {
+    HT_MERGE_KEEP_DST,  // Existing value wins
+    HT_MERGE_TAKE_SRC,  // Incoming value overwrites
+    HT_MERGE_SUM        // Values are added (wrapping)
+} HtMergePolicy;
+
+// Per-thread access handle (ht_thread_handle, defined in hashtablescratch.c)
+typedef struct HtHandle HtHandle;
+
+// Operations done through one handle (ht_handle_stats); plain counters, never shared
+typedef struct {
+    uint64_t gets;
+    uint64_t hits;
+    uint64_t inserts;
+    uint64_t deletes;
+    uint64_t geometry_misses;   // Cached geometry was stale (resize) and had to be reread
+    uint64_t count_flushes;     // Local count deltas published to the table
+} HtHandleStats;
+
+// Per-stripe publication slot for flat combining (defined in hashtablescratch.c)
+typedef struct FcSlot FcSlot;
+
+// How insert/get/delete reach a stripe
+typedef enum {
+    HT_EXEC_LOCKING = 0,        // Every thread locks the stripe itself (default)
+    HT_EXEC_FLAT_COMBINING = 1  // Threads publish ops; the lock holder applies them in batches
+} HtExecMode;
+
+// Previous states of a node, kept while a snapshot may need them (defined in hashtablescratch.c)
+typedef struct NodeVersion NodeVersion;
+
+// Point-in-time read handle (ht_snapshot_begin, defined in hashtablescratch.c)
+typedef struct HtSnapshot HtSnapshot;
+
+#define NODE_DEAD 0x1u  // Deleted, but kept in its chain for snapshots that still see it
+#define NODE_ACCESSED 0x2u  // Read or written since the eviction hand last passed (tiering)
 
 // Node structure for linked list in each bucket
 typedef struct Node {
     int key;
     int value;
     struct Node* next;
+    NodeVersion* versions; // Newest first; NULL unless written while a snapshot was open
+    unsigned flags; // NODE_*
 } Node;
 
+// Append-only disk segments holding evicted entries (hashtablescratch_tier.c)
+typedef struct TierStore TierStore;
+
+// Background growth thread (ht_enable_background_resize)
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    bool running;
+    bool pending; // Growth requested, protected by mutex
+    bool stop;
+    float soft_threshold; // Load factor that wakes the thread
+    float hard_threshold; // Load factor at which writers grow the table themselves
+    atomic_bool grow_requested; // Writers signal at most once per growth
+} Maintenance;
+
+// Result of a background checkpoint (ht_checkpoint_wait)
+typedef struct {
+    int ok;                 // 1 if the file was written and renamed into place
+    size_t entries;
+    size_t bytes;           // File size
+    double pause_ms;        // Writers blocked: stripe barrier + fork
+    double duration_ms;     // From ht_checkpoint_async until the child finished
+    size_t cow_bytes;       // Pages the parent copied on write while the child ran
+} HtCheckpointStats;
+
+// Lock traffic of one stripe, written only by the thread holding it
+typedef struct {
+    atomic_uint_fast64_t acquisitions;
+    atomic_uint_fast64_t contended; // Acquisitions that had to wait for another thread
+    atomic_uint_fast64_t busy; // Non-blocking calls that gave up on this stripe (any thread)
+} __attribute__((aligned(64))) StripeCounters;
+
+// Lock-free readers inside a guarded section (a read around a resize step, a filter probe),
+// counted per key stripe so a writer holding every stripe can wait for them to leave
+typedef struct {
+    atomic_uint active;
+} __attribute__((aligned(64))) StripeReaders;
+
+// Table health report (ht_stats). Chain figures come from every bucket up to
+// HT_STATS_FULL_SCAN buckets, from an even sample above that.
+typedef struct {
+    size_t buckets;
+    size_t entries;                 // In memory (ht_count also adds the disk tier)
+    size_t tier_entries;
+    double load_factor;             // entries / buckets
+    size_t buckets_scanned;         // == buckets unless sampled
+    size_t chain_histogram[HT_STATS_CHAIN_HISTOGRAM]; // Scanned buckets by chain length
+    size_t max_chain;               // Longest scanned chain
+    double empty_ratio;             // Scanned buckets with no node
+    double mean_chain;              // Nodes per non-empty scanned bucket (lookup cost of a hit)
+    size_t stripe_entries[NUM_MUTEXES]; // Nodes per stripe in the current array (scaled up when sampled)
+    uint64_t stripe_acquisitions[NUM_MUTEXES];
+    uint64_t stripe_contended[NUM_MUTEXES];
+    uint64_t stripe_busy[NUM_MUTEXES];  // HT_BUSY returns
+    size_t resizes;                 // Completed or in flight
+    double resize_ms;               // Writers blocked by resize steps, summed
+    bool resizing;                  // An incremental resize is in flight
+    size_t bucket_bytes;            // Bucket arrays, including one being drained
+    size_t node_bytes;              // Nodes (arena: mapped chunks) plus saved versions
+    size_t filter_bytes;
+} HtStats;
+
 // HashTable structure
 typedef struct HashTable {
     Node** buckets;
@@ -25,6 +177,43 @@ typedef struct HashTable {
     atomic_size_t count; // Use atomic for thread-safe count
     pthread_mutex_t mutexes[NUM_MUTEXES]; // Mutex for thread safety
     pthread_mutex_t resize_mutex; // Mutex for resizing    
+    _Atomic(NegFilter*) filter; // Optional negative-lookup filter (NULL if disabled)
+    atomic_size_t filter_stale; // Deletes since the filter was last rebuilt
+    atomic_int exec_mode; // HtExecMode
+    FcSlot* fc_slots; // NUM_MUTEXES * FC_SLOTS publication slots, allocated on first use
+    unsigned id; // Unique per table, tags entries in the per-thread read caches
+    atomic_bool read_cache; // Per-thread hot-key cache enabled (only changed with every stripe held)
+    atomic_uint stripe_versions[NUM_MUTEXES]; // Bumped by every write while the read cache is on
+    Node** old_buckets; // Array being drained by an incremental resize (NULL when idle)
+    size_t old_size;
+    size_t migrate_cursor; // old_buckets[0 .. migrate_cursor) have been moved
+    atomic_bool migrating; // A resize step holds every stripe and is relinking nodes
+    atomic_size_t migrate_done; // During a step: old_buckets[0 .. migrate_done) fully relinked
+    atomic_size_t migrate_busy; // During a step: old_buckets[migrate_busy ..) not touched yet
+    StripeReaders resize_readers[NUM_MUTEXES];
+    StripeReaders filter_readers[NUM_MUTEXES]; // Probing the filter; drained before a replaced one is freed
+    atomic_uint geometry; // Bumped whenever keys may have changed bucket (every bucket mutex held)
+    NegFilter* next_filter; // Filter for the new array, filled while migrating
+    Maintenance maint;
+    unsigned mem_flags; // HtMemFlags used for new bucket arrays and nodes
+    NodeArena* arena; // Node chunks and per-stripe free lists (HT_MEM_NODE_ARENA)
+    atomic_uint_fast64_t epoch; // Tags writes; ht_snapshot_begin advances it
+    atomic_uint snapshots_active;
+    atomic_size_t versions_live; // NodeVersions not yet collected
+    atomic_uint_fast64_t versions_lost; // Newest write epoch whose old state could not be saved
+    pthread_mutex_t snapshot_mutex; // Guards the list of open snapshots
+    HtSnapshot* snapshots;
+    pthread_mutex_t checkpoint_mutex; // Guards the checkpoint_* fields below
+    pid_t checkpoint_pid; // Child writing a checkpoint (0 = none)
+    int checkpoint_pipe; // Child reports its HtCheckpointStats here
+    double checkpoint_start; // Seconds (CLOCK_MONOTONIC)
+    double checkpoint_pause_ms;
+    TierStore* tier; // Cold entries spilled to disk (NULL unless ht_enable_tiering)
+    size_t tier_budget; // Entries kept in memory before the coldest are evicted
+    size_t evict_cursor; // CLOCK hand over buckets, protected by resize_mutex
+    StripeCounters stripe_counters[NUM_MUTEXES];
+    size_t resizes; // Protected by resize_mutex, like resize_ms
+    double resize_ms;
 } HashTable;
 
 
@@ -32,10 +221,137 @@ typedef struct HashTable {
 HashTable* create_hashtable(size_t size);
 void ht_insert(HashTable* table, int key, int value);
 int ht_get(HashTable* table, int key_to_seek, int* seeked_value);
+size_t ht_get_batch(HashTable* table, const int* keys, int* values, int* found, size_t n);
 void ht_delete(HashTable* table, int key);
+HtStatus ht_try_get(HashTable* table, int key_to_seek, int* seeked_value);
+HtStatus ht_try_insert(HashTable* table, int key, int value);
+HtStatus ht_try_delete(HashTable* table, int key);
+HtStatus ht_timed_get(HashTable* table, int key_to_seek, int* seeked_value, unsigned timeout_us);
+HtStatus ht_timed_insert(HashTable* table, int key, int value, unsigned timeout_us);
+HtStatus ht_timed_delete(HashTable* table, int key, unsigned timeout_us);
+int ht_multi_update(HashTable* table, HtTxnOp* ops, size_t n);
+HtHandle* ht_thread_handle(HashTable* table);
+void ht_handle_insert(HtHandle* handle, int key, int value);
+int ht_handle_get(HtHandle* handle, int key_to_seek, int* seeked_value);
+void ht_handle_delete(HtHandle* handle, int key);
+void ht_handle_stats(const HtHandle* handle, HtHandleStats* out);
+void ht_handle_release(HtHandle* handle);
 size_t ht_count(const HashTable* table);
 void ht_destroy(HashTable* table);
 void print_hashtable(HashTable* table);
 void ht_resize(HashTable* table, size_t new_size);
+int ht_enable_filter(HashTable* table, unsigned bits_per_key);
+void ht_filter_rebuild(HashTable* table);
+int ht_set_exec_mode(HashTable* table, HtExecMode mode);
+void ht_enable_read_cache(HashTable* table, bool enable);
+int ht_enable_background_resize(HashTable* table, float soft_threshold, float hard_threshold);
+int ht_set_memory_policy(HashTable* table, unsigned mem_flags);
+HtSnapshot* ht_snapshot_begin(HashTable* table);
+int ht_snapshot_get(HtSnapshot* snapshot, int key_to_seek, int* seeked_value);
+size_t ht_snapshot_foreach(HtSnapshot* snapshot, void (*visit)(int key, int value, void* arg), void* arg);
+int ht_snapshot_valid(HtSnapshot* snapshot);
+void ht_snapshot_end(HtSnapshot* snapshot);
+int ht_checkpoint_async(HashTable* table, const char* path);
+int ht_checkpoint_wait(HashTable* table, HtCheckpointStats* stats);
+HashTable* ht_checkpoint_load(const char* path);
+int ht_enable_tiering(HashTable* table, const char* dir, size_t memory_entries);
+int ht_stats(HashTable* table, HtStats* out);
+int ht_merge(HashTable* dst, HashTable* src, HtMergePolicy policy);
+size_t ht_diff(HashTable* a, HashTable* b, void (*visit)(int key, const int* a_value, const int* b_value, void* arg), void* arg);
+HashTable* ht_intersect(HashTable* a, HashTable* b, HtMergePolicy policy);
+size_t ht_remove_if(HashTable* table, bool (*predicate)(int key, int value, void* ctx), void* ctx, size_t nthreads);
+
+// Shared-memory table (hashtablescratch_shm.c): one table in a POSIX shared-memory segment,
+// read and written by every process that maps it. Geometry and capacity are fixed at creation.
+typedef struct ShmHashTable ShmHashTable;
+
+ShmHashTable* ht_shm_create(const char* name, size_t num_buckets, size_t capacity);
+ShmHashTable* ht_shm_open(const char* name);
+void ht_shm_close(ShmHashTable* table);
+int ht_shm_unlink(const char* name);
+int ht_shm_insert(ShmHashTable* table, int key, int value);
+int ht_shm_get(ShmHashTable* table, int key_to_seek, int* seeked_value);
+void ht_shm_delete(ShmHashTable* table, int key);
+size_t ht_shm_count(const ShmHashTable* table);
+
+// Frozen table (hashtablescratch_frozen.c): immutable minimal-perfect-hash snapshot with
+// lock-free lookups. The image can be saved to a file and mmapped back read-only.
+typedef struct FrozenTable FrozenTable;
+
+FrozenTable* ht_freeze(HashTable* table);
+FrozenTable* ht_frozen_build(const int* keys, const int* values, size_t count, int num_threads);
+int ht_frozen_get(const FrozenTable* table, int key_to_seek, int* seeked_value);
+size_t ht_frozen_count(const FrozenTable* table);
+int ht_frozen_save(const FrozenTable* table, const char* path);
+FrozenTable* ht_frozen_open(const char* path);
+void ht_frozen_close(FrozenTable* table);
+
+// Hopscotch table (hashtablescratch_hopscotch.c): open addressing with 32-bucket neighborhoods,
+// for high load factors. Writers lock two segments; lookups are lock-free and retry on a seqlock.
+typedef struct HopscotchTable HopscotchTable;
+
+HopscotchTable* ht_hop_create(size_t capacity);
+void ht_hop_destroy(HopscotchTable* table);
+int ht_hop_insert(HopscotchTable* table, int key, int value);
+int ht_hop_get(HopscotchTable* table, int key_to_seek, int* seeked_value);
+void ht_hop_delete(HopscotchTable* table, int key);
+size_t ht_hop_count(HopscotchTable* table);
+size_t ht_hop_memory(HopscotchTable* table);
+double ht_hop_load_factor(HopscotchTable* table);
+
+// Robin Hood table (hashtablescratch_robinhood.c): open addressing over a probe-distance array and
+// a key/value array, with backward-shift deletion. Locking and lookups as in the hopscotch table.
+typedef struct RobinHoodTable RobinHoodTable;
+
+RobinHoodTable* ht_rh_create(size_t capacity);
+void ht_rh_destroy(RobinHoodTable* table);
+int ht_rh_insert(RobinHoodTable* table, int key, int value);
+int ht_rh_get(RobinHoodTable* table, int key_to_seek, int* seeked_value);
+void ht_rh_delete(RobinHoodTable* table, int key);
+size_t ht_rh_count(RobinHoodTable* table);
+size_t ht_rh_memory(RobinHoodTable* table);
+double ht_rh_load_factor(RobinHoodTable* table);
+
+// Operation traces (hashtablescratch_trace.c): a build with -DHT_TRACE records every insert, get
+// and delete, including the try/timed, handle and batched forms, each op of ht_multi_update and
+// the keys ht_remove_if deletes; hashtablescratch_replay plays a trace back against any configuration.
+typedef enum {
+    HT_TRACE_INSERT,
+    HT_TRACE_GET,
+    HT_TRACE_DELETE
+} HtTraceOp;
+
+#define HT_TRACE_TIME_SHIFT 16          // stamp = time since start << 16 | thread << 4 | op; time is
+                                        // in clock ticks on disk, ns once loaded (2^48 ticks: ~1 day)
+#define HT_TRACE_THREAD_SHIFT 4
+#define HT_TRACE_THREAD_MASK 0xfffu     // Threads beyond 4096 share ids
+#define HT_TRACE_OP_MASK 0xfu
+
+typedef struct {
+    uint64_t stamp;
+    int key;
+    int value;                          // Inserted value; 0 for gets and deletes
+} HtTraceRecord;
+
+int ht_trace_start(const char* path);
+void ht_trace_stop(void);
+void ht_trace_record(HtTraceOp op, int key, int value);
+HtTraceRecord* ht_trace_load(const char* path, size_t* count);
+
+// Disk tier (hashtablescratch_tier.c): key -> value store in append-only segment files with a
+// compact in-memory index. Used by ht_enable_tiering, but usable on its own.
+TierStore* ht_tier_open(const char* dir);
+void ht_tier_close(TierStore* store);
+int ht_tier_put(TierStore* store, int key, int value);
+int ht_tier_get(TierStore* store, int key, int* value);
+int ht_tier_contains(TierStore* store, int key);
+int ht_tier_take(TierStore* store, int key, int* value);
+int ht_tier_remove(TierStore* store, int key);
+size_t ht_tier_count(TierStore* store);
+void ht_tier_keys(TierStore* store, void (*visit)(int key, void* arg), void* arg);
+int ht_tier_foreach(TierStore* store, void (*visit)(int key, int value, void* arg), void* arg);
+size_t ht_tier_compact(TierStore* store);
+void ht_tier_pause(TierStore* store);
+void ht_tier_resume(TierStore* store);
 
 #endif // HASHTABLE_H
\ No newline at end of file
@@ -0,0 +1,257 @@
+// Load generator for hashtablescratch_server.
+//
+// Each thread opens one connection and keeps `depth` requests (or batches) in flight:
+// it pipelines a window of frames, and every time a response (or a whole batch response)
+// arrives it sends the next one. Reports throughput and round-trip latency percentiles.
+//
+// Usage: ./hashtablescratch_client [-u socket_path | -p port] [-t threads] [-n ops_per_thread]
+//                                   [-d depth] [-b batch] [-r read_percent] [-k keyspace]
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "hashtablescratch_proto.h"
+
+typedef struct {
+    const char* unix_path;
+    int port;
+    long ops;           // Per thread
+    int depth;          // Requests (or batches) in flight per connection
+    int batch;          // 1 = plain frames
+    int read_percent;
+    int keyspace;
+} Config;
+
+typedef struct {
+    pthread_t thread;
+    int id;
+    const Config* config;
+    double* latencies;  // Round trip of every request/batch, in microseconds
+    long completed;     // Requests/batches completed
+    bool failed;
+} ClientThread;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int connect_server(const Config* config) {
+    int fd;
+    if (config->unix_path) {
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        strncpy(addr.sun_path, config->unix_path, sizeof(addr.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) return -1;
+    } else {
+        struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons((uint16_t)config->port) };
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int one = 1;
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) return -1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+static bool write_all(int fd, const void* data, size_t len) {
+    const char* p = data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// Builds one unit of work: a single frame, or a BATCH header followed by `batch` frames
+static size_t build_unit(const Config* config, unsigned* seed, HtRequest* out) {
+    size_t frames = 0;
+    if (config->batch > 1) {
+        out[frames++] = (HtRequest){ HT_OP_BATCH, 0, config->batch };
+    }
+    for (int i = 0; i < config->batch; i++) {
+        int key = (int)(rand_r(seed) % (unsigned)config->keyspace);
+        uint32_t op = (int)(rand_r(seed) % 100) < config->read_percent ? HT_OP_GET : HT_OP_SET;
+        out[frames++] = (HtRequest){ op, key, key * 100 };
+    }
+    return frames;
+}
+
+static void* client_main(void* arg) {
+    ClientThread* self = arg;
+    const Config* config = self->config;
+    unsigned seed = (unsigned)self->id * 7919u + 1;
+
+    int fd = connect_server(config);
+    if (fd < 0) {
+        perror("connect");
+        self->failed = true;
+        return NULL;
+    }
+
+    long units = config->batch > 1 ? config->ops / config->batch : config->ops;
+    size_t unit_frames = (size_t)config->batch + (config->batch > 1 ? 1 : 0); // Responses per unit too
+    HtRequest* frames = malloc(sizeof(HtRequest) * unit_frames * (size_t)config->depth);
+    double* sent_at = malloc(sizeof(double) * (size_t)config->depth);
+    HtResponse* responses = malloc(sizeof(HtResponse) * 4096);
+    if (!frames || !sent_at || !responses) {
+        self->failed = true;
+        goto done;
+    }
+
+    // Fill the pipeline
+    long sent = 0;
+    int window = (int)(units < config->depth ? units : config->depth);
+    size_t count = 0;
+    for (int i = 0; i < window; i++) count += build_unit(config, &seed, frames + count);
+    double start = now_seconds();
+    for (int i = 0; i < window; i++) sent_at[i] = start;
+    if (!write_all(fd, frames, count * sizeof(HtRequest))) {
+        self->failed = true;
+        goto done;
+    }
+    sent = window;
+
+    // Responses come back in order: unit k finishes after k * unit_frames responses
+    size_t partial = 0;       // Bytes of an incomplete response frame already read
+    size_t frames_in_unit = 0;
+    while (self->completed < units) {
+        ssize_t n = read(fd, (char*)responses + partial, sizeof(HtResponse) * 4096 - partial);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            self->failed = true;
+            break;
+        }
+        size_t bytes = partial + (size_t)n;
+        size_t whole = bytes / sizeof(HtResponse);
+
+        size_t batch_bytes = 0;
+        size_t refill = 0;
+        for (size_t i = 0; i < whole; i++) {
+            if (++frames_in_unit < unit_frames) continue;
+            frames_in_unit = 0;
+
+            double t = now_seconds();
+            int slot = (int)(self->completed % config->depth);
+            self->latencies[self->completed] = (t - sent_at[slot]) * 1e6;
+            self->completed++;
+
+            if (sent < units) {
+                sent_at[(int)(sent % config->depth)] = t;
+                refill += build_unit(config, &seed, frames + refill);
+                sent++;
+            }
+        }
+        batch_bytes = refill * sizeof(HtRequest);
+        if (batch_bytes && !write_all(fd, frames, batch_bytes)) {
+            self->failed = true;
+            break;
+        }
+
+        partial = bytes - whole * sizeof(HtResponse);
+        memmove(responses, (char*)responses + whole * sizeof(HtResponse), partial);
+    }
+
+done:
+    free(frames);
+    free(sent_at);
+    free(responses);
+    close(fd);
+    return NULL;
+}
+
+static int compare_double(const void* a, const void* b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char** argv) {
+    Config config = { NULL, HT_PROTO_DEFAULT_PORT, 1000000, 64, 1, 90, 1000000 };
+    int num_threads = 4;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "u:p:t:n:d:b:r:k:")) != -1) {
+        switch (opt) {
+            case 'u': config.unix_path = optarg; break;
+            case 'p': config.port = atoi(optarg); break;
+            case 't': num_threads = atoi(optarg); break;
+            case 'n': config.ops = atol(optarg); break;
+            case 'd': config.depth = atoi(optarg); break;
+            case 'b': config.batch = atoi(optarg); break;
+            case 'r': config.read_percent = atoi(optarg); break;
+            case 'k': config.keyspace = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-u socket_path | -p port] [-t threads] [-n ops_per_thread]\n"
+                                "          [-d depth] [-b batch] [-r read_percent] [-k keyspace]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (num_threads < 1) num_threads = 1;
+    if (config.depth < 1) config.depth = 1;
+    if (config.batch < 1) config.batch = 1;
+    if (config.batch > HT_PROTO_MAX_BATCH) config.batch = HT_PROTO_MAX_BATCH;
+    if (config.keyspace < 1) config.keyspace = 1;
+    // Two windows of responses must fit the 4096-frame receive buffer per read
+    while ((long)config.depth * (config.batch + 1) > 2048 && config.depth > 1) config.depth /= 2;
+
+    long units = config.batch > 1 ? config.ops / config.batch : config.ops;
+    ClientThread* threads = calloc((size_t)num_threads, sizeof(ClientThread));
+    for (int i = 0; i < num_threads; i++) {
+        threads[i].id = i;
+        threads[i].config = &config;
+        threads[i].latencies = malloc(sizeof(double) * (size_t)(units > 0 ? units : 1));
+    }
+
+    double start = now_seconds();
+    for (int i = 0; i < num_threads; i++) pthread_create(&threads[i].thread, NULL, client_main, &threads[i]);
+    for (int i = 0; i < num_threads; i++) pthread_join(threads[i].thread, NULL);
+    double elapsed = now_seconds() - start;
+
+    // Merge latencies of all threads for the percentiles
+    long total_units = 0;
+    for (int i = 0; i < num_threads; i++) total_units += threads[i].completed;
+    double* all = malloc(sizeof(double) * (size_t)(total_units > 0 ? total_units : 1));
+    long pos = 0;
+    bool failed = false;
+    for (int i = 0; i < num_threads; i++) {
+        memcpy(all + pos, threads[i].latencies, sizeof(double) * (size_t)threads[i].completed);
+        pos += threads[i].completed;
+        failed |= threads[i].failed;
+        free(threads[i].latencies);
+    }
+    qsort(all, (size_t)total_units, sizeof(double), compare_double);
+
+    long total_ops = total_units * config.batch;
+    printf("=== LOAD GENERATOR RESULTS ===\n");
+    printf("Threads: %d, depth: %d, batch: %d, reads: %d%%\n", num_threads, config.depth, config.batch, config.read_percent);
+    printf("Operations: %ld in %.3f seconds\n", total_ops, elapsed);
+    printf("Operations per second: %.0f\n", total_ops / elapsed);
+    if (total_units > 0) {
+        printf("Round trip per %s (us): p50 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n",
+               config.batch > 1 ? "batch" : "request",
+               all[total_units / 2], all[total_units * 99 / 100], all[total_units * 999 / 1000], all[total_units - 1]);
+    }
+    if (failed) printf("Some connections failed\n");
+
+    free(all);
+    free(threads);
+    return failed ? 1 : 0;
+}
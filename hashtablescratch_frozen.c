@@ -0,0 +1,477 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hashtablescratch.h"
+
+// Frozen (read-only) table: a minimal perfect hash over contiguous key/value pairs, built
+// once from a snapshot and never modified, so lookups take no locks at all.
+//
+// PTHash-style construction. Keys are split into partitions of ~FROZEN_PARTITION_KEYS by
+// their hash, and each partition is built independently (in parallel). Inside a partition
+// of n keys, keys are grouped into ~4n/log2(n) buckets (skewed so 60% of the keys land in
+// 30% of the buckets), and buckets are placed largest first: for each one we search for the
+// smallest "pilot" that sends all its keys to free slots in [0, n). Slots == keys, so the
+// hash is minimal and the pairs array has no holes.
+//
+// Lookup: hash -> partition directory (a few KB, stays cached) -> pilot (1 cache line) ->
+// pair (1 cache line, pairs are 8 bytes and never straddle). The key stored in the slot is
+// compared, so keys that were never in the table are rejected.
+//
+// The in-memory image is exactly the file format, so ht_frozen_save writes it verbatim and
+// ht_frozen_open just mmaps it (pages are shared between processes that open the file).
+
+#define FROZEN_MAGIC 0x5a465448u    // "HTFZ"
+#define FROZEN_VERSION 1u
+#define FROZEN_PARTITION_KEYS 65536
+#define FROZEN_BUCKET_FACTOR 4.0
+#define FROZEN_MAX_SEEDS 8
+#define FROZEN_MAX_PILOT (1u << 24)  // ~256x the expected search for the last free slot
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t seed;
+    uint64_t count;
+    uint64_t num_partitions;
+    uint64_t directory_offset;
+    uint64_t pilots_offset;
+    uint64_t pairs_offset;
+    uint64_t total_size;
+} FrozenHeader;
+
+// num_partitions + 1 entries; partition p owns [key_offset, next key_offset) of the pairs
+// and [pilot_offset, next pilot_offset) of the pilots
+typedef struct {
+    uint32_t key_offset;
+    uint32_t pilot_offset;
+} FrozenPartition;
+
+typedef struct {
+    int32_t key;
+    int32_t value;
+} FrozenPair;
+
+struct FrozenTable {
+    const FrozenHeader* header;
+    const FrozenPartition* directory;
+    const uint32_t* pilots;
+    const FrozenPair* pairs;
+    size_t map_size;
+    bool mapped;        // From ht_frozen_open (munmap) instead of ht_frozen_build (free)
+};
+
+// Shared by the builder threads
+typedef struct {
+    uint64_t seed;
+    const uint64_t* hashes;     // Grouped by partition
+    const int* keys;            // Same order as hashes
+    const int* values;
+    FrozenTable* table;
+    atomic_size_t next_partition;
+    atomic_bool failed;
+} FrozenBuild;
+
+
+// ============================================================================================= //
+// =========================================== HASHING ========================================= //
+// ============================================================================================= //
+static uint64_t frozen_mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// Bijective on 64 bits, so distinct int keys always get distinct hashes
+static uint64_t frozen_hash(int key, uint64_t seed) {
+    return frozen_mix((uint64_t)(uint32_t)key ^ seed);
+}
+
+// Maps x uniformly onto [0, n) without a division
+static uint64_t fastrange64(uint64_t x, uint64_t n) {
+    return (uint64_t)(((unsigned __int128)x * n) >> 64);
+}
+
+static size_t frozen_partition_of(uint64_t hash, uint64_t num_partitions) {
+    return (size_t)fastrange64(hash, num_partitions);
+}
+
+static uint32_t frozen_num_buckets(uint32_t keys) {
+    if (keys < 2) return 1;
+    double log2n = 0;
+    for (uint32_t n = keys; n > 1; n >>= 1) log2n++;
+    uint32_t buckets = (uint32_t)(FROZEN_BUCKET_FACTOR * keys / log2n) + 1;
+    return buckets < keys ? buckets : keys;
+}
+
+// Skewed bucket assignment: 60% of keys go to the first 30% of buckets
+static uint32_t frozen_bucket_of(uint64_t hash, uint32_t num_buckets) {
+    uint64_t h = frozen_mix(hash ^ 0x9e3779b97f4a7c15ULL);
+    uint32_t dense = (uint32_t)(num_buckets * 0.3);
+    if (dense == 0 || dense == num_buckets) return (uint32_t)fastrange64(h, num_buckets);
+    if ((uint32_t)h < (uint32_t)(0.6 * 4294967296.0)) return (uint32_t)fastrange64(h, dense);
+    return dense + (uint32_t)fastrange64(h, num_buckets - dense);
+}
+
+static uint32_t frozen_slot_of(uint64_t hash, uint32_t pilot, uint32_t keys) {
+    return (uint32_t)fastrange64(frozen_mix(hash ^ frozen_mix(pilot)), keys);
+}
+
+
+// ============================================================================================= //
+// ============================================ BUILD ========================================== //
+// ============================================================================================= //
+// Places one partition's keys. Returns false if some bucket found no pilot (retry new seed).
+static bool frozen_build_partition(FrozenBuild* build, size_t p) {
+    FrozenTable* table = build->table;
+    uint32_t base = table->directory[p].key_offset;
+    uint32_t keys = table->directory[p + 1].key_offset - base;
+    uint32_t num_buckets = table->directory[p + 1].pilot_offset - table->directory[p].pilot_offset;
+    uint32_t* pilots = (uint32_t*)table->pilots + table->directory[p].pilot_offset;
+    FrozenPair* pairs = (FrozenPair*)table->pairs + base;
+    const uint64_t* hashes = build->hashes + base;
+    const int* keys_in = build->keys + base;
+    const int* values = build->values + base;
+    if (keys == 0) return true;
+
+    // Group key indices by bucket (counting sort), then order buckets by size, largest first
+    uint32_t* bucket_start = calloc((size_t)num_buckets + 1, sizeof(uint32_t));
+    uint32_t* members = malloc(sizeof(uint32_t) * keys);
+    uint32_t* order = malloc(sizeof(uint32_t) * num_buckets);
+    uint8_t* taken = calloc(((size_t)keys + 7) / 8, 1);
+    uint32_t* slots = malloc(sizeof(uint32_t) * keys);
+    bool ok = bucket_start && members && order && taken && slots;
+
+    uint32_t max_size = 0;
+    if (ok) {
+        for (uint32_t i = 0; i < keys; i++) bucket_start[frozen_bucket_of(hashes[i], num_buckets) + 1]++;
+        for (uint32_t b = 0; b < num_buckets; b++) {
+            if (bucket_start[b + 1] > max_size) max_size = bucket_start[b + 1];
+            bucket_start[b + 1] += bucket_start[b];
+        }
+        uint32_t* fill = malloc(sizeof(uint32_t) * ((size_t)num_buckets > max_size + 1 ? num_buckets : max_size + 1));
+        ok = fill != NULL;
+        if (ok) {
+            memcpy(fill, bucket_start, sizeof(uint32_t) * num_buckets);
+            for (uint32_t i = 0; i < keys; i++) members[fill[frozen_bucket_of(hashes[i], num_buckets)]++] = i;
+
+            // Buckets by decreasing size
+            memset(fill, 0, sizeof(uint32_t) * (max_size + 1));
+            for (uint32_t b = 0; b < num_buckets; b++) fill[bucket_start[b + 1] - bucket_start[b]]++;
+            uint32_t pos = 0;
+            for (uint32_t s = max_size + 1; s-- > 0;) {
+                uint32_t n = fill[s];
+                fill[s] = pos;
+                pos += n;
+            }
+            for (uint32_t b = 0; b < num_buckets; b++) order[fill[bucket_start[b + 1] - bucket_start[b]]++] = b;
+            free(fill);
+        }
+    }
+
+    for (uint32_t o = 0; ok && o < num_buckets; o++) {
+        uint32_t b = order[o];
+        uint32_t first = bucket_start[b], size = bucket_start[b + 1] - first;
+        if (size == 0) {
+            pilots[b] = 0;
+            continue;
+        }
+
+        // Equal hashes can never be separated: that only happens for a repeated key
+        for (uint32_t k = 1; ok && k < size; k++) {
+            for (uint32_t j = 0; j < k; j++) {
+                if (hashes[members[first + j]] == hashes[members[first + k]]) ok = false;
+            }
+        }
+        if (!ok) break;
+
+        uint32_t pilot = 0;
+        for (;; pilot++) {
+            uint32_t k = 0;
+            for (; k < size; k++) {
+                uint32_t slot = frozen_slot_of(hashes[members[first + k]], pilot, keys);
+                if (taken[slot >> 3] & (1u << (slot & 7))) break;
+                uint32_t j = 0;
+                while (j < k && slots[j] != slot) j++;
+                if (j < k) break; // Two keys of this bucket collide
+                slots[k] = slot;
+            }
+            if (k == size) break;
+            if (pilot == FROZEN_MAX_PILOT || atomic_load_explicit(&build->failed, memory_order_relaxed)) {
+                ok = false;
+                break;
+            }
+        }
+        if (!ok) break;
+
+        pilots[b] = pilot;
+        for (uint32_t k = 0; k < size; k++) {
+            uint32_t i = members[first + k];
+            taken[slots[k] >> 3] |= (uint8_t)(1u << (slots[k] & 7));
+            pairs[slots[k]].key = keys_in[i];
+            pairs[slots[k]].value = values[i];
+        }
+    }
+
+    free(bucket_start);
+    free(members);
+    free(order);
+    free(taken);
+    free(slots);
+    return ok;
+}
+
+static void* frozen_build_worker(void* arg) {
+    FrozenBuild* build = arg;
+    size_t num_partitions = build->table->header->num_partitions;
+    for (;;) {
+        size_t p = atomic_fetch_add(&build->next_partition, 1);
+        if (p >= num_partitions || atomic_load(&build->failed)) break;
+        if (!frozen_build_partition(build, p)) atomic_store(&build->failed, true);
+    }
+    return NULL;
+}
+
+static size_t frozen_align(size_t offset) {
+    return (offset + 63) & ~(size_t)63;
+}
+
+// One attempt with a given seed. Returns NULL if allocation failed or a pilot search gave up.
+static FrozenTable* frozen_build_seeded(const int* keys, const int* values, size_t count,
+                                        uint64_t seed, int num_threads) {
+    size_t num_partitions = (count + FROZEN_PARTITION_KEYS - 1) / FROZEN_PARTITION_KEYS;
+    if (num_partitions == 0) num_partitions = 1;
+
+    // Bucket keys by partition (counting sort), hashing each key once
+    size_t* start = calloc(num_partitions + 1, sizeof(size_t));
+    uint64_t* raw = malloc(sizeof(uint64_t) * (count ? count : 1));
+    uint64_t* hashes = malloc(sizeof(uint64_t) * (count ? count : 1));
+    int* sorted_keys = malloc(sizeof(int) * (count ? count : 1));
+    int* sorted_values = malloc(sizeof(int) * (count ? count : 1));
+    FrozenTable* table = calloc(1, sizeof(FrozenTable));
+    char* image = NULL;
+    bool ok = start && raw && hashes && sorted_keys && sorted_values && table;
+
+    if (ok) {
+        for (size_t i = 0; i < count; i++) {
+            raw[i] = frozen_hash(keys[i], seed);
+            start[frozen_partition_of(raw[i], num_partitions) + 1]++;
+        }
+        for (size_t p = 0; p < num_partitions; p++) start[p + 1] += start[p];
+        for (size_t i = 0; i < count; i++) {
+            size_t pos = start[frozen_partition_of(raw[i], num_partitions)]++;
+            hashes[pos] = raw[i];
+            sorted_keys[pos] = keys[i];
+            sorted_values[pos] = values[i];
+        }
+        for (size_t p = num_partitions; p > 0; p--) start[p] = start[p - 1]; // Undo the fill
+        start[0] = 0;
+
+        size_t total_buckets = 0;
+        for (size_t p = 0; p < num_partitions; p++) total_buckets += frozen_num_buckets((uint32_t)(start[p + 1] - start[p]));
+
+        size_t directory_offset = frozen_align(sizeof(FrozenHeader));
+        size_t pilots_offset = frozen_align(directory_offset + (num_partitions + 1) * sizeof(FrozenPartition));
+        size_t pairs_offset = frozen_align(pilots_offset + total_buckets * sizeof(uint32_t));
+        size_t total_size = pairs_offset + count * sizeof(FrozenPair);
+
+        image = aligned_alloc(64, frozen_align(total_size));
+        ok = image != NULL;
+        if (ok) {
+            memset(image, 0, frozen_align(total_size));
+            FrozenHeader* header = (FrozenHeader*)image;
+            *header = (FrozenHeader){ FROZEN_MAGIC, FROZEN_VERSION, seed, count, num_partitions,
+                                      directory_offset, pilots_offset, pairs_offset, total_size };
+
+            FrozenPartition* directory = (FrozenPartition*)(image + directory_offset);
+            uint32_t pilot_offset = 0;
+            for (size_t p = 0; p <= num_partitions; p++) {
+                directory[p].key_offset = (uint32_t)start[p];
+                directory[p].pilot_offset = pilot_offset;
+                if (p < num_partitions) pilot_offset += frozen_num_buckets((uint32_t)(start[p + 1] - start[p]));
+            }
+
+            table->header = header;
+            table->directory = directory;
+            table->pilots = (const uint32_t*)(image + pilots_offset);
+            table->pairs = (const FrozenPair*)(image + pairs_offset);
+            table->map_size = total_size;
+            table->mapped = false;
+        }
+    }
+
+    if (ok) {
+        FrozenBuild build = { .seed = seed, .hashes = hashes, .keys = sorted_keys,
+                              .values = sorted_values, .table = table };
+        atomic_init(&build.next_partition, 0);
+        atomic_init(&build.failed, false);
+
+        if ((size_t)num_threads > num_partitions) num_threads = (int)num_partitions;
+        pthread_t* threads = malloc(sizeof(pthread_t) * (size_t)num_threads);
+        int started = 0;
+        while (threads && started < num_threads - 1 &&
+               pthread_create(&threads[started], NULL, frozen_build_worker, &build) == 0) {
+            started++;
+        }
+        frozen_build_worker(&build); // The calling thread builds too
+        for (int i = 0; i < started; i++) pthread_join(threads[i], NULL);
+        free(threads);
+
+        ok = !atomic_load(&build.failed);
+    }
+
+    free(start);
+    free(raw);
+    free(hashes);
+    free(sorted_keys);
+    free(sorted_values);
+    if (!ok) {
+        free(image);
+        free(table);
+        return NULL;
+    }
+    return table;
+}
+
+// Builds a frozen table from `count` distinct keys and their values, using `num_threads`
+// threads (0 = one per online CPU). Returns NULL on failure or if a key repeats.
+FrozenTable* ht_frozen_build(const int* keys, const int* values, size_t count, int num_threads) {
+    if ((!keys || !values) && count > 0) return NULL;
+    if (count >= UINT32_MAX) return NULL;
+    if (num_threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_threads = cpus > 0 ? (int)cpus : 1;
+    }
+
+    // A pilot search only fails on a duplicate key (or astronomically bad luck): try a few seeds
+    uint64_t seed = 0x2545f4914f6cdd1dULL;
+    for (int attempt = 0; attempt < FROZEN_MAX_SEEDS; attempt++) {
+        FrozenTable* table = frozen_build_seeded(keys, values, count, seed, num_threads);
+        if (table) return table;
+        seed = frozen_mix(seed + (uint64_t)attempt + 1);
+    }
+    return NULL;
+}
+
+
+// ============================================================================================= //
+// ============================================ LOOKUP ========================================= //
+// ============================================================================================= //
+int ht_frozen_get(const FrozenTable* table, int key_to_seek, int* seeked_value) {
+    if (!table || table->header->count == 0) return 0;
+
+    const FrozenHeader* header = table->header;
+    uint64_t hash = frozen_hash(key_to_seek, header->seed);
+    const FrozenPartition* partition = &table->directory[frozen_partition_of(hash, header->num_partitions)];
+
+    uint32_t base = partition[0].key_offset;
+    uint32_t keys = partition[1].key_offset - base;
+    uint32_t num_buckets = partition[1].pilot_offset - partition[0].pilot_offset;
+    if (keys == 0) return 0;
+
+    uint32_t pilot = table->pilots[partition[0].pilot_offset + frozen_bucket_of(hash, num_buckets)];
+    const FrozenPair* pair = &table->pairs[base + frozen_slot_of(hash, pilot, keys)];
+    if (pair->key != key_to_seek) return 0; // Not found
+
+    *seeked_value = pair->value;
+    return 1; // Found
+}
+
+size_t ht_frozen_count(const FrozenTable* table) {
+    return table ? (size_t)table->header->count : 0;
+}
+
+
+// ============================================================================================= //
+// ======================================== SAVE / OPEN ======================================== //
+// ============================================================================================= //
+// Writes the image to `path`. Returns 1 on success, 0 on failure.
+int ht_frozen_save(const FrozenTable* table, const char* path) {
+    if (!table || !path) return 0;
+
+    FILE* file = fopen(path, "wb");
+    if (!file) return 0;
+    size_t written = fwrite(table->header, 1, table->map_size, file);
+    int closed = fclose(file);
+    return written == table->map_size && closed == 0 ? 1 : 0;
+}
+
+// Sections must be 64-byte aligned, in order and inside the file, with their sizes matching the
+// header's counts. Every bound is checked by subtraction or division, so a crafted header
+// cannot wrap a sum or product into passing.
+static bool frozen_header_valid(const FrozenHeader* header, size_t size) {
+    if (header->magic != FROZEN_MAGIC || header->version != FROZEN_VERSION || header->total_size != size) return false;
+    if (header->num_partitions == 0 || header->count >= UINT32_MAX) return false;
+    if (header->directory_offset < sizeof(FrozenHeader) || header->directory_offset % 64 != 0 ||
+        header->pilots_offset % 64 != 0 || header->pairs_offset % 64 != 0) return false;
+    if (header->directory_offset > header->pilots_offset || header->pilots_offset > header->pairs_offset ||
+        header->pairs_offset > size) return false;
+
+    uint64_t directory_entries = (header->pilots_offset - header->directory_offset) / sizeof(FrozenPartition);
+    uint64_t pairs_bytes = size - header->pairs_offset;
+    return header->num_partitions < directory_entries && // num_partitions + 1 entries fit
+           pairs_bytes % sizeof(FrozenPair) == 0 && pairs_bytes / sizeof(FrozenPair) == header->count;
+}
+
+// Maps a file written by ht_frozen_save read-only. Returns NULL if it is missing or invalid.
+FrozenTable* ht_frozen_open(const char* path) {
+    if (!path) return NULL;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(FrozenHeader)) {
+        close(fd);
+        return NULL;
+    }
+
+    size_t size = (size_t)st.st_size;
+    char* base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+
+    const FrozenHeader* header = (const FrozenHeader*)base;
+    bool valid = frozen_header_valid(header, size);
+    if (valid) { // Offsets must be monotonic and in range, or lookups could read outside the map
+        const FrozenPartition* directory = (const FrozenPartition*)(base + header->directory_offset);
+        valid = directory[0].key_offset == 0 && directory[0].pilot_offset == 0 &&
+                directory[header->num_partitions].key_offset == header->count &&
+                (uint64_t)directory[header->num_partitions].pilot_offset * sizeof(uint32_t) <=
+                    header->pairs_offset - header->pilots_offset;
+        for (uint64_t p = 0; valid && p < header->num_partitions; p++) {
+            uint32_t keys = directory[p + 1].key_offset - directory[p].key_offset;
+            valid = directory[p + 1].key_offset >= directory[p].key_offset &&
+                    directory[p + 1].pilot_offset - directory[p].pilot_offset == frozen_num_buckets(keys) &&
+                    directory[p + 1].pilot_offset > directory[p].pilot_offset;
+        }
+    }
+    FrozenTable* table = valid ? malloc(sizeof(FrozenTable)) : NULL;
+    if (!table) {
+        munmap(base, size);
+        return NULL;
+    }
+
+    table->header = header;
+    table->directory = (const FrozenPartition*)(base + header->directory_offset);
+    table->pilots = (const uint32_t*)(base + header->pilots_offset);
+    table->pairs = (const FrozenPair*)(base + header->pairs_offset);
+    table->map_size = size;
+    table->mapped = true;
+    return table;
+}
+
+void ht_frozen_close(FrozenTable* table) {
+    if (!table) return;
+    if (table->mapped) munmap((void*)table->header, table->map_size);
+    else free((void*)table->header);
+    free(table);
+}
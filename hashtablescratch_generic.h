@@ -0,0 +1,308 @@
+#ifndef HASHTABLE_GENERIC_H
+#define HASHTABLE_GENERIC_H
+
+// Type-specialized versions of the fine-grained hash table.
+//
+// HT_DEFINE_TABLE expands into a complete table (struct + functions) for one key/value
+// combination. Hashing, equality and how keys/values are stored are passed as macros, so
+// every instantiation is compiled for its own types: no void*, no callbacks in the hot path.
+// Locking, growth and the API shape follow hashtablescratch.c:
+//
+//   name*  name_create(size_t size);
+//   void   name_insert(name* table, key_t key, value_t value);   // Copies key and value
+//   int    name_get(name* table, key_t key, value_t* out);       // 1 = found (out is a copy)
+//   void   name_delete(name* table, key_t key);
+//   size_t name_count(name* table);
+//   void   name_destroy(name* table);
+//
+// Trait macros:
+//   HASH(k)            -> uint64_t, computed once per insert and cached in the node
+//   EQ(a, b)           -> nonzero if the keys are equal (only called when hashes match)
+//   KEY_COPY(dst, src) -> store src into node field dst, nonzero on success
+//   KEY_FREE(k)        -> release what KEY_COPY allocated
+//   VAL_COPY(dst, src) / VAL_FREE(v) -> same for values
+//
+// Ready-made instantiations: HT_DEFINE_U64_TABLE (uint64_t keys), HT_DEFINE_BYTES_TABLE
+// (byte-string keys) with any plain value type, plus ht_blob values via the HT_BLOB_* traits.
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define HT_GENERIC_MUTEXES 64
+
+// ============================================================================================= //
+// ============================================ TRAITS ========================================= //
+// ============================================================================================= //
+// Plain values (integers, pointers, small structs): stored by assignment
+#define HT_PLAIN_COPY(dst, src) ((dst) = (src), 1)
+#define HT_PLAIN_FREE(v)        ((void)0)
+
+// 64-bit integer keys (murmur3 finalizer)
+static inline uint64_t ht_u64_hash(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    return k ^ (k >> 33);
+}
+#define HT_U64_HASH(k)  ht_u64_hash(k)
+#define HT_U64_EQ(a, b) ((a) == (b))
+
+// Byte-string keys. Inserted keys are copied into the table; lookups may pass any buffer.
+typedef struct {
+    const void* data;
+    size_t len;
+} ht_bytes;
+
+static inline ht_bytes ht_bytes_of(const char* str) {
+    ht_bytes b = { str, strlen(str) };
+    return b;
+}
+
+// FNV-1a over 8-byte words, finished with the murmur3 mixer
+static inline uint64_t ht_bytes_hash(ht_bytes k) {
+    const unsigned char* p = k.data;
+    uint64_t h = 0xcbf29ce484222325ULL ^ k.len;
+    size_t i = 0;
+    for (; i + 8 <= k.len; i += 8) {
+        uint64_t word;
+        memcpy(&word, p + i, 8);
+        h = (h ^ word) * 0x100000001b3ULL;
+    }
+    for (; i < k.len; i++) h = (h ^ p[i]) * 0x100000001b3ULL;
+    return ht_u64_hash(h);
+}
+
+static inline int ht_bytes_copy(ht_bytes* dst, ht_bytes src) {
+    void* data = malloc(src.len ? src.len : 1);
+    if (!data) return 0;
+    memcpy(data, src.data, src.len);
+    dst->data = data;
+    dst->len = src.len;
+    return 1;
+}
+
+#define HT_BYTES_HASH(k)        ht_bytes_hash(k)
+#define HT_BYTES_EQ(a, b)       ((a).len == (b).len && memcmp((a).data, (b).data, (a).len) == 0)
+#define HT_BYTES_COPY(dst, src) ht_bytes_copy(&(dst), (src))
+#define HT_BYTES_FREE(k)        free((void*)(k).data)
+
+// Blob values: owned copies. name_get hands back a fresh copy the caller must free().
+typedef ht_bytes ht_blob;
+#define HT_BLOB_COPY(dst, src) ht_bytes_copy(&(dst), (src))
+#define HT_BLOB_FREE(v)        free((void*)(v).data)
+
+// Same growth policy as hashtablescratch.c: next prime above twice the size
+static inline size_t ht_generic_next_prime(size_t n) {
+    if (n <= 2) return 2;
+    if (n % 2 == 0) n++;
+    for (;; n += 2) {
+        bool prime = n % 3 != 0 || n == 3;
+        for (size_t i = 5; prime && i * i <= n; i += 6) {
+            if (n % i == 0 || n % (i + 2) == 0) prime = false;
+        }
+        if (prime) return n;
+    }
+}
+
+
+// ============================================================================================= //
+// ========================================== GENERATOR ======================================== //
+// ============================================================================================= //
+#define HT_DEFINE_TABLE(name, key_t, value_t, HASH, EQ, KEY_COPY, KEY_FREE, VAL_COPY, VAL_FREE)  \
+                                                                                                \
+typedef struct name##_node {                                                                    \
+    uint64_t hash;                                                                              \
+    key_t key;                                                                                  \
+    value_t value;                                                                              \
+    struct name##_node* next;                                                                   \
+} name##_node;                                                                                  \
+                                                                                                \
+typedef struct name {                                                                           \
+    name##_node** buckets;                                                                      \
+    size_t size;                                                                                \
+    atomic_size_t count;                                                                        \
+    pthread_mutex_t mutexes[HT_GENERIC_MUTEXES];                                                \
+    pthread_mutex_t resize_mutex;                                                               \
+} name;                                                                                         \
+                                                                                                \
+/* Locks the stripe owning the bucket for hash; retries if a resize moved it */                 \
+static inline pthread_mutex_t* name##_lock(name* table, uint64_t hash, size_t* index) {         \
+    for (;;) {                                                                                  \
+        size_t size = table->size;                                                              \
+        size_t i = (size_t)(hash % size);                                                       \
+        pthread_mutex_t* mutex = &table->mutexes[i % HT_GENERIC_MUTEXES];                       \
+        pthread_mutex_lock(mutex);                                                              \
+        if (size == table->size) {                                                              \
+            *index = i;                                                                         \
+            return mutex;                                                                       \
+        }                                                                                       \
+        pthread_mutex_unlock(mutex);                                                            \
+    }                                                                                           \
+}                                                                                               \
+                                                                                                \
+static inline name* name##_create(size_t size) {                                                \
+    name* table = malloc(sizeof(name));                                                         \
+    if (!table) return NULL;                                                                    \
+    table->size = size ? size : 19;                                                             \
+    table->buckets = calloc(table->size, sizeof(name##_node*));                                 \
+    if (!table->buckets) {                                                                      \
+        free(table);                                                                            \
+        return NULL;                                                                            \
+    }                                                                                           \
+    atomic_init(&table->count, 0);                                                              \
+    for (int i = 0; i < HT_GENERIC_MUTEXES; i++) pthread_mutex_init(&table->mutexes[i], NULL);  \
+    pthread_mutex_init(&table->resize_mutex, NULL);                                             \
+    return table;                                                                               \
+}                                                                                               \
+                                                                                                \
+/* Stop-the-world rehash; cached hashes mean keys are never hashed again */                     \
+static inline void name##_resize(name* table, size_t new_size) {                                \
+    name##_node** new_buckets = calloc(new_size, sizeof(name##_node*));                         \
+    if (!new_buckets) return;                                                                   \
+    for (int i = 0; i < HT_GENERIC_MUTEXES; i++) pthread_mutex_lock(&table->mutexes[i]);        \
+    if (new_size > table->size) {                                                               \
+        for (size_t i = 0; i < table->size; i++) {                                              \
+            name##_node* current = table->buckets[i];                                           \
+            while (current) {                                                                   \
+                name##_node* next_node = current->next;                                         \
+                size_t new_index = (size_t)(current->hash % new_size);                          \
+                current->next = new_buckets[new_index];                                         \
+                new_buckets[new_index] = current;                                               \
+                current = next_node;                                                            \
+            }                                                                                   \
+        }                                                                                       \
+        free(table->buckets);                                                                   \
+        table->buckets = new_buckets;                                                           \
+        table->size = new_size;                                                                 \
+        new_buckets = NULL;                                                                     \
+    }                                                                                           \
+    for (int i = HT_GENERIC_MUTEXES - 1; i >= 0; i--) pthread_mutex_unlock(&table->mutexes[i]); \
+    free(new_buckets); /* Lost the race to another resize */                                    \
+}                                                                                               \
+                                                                                                \
+static inline void name##_insert(name* table, key_t key, value_t value) {                       \
+    if (!table) return;                                                                         \
+    uint64_t hash = HASH(key);                                                                  \
+    size_t index;                                                                               \
+    pthread_mutex_t* mutex = name##_lock(table, hash, &index);                                  \
+                                                                                                \
+    for (name##_node* current = table->buckets[index]; current; current = current->next) {      \
+        if (current->hash == hash && EQ(current->key, key)) {                                   \
+            value_t copy;                                                                       \
+            if (VAL_COPY(copy, value)) {                                                        \
+                VAL_FREE(current->value);                                                       \
+                current->value = copy;                                                          \
+            }                                                                                   \
+            pthread_mutex_unlock(mutex);                                                        \
+            return;                                                                             \
+        }                                                                                       \
+    }                                                                                           \
+                                                                                                \
+    name##_node* node = malloc(sizeof(name##_node));                                            \
+    if (!node) {                                                                                \
+        pthread_mutex_unlock(mutex);                                                            \
+        return;                                                                                 \
+    }                                                                                           \
+    if (!KEY_COPY(node->key, key)) {                                                            \
+        free(node);                                                                             \
+        pthread_mutex_unlock(mutex);                                                            \
+        return;                                                                                 \
+    }                                                                                           \
+    if (!VAL_COPY(node->value, value)) {                                                        \
+        KEY_FREE(node->key);                                                                    \
+        free(node);                                                                             \
+        pthread_mutex_unlock(mutex);                                                            \
+        return;                                                                                 \
+    }                                                                                           \
+    node->hash = hash;                                                                          \
+    node->next = table->buckets[index];                                                         \
+    table->buckets[index] = node;                                                               \
+    size_t count = atomic_fetch_add(&table->count, 1) + 1;                                      \
+    pthread_mutex_unlock(mutex);                                                                \
+                                                                                                \
+    if ((float)count / (float)table->size > 0.7f) {                                             \
+        pthread_mutex_lock(&table->resize_mutex);                                               \
+        if ((float)atomic_load(&table->count) / (float)table->size > 0.7f) {                    \
+            name##_resize(table, ht_generic_next_prime(table->size * 2 + 1));                   \
+        }                                                                                       \
+        pthread_mutex_unlock(&table->resize_mutex);                                             \
+    }                                                                                           \
+}                                                                                               \
+                                                                                                \
+static inline int name##_get(name* table, key_t key, value_t* out) {                            \
+    if (!table) return 0;                                                                       \
+    uint64_t hash = HASH(key);                                                                  \
+    size_t index;                                                                               \
+    pthread_mutex_t* mutex = name##_lock(table, hash, &index);                                  \
+    int found = 0;                                                                              \
+    for (name##_node* current = table->buckets[index]; current; current = current->next) {      \
+        if (current->hash == hash && EQ(current->key, key)) {                                   \
+            found = VAL_COPY(*out, current->value) ? 1 : 0;                                     \
+            break;                                                                              \
+        }                                                                                       \
+    }                                                                                           \
+    pthread_mutex_unlock(mutex);                                                                \
+    return found;                                                                               \
+}                                                                                               \
+                                                                                                \
+static inline void name##_delete(name* table, key_t key) {                                      \
+    if (!table) return;                                                                         \
+    uint64_t hash = HASH(key);                                                                  \
+    size_t index;                                                                               \
+    pthread_mutex_t* mutex = name##_lock(table, hash, &index);                                  \
+    name##_node** link = &table->buckets[index];                                                \
+    while (*link) {                                                                             \
+        name##_node* current = *link;                                                           \
+        if (current->hash == hash && EQ(current->key, key)) {                                   \
+            *link = current->next;                                                              \
+            atomic_fetch_sub(&table->count, 1);                                                 \
+            pthread_mutex_unlock(mutex);                                                        \
+            KEY_FREE(current->key);                                                             \
+            VAL_FREE(current->value);                                                           \
+            free(current);                                                                      \
+            return;                                                                             \
+        }                                                                                       \
+        link = &current->next;                                                                  \
+    }                                                                                           \
+    pthread_mutex_unlock(mutex);                                                                \
+}                                                                                               \
+                                                                                                \
+static inline size_t name##_count(name* table) {                                                \
+    return table ? atomic_load(&table->count) : 0;                                              \
+}                                                                                               \
+                                                                                                \
+static inline void name##_destroy(name* table) {                                                \
+    if (!table) return;                                                                         \
+    for (size_t i = 0; i < table->size; i++) {                                                  \
+        name##_node* current = table->buckets[i];                                               \
+        while (current) {                                                                       \
+            name##_node* next_node = current->next;                                             \
+            KEY_FREE(current->key);                                                             \
+            VAL_FREE(current->value);                                                           \
+            free(current);                                                                      \
+            current = next_node;                                                                \
+        }                                                                                       \
+    }                                                                                           \
+    free(table->buckets);                                                                       \
+    for (int i = 0; i < HT_GENERIC_MUTEXES; i++) pthread_mutex_destroy(&table->mutexes[i]);     \
+    pthread_mutex_destroy(&table->resize_mutex);                                                \
+    free(table);                                                                                \
+}
+
+// uint64_t keys -> plain values
+#define HT_DEFINE_U64_TABLE(name, value_t) \
+    HT_DEFINE_TABLE(name, uint64_t, value_t, HT_U64_HASH, HT_U64_EQ, \
+                    HT_PLAIN_COPY, HT_PLAIN_FREE, HT_PLAIN_COPY, HT_PLAIN_FREE)
+
+// Byte-string keys (copied on insert, hash cached in the node) -> plain values
+#define HT_DEFINE_BYTES_TABLE(name, value_t) \
+    HT_DEFINE_TABLE(name, ht_bytes, value_t, HT_BYTES_HASH, HT_BYTES_EQ, \
+                    HT_BYTES_COPY, HT_BYTES_FREE, HT_PLAIN_COPY, HT_PLAIN_FREE)
+
+#endif // HASHTABLE_GENERIC_H
@@ -0,0 +1,330 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "hashtablescratch.h"
+#include "hashtablescratch_openaddr.h"
+
+// Hopscotch variant of the table: open addressing over one flat bucket array of 16-byte
+// buckets, with no per-entry allocation, run at 0.75-0.8 load (the chained table resizes at
+// 0.7 and pays a node per entry on top).
+//
+// - Every key has a home bucket and lives in one of the HOP_NEIGHBORHOOD buckets starting
+//   there. Each bucket keeps a bitmap of which neighbors hold entries homed at it, so a
+//   lookup reads one bitmap and only the buckets it points to.
+// - Insert takes the nearest free bucket (within HOP_ADD_RANGE) and, while it is too far
+//   from home, swaps it backwards with an entry that may legally move into it. When no
+//   move is possible the table doubles.
+// - Writers lock the segment of the key's home and the next one: everything an insert or
+//   delete touches lies in those two. Segments are HOP_SEGMENT_BUCKETS consecutive home
+//   buckets and the array has HOP_ADD_RANGE spare buckets at the end, so nothing wraps and
+//   segment locks are always taken in ascending order.
+// - ht_hop_get takes no lock. Each segment has a sequence number that writers make odd
+//   while they change entries homed in it; a reader that saw it change retries, and after
+//   HOP_READ_RETRIES tries reads under the lock.
+// - Growth builds a new array and publishes it with every old segment held (oa_grow). The old
+//   one is frozen from then on, so readers still inside it get a consistent (earlier) answer;
+//   it is freed in ht_hop_destroy, as nothing tracks when the last of those readers left.
+
+#define HOP_NEIGHBORHOOD 32         // H: bits in a bucket's neighborhood bitmap
+#define HOP_ADD_RANGE 512           // Buckets searched for a free one before growing
+#define HOP_SEGMENT_BUCKETS 1024    // Home buckets per lock (at least HOP_ADD_RANGE)
+#define HOP_READ_RETRIES 8          // Lock-free lookup attempts before taking the lock
+
+_Static_assert(HOP_ADD_RANGE <= HOP_SEGMENT_BUCKETS, "an insert must stay within two segments");
+
+typedef struct {
+    _Atomic uint32_t hop_info;  // Bit i: bucket home+i holds an entry whose home is this one
+    _Atomic uint32_t used;
+    _Atomic int key;
+    _Atomic int value;
+} HopBucket;
+
+typedef struct {
+    OaArrays base;              // Home buckets and their segments
+    HopBucket* buckets;         // HOP_ADD_RANGE buckets past the home ones
+} HopArrays;
+
+struct HopscotchTable {
+    OaTable base;
+};
+
+
+// ============================================================================================= //
+// =========================================== LAYOUT ========================================== //
+// ============================================================================================= //
+static void hop_arrays_free(OaArrays* base) {
+    if (!base) return;
+    HopArrays* arrays = (HopArrays*)base;
+    oa_segments_free(base);
+    free(arrays->buckets);
+    free(arrays);
+}
+
+static OaArrays* hop_arrays_create(size_t num_buckets) {
+    HopArrays* arrays = calloc(1, sizeof(HopArrays));
+    if (!arrays) return NULL;
+
+    if (!oa_segments_create(&arrays->base, num_buckets, HOP_SEGMENT_BUCKETS)) {
+        free(arrays);
+        return NULL;
+    }
+    arrays->buckets = calloc(arrays->base.num_buckets + HOP_ADD_RANGE, sizeof(HopBucket));
+    if (!arrays->buckets) {
+        hop_arrays_free(&arrays->base);
+        return NULL;
+    }
+    return &arrays->base;
+}
+
+static size_t hop_arrays_bytes(const OaArrays* arrays) {
+    return (arrays->num_buckets + HOP_ADD_RANGE) * sizeof(HopBucket);
+}
+
+static HopArrays* hop_current(HopscotchTable* table) {
+    return (HopArrays*)atomic_load_explicit(&table->base.arrays, memory_order_acquire);
+}
+
+
+// ============================================================================================= //
+// ========================================== LOCKING ========================================== //
+// ============================================================================================= //
+static void hop_unlock(HopArrays* arrays, size_t home) {
+    size_t s = home / HOP_SEGMENT_BUCKETS;
+    if (s + 1 < arrays->base.num_segments) pthread_mutex_unlock(&arrays->base.segments[s + 1].mutex);
+    pthread_mutex_unlock(&arrays->base.segments[s].mutex);
+}
+
+// Locks the two segments a write on key may touch, in the array that is current once they
+// are held (growth publishes a new one only while holding every segment of the old)
+static HopArrays* hop_lock(HopscotchTable* table, int key, size_t* home) {
+    for (;;) {
+        HopArrays* arrays = hop_current(table);
+        *home = oa_home(key, arrays->base.num_buckets);
+        size_t s = *home / HOP_SEGMENT_BUCKETS;
+        pthread_mutex_lock(&arrays->base.segments[s].mutex);
+        if (s + 1 < arrays->base.num_segments) pthread_mutex_lock(&arrays->base.segments[s + 1].mutex);
+        if (atomic_load_explicit(&table->base.arrays, memory_order_relaxed) == &arrays->base) return arrays;
+        hop_unlock(arrays, *home); // The table grew meanwhile
+    }
+}
+
+// Seqlock write side over the locked segments
+static void hop_write_begin(HopArrays* arrays, size_t home) {
+    size_t s = home / HOP_SEGMENT_BUCKETS;
+    size_t last = s + 1 < arrays->base.num_segments ? s + 1 : s;
+    for (size_t i = s; i <= last; i++) {
+        atomic_uint* seq = &arrays->base.segments[i].seq;
+        atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_release);
+}
+
+static void hop_write_end(HopArrays* arrays, size_t home) {
+    size_t s = home / HOP_SEGMENT_BUCKETS;
+    size_t last = s + 1 < arrays->base.num_segments ? s + 1 : s;
+    for (size_t i = s; i <= last; i++) {
+        atomic_uint* seq = &arrays->base.segments[i].seq;
+        atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) + 1, memory_order_release);
+    }
+}
+
+// ============================================================================================= //
+// ========================================= PLACEMENT ========================================= //
+// ============================================================================================= //
+// Caller holds the key's segments (or owns the arrays outright)
+static HopBucket* hop_find(HopArrays* arrays, size_t home, int key) {
+    uint32_t hop = atomic_load_explicit(&arrays->buckets[home].hop_info, memory_order_relaxed);
+    while (hop) {
+        HopBucket* bucket = &arrays->buckets[home + (size_t)__builtin_ctz(hop)];
+        if (atomic_load_explicit(&bucket->key, memory_order_relaxed) == key) return bucket;
+        hop &= hop - 1;
+    }
+    return NULL;
+}
+
+// Moves an entry from before *free into it, so the free bucket gets closer to the home
+// being inserted into. The moved entry stays within its own neighborhood.
+static bool hop_move_closer(HopArrays* arrays, size_t* free) {
+    HopBucket* buckets = arrays->buckets;
+    for (size_t owner = *free - (HOP_NEIGHBORHOOD - 1); owner < *free; owner++) {
+        uint32_t hop = atomic_load_explicit(&buckets[owner].hop_info, memory_order_relaxed);
+        if (!hop) continue;
+        size_t from = owner + (size_t)__builtin_ctz(hop); // Earliest entry homed at owner
+        if (from >= *free) continue;
+
+        HopBucket* src = &buckets[from];
+        HopBucket* dst = &buckets[*free];
+        atomic_store_explicit(&dst->key, atomic_load_explicit(&src->key, memory_order_relaxed), memory_order_relaxed);
+        atomic_store_explicit(&dst->value, atomic_load_explicit(&src->value, memory_order_relaxed), memory_order_relaxed);
+        atomic_store_explicit(&dst->used, 1, memory_order_relaxed);
+        hop = (hop | 1u << (*free - owner)) & ~(1u << (from - owner));
+        atomic_store_explicit(&buckets[owner].hop_info, hop, memory_order_relaxed);
+        atomic_store_explicit(&src->used, 0, memory_order_relaxed);
+        *free = from;
+        return true;
+    }
+    return false;
+}
+
+// Places a key known to be absent. Returns false if the neighborhood cannot take it.
+static bool hop_place(HopArrays* arrays, size_t home, int key, int value) {
+    HopBucket* buckets = arrays->buckets;
+    size_t end = home + HOP_ADD_RANGE;
+    size_t free = home;
+    while (free < end && atomic_load_explicit(&buckets[free].used, memory_order_relaxed)) free++;
+    if (free == end) return false;
+
+    while (free - home >= HOP_NEIGHBORHOOD) {
+        if (!hop_move_closer(arrays, &free)) return false;
+    }
+
+    atomic_store_explicit(&buckets[free].key, key, memory_order_relaxed);
+    atomic_store_explicit(&buckets[free].value, value, memory_order_relaxed);
+    atomic_store_explicit(&buckets[free].used, 1, memory_order_relaxed);
+    uint32_t hop = atomic_load_explicit(&buckets[home].hop_info, memory_order_relaxed);
+    atomic_store_explicit(&buckets[home].hop_info, hop | 1u << (free - home), memory_order_relaxed);
+    oa_counter_add(&arrays->base.segments[home / HOP_SEGMENT_BUCKETS].count, 1);
+    return true;
+}
+
+// Moves every entry of old into grown. Returns false if some neighborhood overflowed.
+static bool hop_rehash(OaArrays* grown_base, OaArrays* old_base) {
+    HopArrays* grown = (HopArrays*)grown_base;
+    HopArrays* old = (HopArrays*)old_base;
+    for (size_t i = 0; i < old->base.num_buckets + HOP_ADD_RANGE; i++) {
+        HopBucket* bucket = &old->buckets[i];
+        if (!atomic_load_explicit(&bucket->used, memory_order_relaxed)) continue;
+        int key = atomic_load_explicit(&bucket->key, memory_order_relaxed);
+        int value = atomic_load_explicit(&bucket->value, memory_order_relaxed);
+        if (!hop_place(grown, oa_home(key, grown->base.num_buckets), key, value)) return false;
+    }
+    return true;
+}
+
+static const OaLayout hop_layout = { hop_arrays_create, hop_arrays_free, hop_rehash, hop_arrays_bytes };
+
+
+// ============================================================================================= //
+// ======================================= CREATE / DESTROY ==================================== //
+// ============================================================================================= //
+// Sized to hold `capacity` entries at 0.75 load. Past about 0.8 some neighborhood usually
+// overflows and the table doubles. Returns NULL on failure.
+HopscotchTable* ht_hop_create(size_t capacity) {
+    HopscotchTable* table = malloc(sizeof(HopscotchTable));
+    if (!table) return NULL;
+
+    OaArrays* arrays = hop_arrays_create(capacity + capacity / 3);
+    if (!arrays) {
+        free(table);
+        return NULL;
+    }
+    oa_table_init(&table->base, arrays);
+    return table;
+}
+
+void ht_hop_destroy(HopscotchTable* table) {
+    if (!table) return;
+    oa_table_destroy(&table->base, &hop_layout);
+    free(table);
+}
+
+
+// ============================================================================================= //
+// ========================================= OPERATIONS ======================================== //
+// ============================================================================================= //
+// Returns 1 on success, 0 if the table could not grow
+int ht_hop_insert(HopscotchTable* table, int key, int value) {
+    if (!table) return 0;
+
+    for (;;) {
+        size_t home;
+        HopArrays* arrays = hop_lock(table, key, &home);
+        HopBucket* bucket = hop_find(arrays, home, key);
+        if (bucket) { // A single store: readers see the old or the new value
+            atomic_store_explicit(&bucket->value, value, memory_order_relaxed);
+            hop_unlock(arrays, home);
+            return 1;
+        }
+
+        hop_write_begin(arrays, home);
+        bool placed = hop_place(arrays, home, key, value);
+        hop_write_end(arrays, home);
+        hop_unlock(arrays, home);
+        if (placed) return 1;
+        if (!oa_grow(&table->base, &arrays->base, &hop_layout)) return 0;
+    }
+}
+
+// 1 = found, 0 = not found. Lock-free unless writers keep changing the key's segment.
+int ht_hop_get(HopscotchTable* table, int key_to_seek, int* seeked_value) {
+    if (!table) return 0;
+
+    for (int attempt = 0; attempt < HOP_READ_RETRIES; attempt++) {
+        HopArrays* arrays = hop_current(table);
+        size_t home = oa_home(key_to_seek, arrays->base.num_buckets);
+        atomic_uint* seq = &arrays->base.segments[home / HOP_SEGMENT_BUCKETS].seq;
+        unsigned before = atomic_load_explicit(seq, memory_order_acquire);
+        if (before & 1) continue; // Writer inside
+
+        bool found = false;
+        int value = 0;
+        uint32_t hop = atomic_load_explicit(&arrays->buckets[home].hop_info, memory_order_relaxed);
+        while (hop) {
+            HopBucket* bucket = &arrays->buckets[home + (size_t)__builtin_ctz(hop)];
+            if (atomic_load_explicit(&bucket->key, memory_order_relaxed) == key_to_seek) {
+                value = atomic_load_explicit(&bucket->value, memory_order_relaxed);
+                found = true;
+                break;
+            }
+            hop &= hop - 1;
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(seq, memory_order_relaxed) != before) continue;
+        if (found) *seeked_value = value;
+        return found ? 1 : 0;
+    }
+
+    // Writers kept overlapping: read under the lock
+    size_t home;
+    HopArrays* arrays = hop_lock(table, key_to_seek, &home);
+    HopBucket* bucket = hop_find(arrays, home, key_to_seek);
+    if (bucket) *seeked_value = atomic_load_explicit(&bucket->value, memory_order_relaxed);
+    hop_unlock(arrays, home);
+    return bucket ? 1 : 0;
+}
+
+void ht_hop_delete(HopscotchTable* table, int key) {
+    if (!table) return;
+
+    size_t home;
+    HopArrays* arrays = hop_lock(table, key, &home);
+    HopBucket* bucket = hop_find(arrays, home, key);
+    if (bucket) {
+        hop_write_begin(arrays, home);
+        uint32_t hop = atomic_load_explicit(&arrays->buckets[home].hop_info, memory_order_relaxed);
+        atomic_store_explicit(&arrays->buckets[home].hop_info, hop & ~(1u << (bucket - &arrays->buckets[home])),
+                              memory_order_relaxed);
+        atomic_store_explicit(&bucket->used, 0, memory_order_relaxed);
+        oa_counter_add(&arrays->base.segments[home / HOP_SEGMENT_BUCKETS].count, -1);
+        hop_write_end(arrays, home);
+    }
+    hop_unlock(arrays, home);
+}
+
+size_t ht_hop_count(HopscotchTable* table) {
+    return table ? oa_table_count(&table->base) : 0;
+}
+
+// Bytes held by the current array, the arrays retired by growth and their segment locks
+size_t ht_hop_memory(HopscotchTable* table) {
+    return table ? oa_table_memory(&table->base, sizeof(HopscotchTable), sizeof(HopArrays), &hop_layout) : 0;
+}
+
+// Entries over home buckets
+double ht_hop_load_factor(HopscotchTable* table) {
+    return table ? oa_table_load_factor(&table->base) : 0.0;
+}
@@ -1,4 +1,5 @@
 #include "hashtablescratch.h"
+#include "hashtablescratch_generic.h"
 #include <pthread.h>
 #include <stdio.h>
 #include <time.h>
@@ -13,6 +14,90 @@ typedef struct {
     int thread_id;       // Thread identifier (0 to NUM_THREADS-1)
 } thread_arg_t;
 
+#define GENERIC_THREADS 4
+#define GENERIC_KEYS_PER_THREAD 20000
+
+// Type-specialized tables built from hashtablescratch_generic.h, checked after the main test
+HT_DEFINE_BYTES_TABLE(StrTable, int)
+HT_DEFINE_U64_TABLE(U64Table, uint64_t)
+HT_DEFINE_TABLE(BlobTable, ht_bytes, ht_blob, HT_BYTES_HASH, HT_BYTES_EQ,
+                HT_BYTES_COPY, HT_BYTES_FREE, HT_BLOB_COPY, HT_BLOB_FREE)
+
+typedef struct {
+    StrTable* table;
+    int thread_id;
+} generic_arg_t;
+
+// Each thread inserts its own block of string keys, then deletes every other one
+static void* thread_generic(void* arg) {
+    generic_arg_t* data = (generic_arg_t*)arg;
+    char key[32];
+    for (int i = 0; i < GENERIC_KEYS_PER_THREAD; i++) {
+        snprintf(key, sizeof(key), "key-%d-%d", data->thread_id, i);
+        StrTable_insert(data->table, ht_bytes_of(key), i);
+    }
+    for (int i = 0; i < GENERIC_KEYS_PER_THREAD; i += 2) {
+        snprintf(key, sizeof(key), "key-%d-%d", data->thread_id, i);
+        StrTable_delete(data->table, ht_bytes_of(key));
+    }
+    return NULL;
+}
+
+// Returns 1 if the string-keyed, u64-keyed and blob-valued tables all behave
+static int generic_tables_test(void) {
+    int ok = 1;
+
+    StrTable* strings = StrTable_create(19);
+    if (!strings) return 0;
+    pthread_t threads[GENERIC_THREADS];
+    generic_arg_t args[GENERIC_THREADS];
+    for (int i = 0; i < GENERIC_THREADS; i++) {
+        args[i].table = strings;
+        args[i].thread_id = i;
+        pthread_create(&threads[i], NULL, thread_generic, &args[i]);
+    }
+    for (int i = 0; i < GENERIC_THREADS; i++) pthread_join(threads[i], NULL);
+
+    ok &= StrTable_count(strings) == GENERIC_THREADS * GENERIC_KEYS_PER_THREAD / 2;
+    char key[32];
+    for (int t = 0; t < GENERIC_THREADS; t++) {
+        for (int i = 0; i < GENERIC_KEYS_PER_THREAD; i++) {
+            snprintf(key, sizeof(key), "key-%d-%d", t, i);
+            int value = -1;
+            int found = StrTable_get(strings, ht_bytes_of(key), &value);
+            ok &= (i % 2 == 0) ? !found : (found && value == i);
+        }
+    }
+    StrTable_insert(strings, ht_bytes_of("key-0-1"), 7); // Overwrite keeps the count
+    int value = 0;
+    ok &= StrTable_get(strings, ht_bytes_of("key-0-1"), &value) && value == 7;
+    ok &= StrTable_count(strings) == GENERIC_THREADS * GENERIC_KEYS_PER_THREAD / 2;
+    StrTable_destroy(strings);
+
+    U64Table* numbers = U64Table_create(0);
+    if (!numbers) return 0;
+    for (uint64_t i = 0; i < 100000; i++) U64Table_insert(numbers, i << 32, i);
+    uint64_t number = 0;
+    ok &= U64Table_count(numbers) == 100000;
+    ok &= U64Table_get(numbers, 4242ULL << 32, &number) && number == 4242;
+    ok &= !U64Table_get(numbers, 4242, &number);
+    U64Table_destroy(numbers);
+
+    BlobTable* blobs = BlobTable_create(0);
+    if (!blobs) return 0;
+    BlobTable_insert(blobs, ht_bytes_of("greeting"), ht_bytes_of("hello"));
+    BlobTable_insert(blobs, ht_bytes_of("greeting"), ht_bytes_of("hello, world"));
+    ht_blob blob = { NULL, 0 };
+    ok &= BlobTable_get(blobs, ht_bytes_of("greeting"), &blob) && blob.len == 12 &&
+          memcmp(blob.data, "hello, world", 12) == 0;
+    free((void*)blob.data);
+    BlobTable_delete(blobs, ht_bytes_of("greeting"));
+    ok &= BlobTable_count(blobs) == 0;
+    BlobTable_destroy(blobs);
+
+    return ok;
+}
+
 // Function executed by each thread
 void* thread_insert(void* arg) {
     thread_arg_t* data = (thread_arg_t*)arg;
@@ -72,6 +157,22 @@ int main(void) {
     printf("Total time: %.3f seconds\n", time_taken);
     printf("Insertions per second: %.0f\n", (double)(NUM_THREADS * ELEMENTS_PER_THREAD) / time_taken);
 
+    // Shape of the final table
+    HtStats stats;
+    if (ht_stats(ht, &stats)) {
+        uint64_t acquisitions = 0, contended = 0;
+        for (int i = 0; i < NUM_MUTEXES; i++) {
+            acquisitions += stats.stripe_acquisitions[i];
+            contended += stats.stripe_contended[i];
+        }
+        printf("Longest chain: %zu, empty buckets: %.1f%%, nodes per used bucket: %.2f\n",
+               stats.max_chain, stats.empty_ratio * 100.0, stats.mean_chain);
+        printf("Resizes: %zu (%.1f ms in resize steps)\n", stats.resizes, stats.resize_ms);
+        printf("Stripe locks: %llu, waited: %llu (%.2f%%)\n", (unsigned long long)acquisitions,
+               (unsigned long long)contended, acquisitions ? 100.0 * contended / acquisitions : 0.0);
+        printf("Memory: %zu MB buckets, %zu MB nodes\n", stats.bucket_bytes >> 20, stats.node_bytes >> 20);
+    }
+
     if (ht->count == NUM_THREADS * ELEMENTS_PER_THREAD) {
         printf("\n¡ABSOLUTE SUCCESS! Fine-grained thread-safety works perfectly.\n");
         printf("¡Your hash table is a MULTI-THREAD BEAST! 🦁🔥\n");
@@ -82,5 +183,8 @@ int main(void) {
     // Clean up
     ht_destroy(ht);
 
-    return 0;
+    int generic_ok = generic_tables_test();
+    printf("Generic tables (string, u64 and blob): %s\n", generic_ok ? "OK" : "FAILED");
+
+    return generic_ok ? 0 : 1;
 }
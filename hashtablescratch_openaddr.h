@@ -0,0 +1,177 @@
+#ifndef HASHTABLE_OPENADDR_H
+#define HASHTABLE_OPENADDR_H
+
+// Shared internals of the open-addressing tables (hashtablescratch_hopscotch.c and
+// hashtablescratch_robinhood.c). Both keep their buckets in flat arrays split into locked
+// segments, and grow by building new arrays with every old segment held. What differs is only
+// the bucket layout, so each table embeds OaArrays at the start of its own arrays struct and
+// hands the layout-specific steps to oa_grow / oa_table_* through an OaLayout.
+//
+// - Homes: a 64-bit mix of the key scaled to the bucket count (no division).
+// - Segments: a mutex, a sequence number (odd while a writer changes the segment) and the
+//   number of entries homed there, one cache line each.
+// - Growth: arrays replaced by growth are frozen, since lock-free readers may still be
+//   inside them, and kept on the table's retired list until it is destroyed. They still
+//   count towards its memory.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+typedef struct {
+    pthread_mutex_t mutex;
+    atomic_uint seq;            // Odd while a writer changes the segment
+    atomic_size_t count;        // Entries homed here, written under mutex
+} __attribute__((aligned(64))) OaSegment;
+
+typedef struct OaArrays {
+    size_t num_buckets;         // Home buckets (a whole number of segments)
+    size_t num_segments;
+    OaSegment* segments;
+    struct OaArrays* retired_next;
+} OaArrays;
+
+typedef struct {
+    _Atomic(OaArrays*) arrays;
+    pthread_mutex_t resize_mutex;
+    OaArrays* retired;          // Replaced by growth, freed in oa_table_destroy
+} OaTable;
+
+// What oa_grow and oa_table_* need to know about a table's bucket layout
+typedef struct {
+    OaArrays* (*create)(size_t num_buckets);
+    void (*free)(OaArrays* arrays);
+    bool (*rehash)(OaArrays* grown, OaArrays* old);     // false: some entry did not fit
+    size_t (*bytes)(const OaArrays* arrays);            // Bucket storage, segments excluded
+} OaLayout;
+
+
+// ============================================================================================= //
+// =========================================== LAYOUT ========================================== //
+// ============================================================================================= //
+static inline uint64_t oa_mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+// Open addressing needs scattered homes even for sequential keys
+static inline size_t oa_home(int key, size_t num_buckets) {
+    return (size_t)(((unsigned __int128)oa_mix((uint64_t)(uint32_t)key) * num_buckets) >> 64);
+}
+
+// Rounds num_buckets up to whole segments and allocates their locks. Returns false on failure.
+static inline bool oa_segments_create(OaArrays* arrays, size_t num_buckets, size_t segment_buckets) {
+    arrays->num_segments = (num_buckets + segment_buckets - 1) / segment_buckets;
+    if (arrays->num_segments == 0) arrays->num_segments = 1;
+    arrays->num_buckets = arrays->num_segments * segment_buckets;
+    arrays->segments = aligned_alloc(64, arrays->num_segments * sizeof(OaSegment));
+    if (!arrays->segments) return false;
+    for (size_t s = 0; s < arrays->num_segments; s++) {
+        pthread_mutex_init(&arrays->segments[s].mutex, NULL);
+        atomic_init(&arrays->segments[s].seq, 0);
+        atomic_init(&arrays->segments[s].count, 0);
+    }
+    return true;
+}
+
+static inline void oa_segments_free(OaArrays* arrays) {
+    if (!arrays->segments) return;
+    for (size_t s = 0; s < arrays->num_segments; s++) pthread_mutex_destroy(&arrays->segments[s].mutex);
+    free(arrays->segments);
+}
+
+// Only the segment's lock holder writes it; readers just sum
+static inline void oa_counter_add(atomic_size_t* counter, long delta) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + (size_t)delta,
+                          memory_order_relaxed);
+}
+
+
+// ============================================================================================= //
+// ============================================ TABLE ========================================== //
+// ============================================================================================= //
+static inline void oa_table_init(OaTable* table, OaArrays* arrays) {
+    atomic_init(&table->arrays, arrays);
+    pthread_mutex_init(&table->resize_mutex, NULL);
+    table->retired = NULL;
+}
+
+static inline void oa_table_destroy(OaTable* table, const OaLayout* layout) {
+    layout->free(atomic_load(&table->arrays));
+    while (table->retired) {
+        OaArrays* next = table->retired->retired_next;
+        layout->free(table->retired);
+        table->retired = next;
+    }
+    pthread_mutex_destroy(&table->resize_mutex);
+}
+
+// Doubles the table unless another thread already replaced `seen`. A rehash that overflows
+// some neighborhood or probe limit just tries the next size up. Returns false if memory ran out.
+static inline bool oa_grow(OaTable* table, OaArrays* seen, const OaLayout* layout) {
+    pthread_mutex_lock(&table->resize_mutex);
+    OaArrays* old = atomic_load_explicit(&table->arrays, memory_order_relaxed);
+    if (old != seen) {
+        pthread_mutex_unlock(&table->resize_mutex);
+        return true;
+    }
+    for (size_t s = 0; s < old->num_segments; s++) pthread_mutex_lock(&old->segments[s].mutex);
+
+    OaArrays* grown = NULL;
+    for (size_t num_buckets = old->num_buckets * 2; !grown; num_buckets *= 2) {
+        grown = layout->create(num_buckets);
+        if (!grown) break;
+        if (!layout->rehash(grown, old)) {
+            layout->free(grown);
+            grown = NULL;
+        }
+    }
+
+    if (grown) {
+        atomic_store_explicit(&table->arrays, grown, memory_order_release);
+        old->retired_next = table->retired;
+        table->retired = old;
+    }
+    for (size_t s = old->num_segments; s-- > 0;) pthread_mutex_unlock(&old->segments[s].mutex);
+    pthread_mutex_unlock(&table->resize_mutex);
+    return grown != NULL;
+}
+
+static inline size_t oa_table_count(OaTable* table) {
+    OaArrays* arrays = atomic_load_explicit(&table->arrays, memory_order_acquire);
+    size_t count = 0;
+    for (size_t s = 0; s < arrays->num_segments; s++) {
+        count += atomic_load_explicit(&arrays->segments[s].count, memory_order_relaxed);
+    }
+    return count;
+}
+
+static inline size_t oa_arrays_memory(const OaArrays* arrays, size_t struct_bytes, const OaLayout* layout) {
+    return struct_bytes + layout->bytes(arrays) + arrays->num_segments * sizeof(OaSegment);
+}
+
+// Bytes held by the current arrays and every retired one; table_bytes and arrays_bytes are
+// the sizes of the table's and arrays' own structs
+static inline size_t oa_table_memory(OaTable* table, size_t table_bytes, size_t arrays_bytes, const OaLayout* layout) {
+    pthread_mutex_lock(&table->resize_mutex); // Growth links the retired list under it
+    size_t bytes = table_bytes + oa_arrays_memory(atomic_load(&table->arrays), arrays_bytes, layout);
+    for (const OaArrays* old = table->retired; old; old = old->retired_next) {
+        bytes += oa_arrays_memory(old, arrays_bytes, layout);
+    }
+    pthread_mutex_unlock(&table->resize_mutex);
+    return bytes;
+}
+
+// Entries over home buckets
+static inline double oa_table_load_factor(OaTable* table) {
+    OaArrays* arrays = atomic_load_explicit(&table->arrays, memory_order_acquire);
+    return (double)oa_table_count(table) / (double)arrays->num_buckets;
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef HASHTABLE_PROTO_H
+#define HASHTABLE_PROTO_H
+
+// Binary protocol spoken by hashtablescratch_server and hashtablescratch_client.
+//
+// Every request is a fixed 12-byte frame and every response an 8-byte frame, both in host
+// byte order (the server only listens on a Unix socket or loopback). Clients may pipeline:
+// send any number of frames without waiting, responses come back in the same order.
+//
+// A batch is a BATCH frame whose value is the number n of GET/SET/DELETE frames that follow
+// it. The server answers with a BATCH response (value = n) followed by n responses.
+
+#include <stdint.h>
+
+#define HT_PROTO_DEFAULT_PORT 7379
+#define HT_PROTO_MAX_BATCH 4096
+
+enum {
+    HT_OP_GET = 1,
+    HT_OP_SET = 2,
+    HT_OP_DELETE = 3,
+    HT_OP_BATCH = 4
+};
+
+enum {
+    HT_STATUS_OK = 0,
+    HT_STATUS_NOT_FOUND = 1,
+    HT_STATUS_BAD_REQUEST = 2
+};
+
+typedef struct {
+    uint32_t op;
+    int32_t key;
+    int32_t value;  // SET: value to store, BATCH: number of frames that follow
+} HtRequest;
+
+typedef struct {
+    uint32_t status;
+    int32_t value;  // GET: value found, BATCH: number of responses that follow
+} HtResponse;
+
+#endif // HASHTABLE_PROTO_H
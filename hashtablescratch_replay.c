@@ -0,0 +1,283 @@
+// Replays an operation trace (recorded by a build with -DHT_TRACE) against a table.
+//
+// Every thread of the trace gets its own replay thread, which applies that thread's operations
+// in their recorded order. In interleaved mode (default) each operation waits until its recorded
+// time after the start, so threads overlap as they did in production; the lag column shows how
+// far behind schedule operations started. In max mode every thread runs flat out. Reports
+// throughput and per-operation latency percentiles.
+//
+// Usage: ./hashtablescratch_replay [-m interleaved|max] [-b chained|hopscotch|robinhood]
+//                                  [-s initial_size] [-f filter_bits] [-c] [-C] [-g] [-M mem_flags]
+//                                  trace_file
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "hashtablescratch.h"
+
+#define REPLAY_SPIN_NS 50000    // Closer than this to an operation's time, yield instead of sleeping
+
+typedef enum {
+    BACKEND_CHAINED,
+    BACKEND_HOPSCOTCH,
+    BACKEND_ROBINHOOD
+} BackendKind;
+
+typedef struct {
+    BackendKind backend;
+    bool interleaved;
+    size_t initial_size;    // Buckets (chained) or capacity (open addressing)
+    unsigned filter_bits;   // 0 = no negative filter
+    bool read_cache;
+    bool flat_combining;
+    bool background_resize;
+    unsigned mem_flags;
+} Config;
+
+typedef struct {
+    pthread_t thread;
+    const Config* config;
+    void* table;
+    const HtTraceRecord* records;    // This thread's operations, in time order
+    size_t count;
+    uint32_t* latencies;    // Per operation, ns (saturating)
+    uint32_t* lags;         // Start behind schedule, ns (interleaved only)
+    long start_ns;          // Shared replay start
+    long hits;
+} ReplayThread;
+
+static long now_nanoseconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static uint32_t saturate(long ns) {
+    return ns < 0 ? 0 : ns > (long)UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+}
+
+static int apply(const Config* config, void* table, HtTraceOp op, int key, int value) {
+    int out;
+    switch (config->backend) {
+        case BACKEND_HOPSCOTCH:
+            if (op == HT_TRACE_INSERT) return ht_hop_insert(table, key, value), 0;
+            if (op == HT_TRACE_GET) return ht_hop_get(table, key, &out);
+            ht_hop_delete(table, key);
+            return 0;
+        case BACKEND_ROBINHOOD:
+            if (op == HT_TRACE_INSERT) return ht_rh_insert(table, key, value), 0;
+            if (op == HT_TRACE_GET) return ht_rh_get(table, key, &out);
+            ht_rh_delete(table, key);
+            return 0;
+        default:
+            if (op == HT_TRACE_INSERT) ht_insert(table, key, value);
+            else if (op == HT_TRACE_GET) return ht_get(table, key, &out);
+            else ht_delete(table, key);
+            return 0;
+    }
+}
+
+// Sleeps until shortly before `due`, then yields until it arrives. Returns the time it woke.
+static long wait_until(long due) {
+    long now = now_nanoseconds();
+    while (now < due) {
+        if (due - now > REPLAY_SPIN_NS) {
+            long ns = due - now - REPLAY_SPIN_NS / 2;
+            struct timespec ts = { ns / 1000000000L, ns % 1000000000L };
+            nanosleep(&ts, NULL);
+        } else {
+            sched_yield();
+        }
+        now = now_nanoseconds();
+    }
+    return now;
+}
+
+static void* replay_main(void* arg) {
+    ReplayThread* self = arg;
+    for (size_t i = 0; i < self->count; i++) {
+        const HtTraceRecord* record = &self->records[i];
+        HtTraceOp op = (HtTraceOp)(record->stamp & HT_TRACE_OP_MASK);
+        long begin;
+        if (self->config->interleaved) {
+            long due = self->start_ns + (long)(record->stamp >> HT_TRACE_TIME_SHIFT);
+            begin = wait_until(due);
+            self->lags[i] = saturate(begin - due);
+        } else {
+            begin = now_nanoseconds();
+        }
+        self->hits += apply(self->config, self->table, op, record->key, record->value);
+        self->latencies[i] = saturate(now_nanoseconds() - begin);
+    }
+    return NULL;
+}
+
+static int compare_u32(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void print_percentiles(const char* label, uint32_t* samples, size_t n) {
+    if (n == 0) return;
+    qsort(samples, n, sizeof(uint32_t), compare_u32);
+    printf("%-8s %12zu %10u %10u %10u %10u\n", label, n, samples[n / 2], samples[n * 99 / 100],
+           samples[n * 999 / 1000], samples[n - 1]);
+}
+
+static void* create_table(const Config* config, size_t max_entries) {
+    if (config->backend == BACKEND_HOPSCOTCH) {
+        return ht_hop_create(config->initial_size ? config->initial_size : max_entries);
+    }
+    if (config->backend == BACKEND_ROBINHOOD) {
+        return ht_rh_create(config->initial_size ? config->initial_size : max_entries);
+    }
+
+    HashTable* table = create_hashtable(config->initial_size ? config->initial_size : INITIAL_TABLE_SIZE);
+    if (!table) return NULL;
+    if ((config->mem_flags && !ht_set_memory_policy(table, config->mem_flags)) ||
+        (config->filter_bits && !ht_enable_filter(table, config->filter_bits)) ||
+        (config->flat_combining && !ht_set_exec_mode(table, HT_EXEC_FLAT_COMBINING)) ||
+        (config->background_resize && !ht_enable_background_resize(table, 0.7f, 2.0f))) {
+        ht_destroy(table);
+        return NULL;
+    }
+    if (config->read_cache) ht_enable_read_cache(table, true);
+    return table;
+}
+
+static void destroy_table(const Config* config, void* table) {
+    if (config->backend == BACKEND_HOPSCOTCH) ht_hop_destroy(table);
+    else if (config->backend == BACKEND_ROBINHOOD) ht_rh_destroy(table);
+    else ht_destroy(table);
+}
+
+static int usage(const char* program) {
+    fprintf(stderr, "Usage: %s [-m interleaved|max] [-b chained|hopscotch|robinhood]\n"
+                    "          [-s initial_size] [-f filter_bits] [-c] [-C] [-g] [-M mem_flags] trace_file\n",
+            program);
+    return 1;
+}
+
+int main(int argc, char** argv) {
+    Config config = { BACKEND_CHAINED, true, 0, 0, false, false, false, 0 };
+    static const char* backend_names[] = { "chained", "hopscotch", "robinhood" };
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:b:s:f:cCgM:")) != -1) {
+        switch (opt) {
+            case 'm':
+                if (strcmp(optarg, "interleaved") == 0) config.interleaved = true;
+                else if (strcmp(optarg, "max") == 0) config.interleaved = false;
+                else return usage(argv[0]);
+                break;
+            case 'b':
+                if (strcmp(optarg, "chained") == 0) config.backend = BACKEND_CHAINED;
+                else if (strcmp(optarg, "hopscotch") == 0) config.backend = BACKEND_HOPSCOTCH;
+                else if (strcmp(optarg, "robinhood") == 0) config.backend = BACKEND_ROBINHOOD;
+                else return usage(argv[0]);
+                break;
+            case 's': config.initial_size = strtoul(optarg, NULL, 10); break;
+            case 'f': config.filter_bits = (unsigned)atoi(optarg); break;
+            case 'c': config.read_cache = true; break;
+            case 'C': config.flat_combining = true; break;
+            case 'g': config.background_resize = true; break;
+            case 'M': config.mem_flags = (unsigned)strtoul(optarg, NULL, 0); break;
+            default: return usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1) return usage(argv[0]);
+
+    size_t count;
+    HtTraceRecord* records = ht_trace_load(argv[optind], &count);
+    if (!records) {
+        fprintf(stderr, "Cannot read trace %s\n", argv[optind]);
+        return 1;
+    }
+
+    // Split the trace by thread; a stable pass keeps each thread's operations in time order
+    unsigned num_threads = 0;
+    for (size_t i = 0; i < count; i++) {
+        unsigned thread = (unsigned)(records[i].stamp >> HT_TRACE_THREAD_SHIFT) & HT_TRACE_THREAD_MASK;
+        if (thread + 1 > num_threads) num_threads = thread + 1;
+    }
+    if (num_threads == 0) num_threads = 1;
+    size_t* offsets = calloc(num_threads + 1, sizeof(size_t));
+    HtTraceRecord* by_thread = malloc((count ? count : 1) * sizeof(HtTraceRecord));
+    ReplayThread* threads = calloc(num_threads, sizeof(ReplayThread));
+    uint32_t* latencies = malloc((count ? count : 1) * sizeof(uint32_t));
+    uint32_t* lags = config.interleaved ? malloc((count ? count : 1) * sizeof(uint32_t)) : NULL;
+    size_t inserts = 0; // Bounds the live keys, which sizes the open-addressing tables
+    for (size_t i = 0; i < count; i++) inserts += (records[i].stamp & HT_TRACE_OP_MASK) == HT_TRACE_INSERT;
+    void* table = create_table(&config, inserts ? inserts : 1);
+    if (!offsets || !by_thread || !threads || !latencies || (config.interleaved && !lags) || !table) {
+        fprintf(stderr, "Out of memory or unsupported table configuration\n");
+        return 1;
+    }
+    for (size_t i = 0; i < count; i++) offsets[((records[i].stamp >> HT_TRACE_THREAD_SHIFT) & HT_TRACE_THREAD_MASK) + 1]++;
+    for (unsigned t = 0; t < num_threads; t++) offsets[t + 1] += offsets[t];
+    for (unsigned t = 0; t < num_threads; t++) {
+        threads[t] = (ReplayThread){ .config = &config, .table = table, .records = by_thread + offsets[t],
+                                     .latencies = latencies + offsets[t], .lags = lags ? lags + offsets[t] : NULL };
+    }
+    for (size_t i = 0; i < count; i++) {
+        ReplayThread* owner = &threads[(records[i].stamp >> HT_TRACE_THREAD_SHIFT) & HT_TRACE_THREAD_MASK];
+        by_thread[owner->records - by_thread + owner->count++] = records[i];
+    }
+    free(records);
+
+    long start = now_nanoseconds();
+    for (unsigned t = 0; t < num_threads; t++) {
+        threads[t].start_ns = start;
+        pthread_create(&threads[t].thread, NULL, replay_main, &threads[t]);
+    }
+    long hits = 0;
+    for (unsigned t = 0; t < num_threads; t++) {
+        pthread_join(threads[t].thread, NULL);
+        hits += threads[t].hits;
+    }
+    double elapsed = (now_nanoseconds() - start) / 1e9;
+
+    // Regroup the latencies by operation type
+    size_t per_op[3] = {0};
+    for (size_t i = 0; i < count; i++) per_op[by_thread[i].stamp & HT_TRACE_OP_MASK]++;
+    uint32_t* grouped = malloc((count ? count : 1) * sizeof(uint32_t));
+    size_t fill[3] = { 0, per_op[0], per_op[0] + per_op[1] };
+    for (size_t i = 0; grouped && i < count; i++) grouped[fill[by_thread[i].stamp & HT_TRACE_OP_MASK]++] = latencies[i];
+
+    double traced = count ? (double)(by_thread[0].stamp >> HT_TRACE_TIME_SHIFT) : 0;
+    for (size_t i = 0; i < count; i++) {
+        double t = (double)(by_thread[i].stamp >> HT_TRACE_TIME_SHIFT);
+        if (t > traced) traced = t;
+    }
+
+    printf("=== TRACE REPLAY RESULTS ===\n");
+    printf("Table: %s, mode: %s, threads: %u\n", backend_names[config.backend],
+           config.interleaved ? "interleaved" : "max", num_threads);
+    printf("Operations: %zu in %.3f seconds (traced span %.3f seconds)\n", count, elapsed, traced / 1e9);
+    printf("Operations per second: %.0f\n", elapsed > 0 ? count / elapsed : 0.0);
+    printf("Gets found: %ld of %zu\n\n", hits, per_op[HT_TRACE_GET]);
+    printf("%-8s %12s %10s %10s %10s %10s\n", "Op", "Count", "p50 ns", "p99 ns", "p99.9 ns", "max ns");
+    if (grouped) {
+        print_percentiles("insert", grouped, per_op[HT_TRACE_INSERT]);
+        print_percentiles("get", grouped + per_op[0], per_op[HT_TRACE_GET]);
+        print_percentiles("delete", grouped + per_op[0] + per_op[1], per_op[HT_TRACE_DELETE]);
+    }
+    print_percentiles("all", latencies, count);
+    if (lags) print_percentiles("lag", lags, count);
+
+    destroy_table(&config, table);
+    free(grouped);
+    free(latencies);
+    free(lags);
+    free(threads);
+    free(by_thread);
+    free(offsets);
+    return 0;
+}
@@ -0,0 +1,365 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "hashtablescratch.h"
+#include "hashtablescratch_openaddr.h"
+
+// Robin Hood variant of the table: open addressing over two flat arrays (probe distances and
+// key/value pairs) in one allocation, run at 0.9 load. A hit touches one line of each.
+//
+// - dist[i] is 0 for an empty bucket, otherwise 1 + how far the entry sits from its home.
+//   Entries of a cluster stay ordered by home, so the entries homed at h are exactly the
+//   buckets h+k with dist == k+1, and a lookup stops at the first bucket whose distance is
+//   shorter than its own. The distance bytes are compared 16 at a time.
+// - Insert shifts the run from the insertion point up to the next empty bucket one step
+//   right; delete shifts the run after the entry one step left until an empty bucket or an
+//   entry at home (backward shift: no tombstones). A distance above RH_MAX_DISTANCE makes
+//   the table double instead.
+// - Writers lock the key's segment and the next, then further segments in ascending order
+//   if the shifted run reaches them. Entries lie within RH_MAX_DISTANCE of home, so a lookup
+//   reads at most two segments; it takes no lock and validates both segments' sequence
+//   numbers, falling back to the lock after RH_READ_RETRIES tries.
+// - Growth and retired arrays work as in the hopscotch table (hashtablescratch_openaddr.h).
+
+#define RH_MAX_DISTANCE 127         // Longest probe distance before the table grows
+#define RH_SEGMENT_BUCKETS 1024     // Home buckets per lock (more than RH_MAX_DISTANCE)
+#define RH_READ_RETRIES 8           // Lock-free lookup attempts before taking the lock
+#define RH_SCAN_WIDTH 16            // Distance bytes compared at once; also tail padding
+
+_Static_assert(RH_MAX_DISTANCE < RH_SEGMENT_BUCKETS, "a lookup must stay within two segments");
+_Static_assert(RH_MAX_DISTANCE + RH_SCAN_WIDTH < 256, "stored distances must fit a byte");
+
+typedef struct {
+    int key;
+    int value;
+} RhEntry;
+
+typedef struct {
+    OaArrays base;              // Home buckets and their segments
+    uint8_t* dist;              // RH_MAX_DISTANCE + RH_SCAN_WIDTH buckets past the home ones
+    RhEntry* entries;
+} RhArrays;
+
+struct RobinHoodTable {
+    OaTable base;
+};
+
+
+// ============================================================================================= //
+// =========================================== LAYOUT ========================================== //
+// ============================================================================================= //
+static size_t rh_total_buckets(const OaArrays* arrays) {
+    return arrays->num_buckets + RH_MAX_DISTANCE + RH_SCAN_WIDTH;
+}
+
+// The tail past the last home bucket belongs to the last segment
+static size_t rh_segment_of(const RhArrays* arrays, size_t index) {
+    size_t s = index / RH_SEGMENT_BUCKETS;
+    return s < arrays->base.num_segments ? s : arrays->base.num_segments - 1;
+}
+
+static void rh_arrays_free(OaArrays* base) {
+    if (!base) return;
+    RhArrays* arrays = (RhArrays*)base;
+    oa_segments_free(base);
+    free(arrays->dist);
+    free(arrays);
+}
+
+static OaArrays* rh_arrays_create(size_t num_buckets) {
+    RhArrays* arrays = calloc(1, sizeof(RhArrays));
+    if (!arrays) return NULL;
+
+    if (!oa_segments_create(&arrays->base, num_buckets, RH_SEGMENT_BUCKETS)) {
+        free(arrays);
+        return NULL;
+    }
+
+    // One block: distances, then entries starting on a cache line
+    size_t total = rh_total_buckets(&arrays->base);
+    size_t dist_bytes = (total + 63) & ~(size_t)63;
+    arrays->dist = calloc(1, dist_bytes + total * sizeof(RhEntry));
+    if (!arrays->dist) {
+        rh_arrays_free(&arrays->base);
+        return NULL;
+    }
+    arrays->entries = (RhEntry*)(arrays->dist + dist_bytes);
+    return &arrays->base;
+}
+
+static size_t rh_arrays_bytes(const OaArrays* arrays) {
+    return rh_total_buckets(arrays) * (1 + sizeof(RhEntry));
+}
+
+static RhArrays* rh_current(RobinHoodTable* table) {
+    return (RhArrays*)atomic_load_explicit(&table->base.arrays, memory_order_acquire);
+}
+
+// Index of key among the entries homed at `home` (its value copied to `value` if set), or -1.
+// Stops at the first bucket whose distance is shorter than its offset from home. Lock-free
+// readers race with writers here and discard the result if a segment's sequence number moved,
+// so the race is left to the seqlock.
+__attribute__((no_sanitize_thread))
+static long rh_find(const RhArrays* arrays, size_t home, int key, int* value) {
+    const uint8_t* dist = arrays->dist + home;
+    for (unsigned base = 0; base <= RH_MAX_DISTANCE; base += RH_SCAN_WIDTH) {
+        unsigned match = 0;
+        unsigned shorter = 0;
+#ifdef __SSE2__
+        const __m128i ramp = _mm_setr_epi8(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16);
+        __m128i d = _mm_loadu_si128((const __m128i*)(dist + base));
+        __m128i want = _mm_add_epi8(ramp, _mm_set1_epi8((char)base));
+        match = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(d, want));
+        shorter = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(d, want), d)) & ~match;
+#else
+        for (unsigned i = 0; i < RH_SCAN_WIDTH; i++) {
+            unsigned want = base + i + 1;
+            if (dist[base + i] == want) match |= 1u << i;
+            else if (dist[base + i] < want) shorter |= 1u << i;
+        }
+#endif
+        if (shorter) match &= (shorter & -shorter) - 1; // Nothing homed here past that bucket
+        while (match) {
+            size_t index = home + base + (size_t)__builtin_ctz(match);
+            if (arrays->entries[index].key == key) {
+                if (value) *value = arrays->entries[index].value;
+                return (long)index;
+            }
+            match &= match - 1;
+        }
+        if (shorter) return -1;
+    }
+    return -1;
+}
+
+
+// ============================================================================================= //
+// ========================================== LOCKING ========================================== //
+// ============================================================================================= //
+// Segments first..last are held by one writer
+typedef struct {
+    RhArrays* arrays;
+    size_t first;
+    size_t last;
+} RhLocked;
+
+static void rh_unlock(RhLocked* held) {
+    for (size_t s = held->last + 1; s-- > held->first;) pthread_mutex_unlock(&held->arrays->base.segments[s].mutex);
+}
+
+static void rh_lock_through(RhLocked* held, size_t index) {
+    size_t s = rh_segment_of(held->arrays, index);
+    while (held->last < s) pthread_mutex_lock(&held->arrays->base.segments[++held->last].mutex);
+}
+
+// Locks the key's home segment and the next one in the array that is current once they are
+// held. Returns the home bucket.
+static size_t rh_lock(RobinHoodTable* table, int key, RhLocked* held) {
+    for (;;) {
+        RhArrays* arrays = rh_current(table);
+        size_t home = oa_home(key, arrays->base.num_buckets);
+        held->arrays = arrays;
+        held->first = held->last = rh_segment_of(arrays, home);
+        pthread_mutex_lock(&arrays->base.segments[held->first].mutex);
+        rh_lock_through(held, home + RH_MAX_DISTANCE);
+        if (atomic_load_explicit(&table->base.arrays, memory_order_relaxed) == &arrays->base) return home;
+        rh_unlock(held); // The table grew meanwhile
+    }
+}
+
+static void rh_write_begin(RhLocked* held) {
+    for (size_t s = held->first; s <= held->last; s++) {
+        atomic_uint* seq = &held->arrays->base.segments[s].seq;
+        atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_release);
+}
+
+static void rh_write_end(RhLocked* held) {
+    for (size_t s = held->first; s <= held->last; s++) {
+        atomic_uint* seq = &held->arrays->base.segments[s].seq;
+        atomic_store_explicit(seq, atomic_load_explicit(seq, memory_order_relaxed) + 1, memory_order_release);
+    }
+}
+
+// ============================================================================================= //
+// ========================================= PLACEMENT ========================================= //
+// ============================================================================================= //
+// Inserts a key known to be absent. Returns false, leaving the arrays untouched, if some
+// entry would end up more than RH_MAX_DISTANCE from home. With `held` set, segments are locked
+// as the run extends into them and bumped around the change; without it the arrays are private.
+static bool rh_place(RhArrays* arrays, size_t home, int key, int value, RhLocked* held) {
+    uint8_t* dist = arrays->dist;
+
+    // Insertion point: the first bucket holding an entry homed after ours (or empty)
+    size_t at = home;
+    while (dist[at] >= at - home + 1) {
+        if (at - home == RH_MAX_DISTANCE) return false;
+        at++;
+    }
+
+    // The run it displaces ends at the next empty bucket; every entry in it moves one further
+    size_t end = at;
+    for (; dist[end] != 0; end++) {
+        if (held) rh_lock_through(held, end + 1);
+        if (dist[end] > RH_MAX_DISTANCE) return false;
+    }
+    if (held) {
+        rh_lock_through(held, end);
+        rh_write_begin(held);
+    }
+
+    size_t run = end - at;
+    memmove(&arrays->entries[at + 1], &arrays->entries[at], run * sizeof(RhEntry));
+    for (size_t i = end; i > at; i--) dist[i] = (uint8_t)(dist[i - 1] + 1);
+    arrays->entries[at] = (RhEntry){ key, value };
+    dist[at] = (uint8_t)(at - home + 1);
+    oa_counter_add(&arrays->base.segments[rh_segment_of(arrays, home)].count, 1);
+
+    if (held) rh_write_end(held);
+    return true;
+}
+
+// Backward-shift delete of the entry at `at`
+static void rh_remove_at(RhArrays* arrays, size_t at, size_t home, RhLocked* held) {
+    uint8_t* dist = arrays->dist;
+    size_t end = at + 1;
+    rh_lock_through(held, end);
+    for (; dist[end] > 1; end++) rh_lock_through(held, end + 1);
+
+    rh_write_begin(held);
+    size_t run = end - at - 1;
+    memmove(&arrays->entries[at], &arrays->entries[at + 1], run * sizeof(RhEntry));
+    for (size_t i = at; i < end - 1; i++) dist[i] = (uint8_t)(dist[i + 1] - 1);
+    dist[end - 1] = 0;
+    oa_counter_add(&arrays->base.segments[rh_segment_of(arrays, home)].count, -1);
+    rh_write_end(held);
+}
+
+// Moves every entry of old into grown. Returns false if some entry landed too far from home.
+static bool rh_rehash(OaArrays* grown_base, OaArrays* old_base) {
+    RhArrays* grown = (RhArrays*)grown_base;
+    RhArrays* old = (RhArrays*)old_base;
+    size_t total = rh_total_buckets(old_base);
+    for (size_t i = 0; i < total; i++) {
+        if (!old->dist[i]) continue;
+        RhEntry entry = old->entries[i];
+        if (!rh_place(grown, oa_home(entry.key, grown->base.num_buckets), entry.key, entry.value, NULL)) return false;
+    }
+    return true;
+}
+
+static const OaLayout rh_layout = { rh_arrays_create, rh_arrays_free, rh_rehash, rh_arrays_bytes };
+
+
+// ============================================================================================= //
+// ======================================= CREATE / DESTROY ==================================== //
+// ============================================================================================= //
+// Sized to hold `capacity` entries at 0.9 load. Returns NULL on failure.
+RobinHoodTable* ht_rh_create(size_t capacity) {
+    RobinHoodTable* table = malloc(sizeof(RobinHoodTable));
+    if (!table) return NULL;
+
+    OaArrays* arrays = rh_arrays_create(capacity + capacity / 9);
+    if (!arrays) {
+        free(table);
+        return NULL;
+    }
+    oa_table_init(&table->base, arrays);
+    return table;
+}
+
+void ht_rh_destroy(RobinHoodTable* table) {
+    if (!table) return;
+    oa_table_destroy(&table->base, &rh_layout);
+    free(table);
+}
+
+
+// ============================================================================================= //
+// ========================================= OPERATIONS ======================================== //
+// ============================================================================================= //
+// Returns 1 on success, 0 if the table could not grow
+int ht_rh_insert(RobinHoodTable* table, int key, int value) {
+    if (!table) return 0;
+
+    for (;;) {
+        RhLocked held;
+        size_t home = rh_lock(table, key, &held);
+        RhArrays* arrays = held.arrays;
+        long found = rh_find(arrays, home, key, NULL);
+        if (found >= 0) {
+            rh_write_begin(&held);
+            arrays->entries[found].value = value;
+            rh_write_end(&held);
+            rh_unlock(&held);
+            return 1;
+        }
+
+        bool placed = rh_place(arrays, home, key, value, &held);
+        rh_unlock(&held);
+        if (placed) return 1;
+        if (!oa_grow(&table->base, &arrays->base, &rh_layout)) return 0;
+    }
+}
+
+// 1 = found, 0 = not found. Lock-free unless writers keep changing the key's segments.
+int ht_rh_get(RobinHoodTable* table, int key_to_seek, int* seeked_value) {
+    if (!table) return 0;
+
+    for (int attempt = 0; attempt < RH_READ_RETRIES; attempt++) {
+        RhArrays* arrays = rh_current(table);
+        size_t home = oa_home(key_to_seek, arrays->base.num_buckets);
+        atomic_uint* first = &arrays->base.segments[rh_segment_of(arrays, home)].seq;
+        atomic_uint* second = &arrays->base.segments[rh_segment_of(arrays, home + RH_MAX_DISTANCE)].seq;
+        unsigned first_before = atomic_load_explicit(first, memory_order_acquire);
+        unsigned second_before = atomic_load_explicit(second, memory_order_acquire);
+        if ((first_before | second_before) & 1) continue; // Writer inside
+
+        int value = 0;
+        long found = rh_find(arrays, home, key_to_seek, &value);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(first, memory_order_relaxed) != first_before ||
+            atomic_load_explicit(second, memory_order_relaxed) != second_before) continue;
+        if (found >= 0) *seeked_value = value;
+        return found >= 0 ? 1 : 0;
+    }
+
+    // Writers kept overlapping: read under the lock
+    RhLocked held;
+    size_t home = rh_lock(table, key_to_seek, &held);
+    long found = rh_find(held.arrays, home, key_to_seek, seeked_value);
+    rh_unlock(&held);
+    return found >= 0 ? 1 : 0;
+}
+
+void ht_rh_delete(RobinHoodTable* table, int key) {
+    if (!table) return;
+
+    RhLocked held;
+    size_t home = rh_lock(table, key, &held);
+    long found = rh_find(held.arrays, home, key, NULL);
+    if (found >= 0) rh_remove_at(held.arrays, (size_t)found, home, &held);
+    rh_unlock(&held);
+}
+
+size_t ht_rh_count(RobinHoodTable* table) {
+    return table ? oa_table_count(&table->base) : 0;
+}
+
+// Bytes held by the current arrays, the arrays retired by growth and their segment locks
+size_t ht_rh_memory(RobinHoodTable* table) {
+    return table ? oa_table_memory(&table->base, sizeof(RobinHoodTable), sizeof(RhArrays), &rh_layout) : 0;
+}
+
+// Entries over home buckets
+double ht_rh_load_factor(RobinHoodTable* table) {
+    return table ? oa_table_load_factor(&table->base) : 0.0;
+}
@@ -0,0 +1,392 @@
+// Key-value server in front of the fine-grained hash table.
+//
+// One process owns the table; other processes on the host talk to it over a Unix socket or
+// loopback TCP using the fixed-frame protocol in hashtablescratch_proto.h. Each worker
+// thread runs its own edge-triggered epoll loop over many connections, parses every
+// complete frame in its read buffer in one pass (pipelining), and sends all queued
+// responses back with a single writev.
+//
+// Usage: ./hashtablescratch_server [-u socket_path | -p port] [-t workers]
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "hashtablescratch.h"
+#include "hashtablescratch_proto.h"
+
+#define DEFAULT_WORKERS 4
+#define MAX_EVENTS 256
+#define READ_BUFFER_SIZE (64 * 1024)      // Fits a full HT_PROTO_MAX_BATCH batch
+#define OUT_CHUNK_SIZE (16 * 1024)
+#define MAX_IOVECS 64
+#define MAX_PENDING_OUTPUT (4 * 1024 * 1024) // Stop parsing input until the client reads
+
+// Response bytes waiting to be sent, as a list of chunks handed to writev in one call
+typedef struct OutChunk {
+    struct OutChunk* next;
+    size_t len;
+    size_t sent;
+    char data[OUT_CHUNK_SIZE];
+} OutChunk;
+
+typedef struct Connection {
+    struct Connection* prev;    // In the owning worker's list of open connections
+    struct Connection* next;
+    int fd;
+    size_t in_len;
+    OutChunk* out_head;
+    OutChunk* out_tail;
+    size_t out_pending;
+    char in[READ_BUFFER_SIZE];
+} Connection;
+
+typedef struct {
+    pthread_t thread;
+    int epoll_fd;
+    pthread_mutex_t mutex;  // Guards connections: the accept loop adds, the worker removes
+    Connection* connections; // Open connections, closed at shutdown if still there
+    OutChunk* free_chunks;  // Recycled output chunks (worker-local, no locking)
+    unsigned long long ops;
+} Worker;
+
+static HashTable* table;
+static volatile sig_atomic_t stop_requested = 0;
+
+
+// ============================================================================================= //
+// =========================================== OUTPUT ========================================== //
+// ============================================================================================= //
+static bool out_append(Worker* worker, Connection* conn, const void* data, size_t len) {
+    OutChunk* tail = conn->out_tail;
+    if (!tail || tail->len + len > OUT_CHUNK_SIZE) {
+        OutChunk* chunk = worker->free_chunks;
+        if (chunk) worker->free_chunks = chunk->next;
+        else if (!(chunk = malloc(sizeof(OutChunk)))) return false;
+
+        chunk->next = NULL;
+        chunk->len = 0;
+        chunk->sent = 0;
+        if (tail) tail->next = chunk;
+        else conn->out_head = chunk;
+        conn->out_tail = chunk;
+        tail = chunk;
+    }
+    memcpy(tail->data + tail->len, data, len);
+    tail->len += len;
+    conn->out_pending += len;
+    return true;
+}
+
+// Sends as much queued output as the socket takes. Returns false on a fatal socket error.
+static bool out_flush(Worker* worker, Connection* conn) {
+    while (conn->out_head) {
+        struct iovec iov[MAX_IOVECS];
+        int count = 0;
+        for (OutChunk* chunk = conn->out_head; chunk && count < MAX_IOVECS; chunk = chunk->next) {
+            iov[count].iov_base = chunk->data + chunk->sent;
+            iov[count].iov_len = chunk->len - chunk->sent;
+            count++;
+        }
+
+        ssize_t written = writev(conn->fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK; // EPOLLOUT will resume
+        }
+
+        conn->out_pending -= (size_t)written;
+        while (written > 0) {
+            OutChunk* chunk = conn->out_head;
+            size_t left = chunk->len - chunk->sent;
+            if ((size_t)written < left) {
+                chunk->sent += (size_t)written;
+                break;
+            }
+            written -= (ssize_t)left;
+            conn->out_head = chunk->next;
+            if (!conn->out_head) conn->out_tail = NULL;
+            chunk->next = worker->free_chunks;
+            worker->free_chunks = chunk;
+        }
+    }
+    return true;
+}
+
+
+// ============================================================================================= //
+// ========================================== REQUESTS ========================================= //
+// ============================================================================================= //
+static HtResponse execute(const HtRequest* req) {
+    HtResponse resp = { HT_STATUS_OK, 0 };
+    switch (req->op) {
+        case HT_OP_GET:
+            if (!ht_get(table, req->key, &resp.value)) resp.status = HT_STATUS_NOT_FOUND;
+            break;
+        case HT_OP_SET:
+            ht_insert(table, req->key, req->value);
+            break;
+        case HT_OP_DELETE:
+            ht_delete(table, req->key);
+            break;
+        default:
+            resp.status = HT_STATUS_BAD_REQUEST;
+    }
+    return resp;
+}
+
+// Runs every complete frame in the input buffer. Returns false if the connection must close.
+static bool process_input(Worker* worker, Connection* conn) {
+    size_t pos = 0;
+
+    while (conn->in_len - pos >= sizeof(HtRequest) && conn->out_pending < MAX_PENDING_OUTPUT) {
+        HtRequest req;
+        memcpy(&req, conn->in + pos, sizeof(req));
+
+        if (req.op != HT_OP_BATCH) {
+            HtResponse resp = execute(&req);
+            if (!out_append(worker, conn, &resp, sizeof(resp))) return false;
+            pos += sizeof(HtRequest);
+            worker->ops++;
+            continue;
+        }
+
+        if (req.value < 0 || req.value > HT_PROTO_MAX_BATCH) return false; // Cannot resync
+        size_t needed = sizeof(HtRequest) * (1 + (size_t)req.value);
+        if (conn->in_len - pos < needed) break; // Wait for the rest of the batch
+
+        HtResponse header = { HT_STATUS_OK, req.value };
+        if (!out_append(worker, conn, &header, sizeof(header))) return false;
+        for (int32_t i = 1; i <= req.value; i++) {
+            HtRequest sub;
+            memcpy(&sub, conn->in + pos + i * sizeof(HtRequest), sizeof(sub));
+            HtResponse resp = { HT_STATUS_BAD_REQUEST, 0 };
+            if (sub.op != HT_OP_BATCH) resp = execute(&sub); // No nested batches
+            if (!out_append(worker, conn, &resp, sizeof(resp))) return false;
+        }
+        pos += needed;
+        worker->ops += (unsigned long long)req.value;
+    }
+
+    // Keep the partial frame at the front of the buffer
+    memmove(conn->in, conn->in + pos, conn->in_len - pos);
+    conn->in_len -= pos;
+    return true;
+}
+
+// Edge-triggered: drain the socket until EAGAIN (or until output backs up)
+static bool service(Worker* worker, Connection* conn) {
+    for (;;) {
+        if (!out_flush(worker, conn)) return false;
+        if (conn->out_pending >= MAX_PENDING_OUTPUT) return true; // Resume on EPOLLOUT
+        if (!process_input(worker, conn)) return false;
+        if (conn->out_pending >= MAX_PENDING_OUTPUT) continue;
+
+        ssize_t n = read(conn->fd, conn->in + conn->in_len, READ_BUFFER_SIZE - conn->in_len);
+        if (n == 0) return false; // Peer closed
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+            return out_flush(worker, conn);
+        }
+        conn->in_len += (size_t)n;
+    }
+}
+
+static void close_connection(Worker* worker, Connection* conn) {
+    pthread_mutex_lock(&worker->mutex);
+    if (conn->prev) conn->prev->next = conn->next;
+    else worker->connections = conn->next;
+    if (conn->next) conn->next->prev = conn->prev;
+    pthread_mutex_unlock(&worker->mutex);
+
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    while (conn->out_head) {
+        OutChunk* chunk = conn->out_head;
+        conn->out_head = chunk->next;
+        chunk->next = worker->free_chunks;
+        worker->free_chunks = chunk;
+    }
+    free(conn);
+}
+
+
+// ============================================================================================= //
+// ========================================== WORKERS ========================================== //
+// ============================================================================================= //
+static void* worker_main(void* arg) {
+    Worker* worker = arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    while (!stop_requested) {
+        int n = epoll_wait(worker->epoll_fd, events, MAX_EVENTS, 200);
+        for (int i = 0; i < n; i++) {
+            Connection* conn = events[i].data.ptr;
+            bool keep = !(events[i].events & EPOLLERR) && service(worker, conn);
+            if (!keep) close_connection(worker, conn);
+        }
+    }
+    return NULL;
+}
+
+static int open_listener(const char* unix_path, int port) {
+    int fd;
+    if (unix_path) {
+        struct sockaddr_un addr = { .sun_family = AF_UNIX };
+        if (strlen(unix_path) >= sizeof(addr.sun_path)) return -1;
+        strcpy(addr.sun_path, unix_path);
+        unlink(unix_path);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) return -1;
+    } else {
+        struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons((uint16_t)port) };
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        int one = 1;
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) return -1;
+    }
+    if (listen(fd, 1024) != 0) return -1;
+    return fd;
+}
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop_requested = 1;
+}
+
+int main(int argc, char** argv) {
+    const char* unix_path = NULL;
+    int port = HT_PROTO_DEFAULT_PORT;
+    int num_workers = DEFAULT_WORKERS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "u:p:t:")) != -1) {
+        switch (opt) {
+            case 'u': unix_path = optarg; break;
+            case 'p': port = atoi(optarg); break;
+            case 't': num_workers = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-u socket_path | -p port] [-t workers]\n", argv[0]);
+                return 1;
+        }
+    }
+    if (num_workers < 1) num_workers = 1;
+
+    table = create_hashtable(INITIAL_TABLE_SIZE);
+    if (!table) {
+        printf("Error creating hash table\n");
+        return 1;
+    }
+    ht_enable_background_resize(table, 0.7f, 2.0f); // Never stall a request on growth
+
+    int listen_fd = open_listener(unix_path, port);
+    if (listen_fd < 0) {
+        perror("listen");
+        return 1;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    Worker* workers = calloc((size_t)num_workers, sizeof(Worker));
+    int started = 0;
+    while (workers && started < num_workers) {
+        Worker* worker = &workers[started];
+        worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (worker->epoll_fd < 0) break;
+        pthread_mutex_init(&worker->mutex, NULL);
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+            pthread_mutex_destroy(&worker->mutex);
+            close(worker->epoll_fd);
+            break;
+        }
+        started++;
+    }
+    bool failed = started < num_workers;
+    if (failed) {
+        printf("Error starting workers\n");
+        stop_requested = 1; // Skip the accept loop and stop the workers already running
+    } else if (unix_path) {
+        printf("Listening on %s with %d workers\n", unix_path, num_workers);
+    } else {
+        printf("Listening on 127.0.0.1:%d with %d workers\n", port, num_workers);
+    }
+
+    // Accept loop: connections are spread round-robin over the workers' epoll sets
+    int next_worker = 0;
+    struct pollfd pfd = { .fd = listen_fd, .events = POLLIN };
+    while (!stop_requested) {
+        if (poll(&pfd, 1, 200) <= 0) continue;
+
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) continue;
+        if (!unix_path) {
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+
+        Connection* conn = malloc(sizeof(Connection));
+        if (!conn) {
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->in_len = 0;
+        conn->out_head = conn->out_tail = NULL;
+        conn->out_pending = 0;
+        conn->prev = NULL;
+
+        // Listed before it is armed: once in the epoll set the worker may close it
+        Worker* worker = &workers[next_worker];
+        next_worker = (next_worker + 1) % num_workers;
+        pthread_mutex_lock(&worker->mutex);
+        conn->next = worker->connections;
+        if (conn->next) conn->next->prev = conn;
+        worker->connections = conn;
+        pthread_mutex_unlock(&worker->mutex);
+
+        struct epoll_event ev = { .events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = conn };
+        if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) close_connection(worker, conn);
+    }
+
+    unsigned long long total_ops = 0;
+    for (int i = 0; i < started; i++) {
+        Worker* worker = &workers[i];
+        pthread_join(worker->thread, NULL);
+        while (worker->connections) close_connection(worker, worker->connections); // Clients still attached
+        close(worker->epoll_fd);
+        pthread_mutex_destroy(&worker->mutex);
+        total_ops += worker->ops;
+        while (worker->free_chunks) {
+            OutChunk* next = worker->free_chunks->next;
+            free(worker->free_chunks);
+            worker->free_chunks = next;
+        }
+    }
+    if (!failed) printf("\nServed %llu operations, %zu keys in table\n", total_ops, (size_t)table->count);
+
+    close(listen_fd);
+    if (unix_path) unlink(unix_path);
+    free(workers);
+    ht_destroy(table);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,432 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "hashtablescratch.h"
+
+// Shared-memory variant of the table: the whole table (header, stripe mutexes, bucket array
+// and node pool) lives in one POSIX shared-memory segment, so every process that maps it
+// reads and writes the same table with no copying.
+//
+// - Links are node indices (0 = NULL) instead of pointers, since each process may map the
+//   segment at a different address.
+// - Stripe mutexes are PTHREAD_PROCESS_SHARED and robust. Every update is published with a
+//   single store of a link, so a chain is never left half-written, but a process that dies
+//   holding a stripe can still leave a node off every chain and free list, or the count
+//   wrong. So the next locker that gets EOWNERDEAD marks the segment dirty, and before
+//   anything else uses it, shm_recover takes every stripe, hands each node no chain reaches
+//   back to the free lists and recounts the entries.
+// - Geometry is fixed at creation (no resize): remapping a live segment in every process
+//   would need a cross-process handshake on each growth. Size it with the expected peak.
+
+#define SHM_MAGIC 0x48545348u   // "HTSH"
+#define SHM_NIL 0u
+
+typedef struct {
+    int key;
+    int value;
+    uint32_t next;  // Index of the next node in the chain, SHM_NIL at the end
+} ShmNode;
+
+// Everything below lives inside the segment
+typedef struct {
+    uint32_t magic;
+    atomic_int ready;               // Set last by the creator; openers wait for it
+    uint64_t num_buckets;
+    uint64_t capacity;              // Nodes in the pool (index 0 is reserved as NIL)
+    atomic_size_t count;
+    atomic_int dirty;               // A process died holding a stripe: shm_recover must run
+    atomic_uint_fast64_t next_unused; // Bump allocator over the node pool
+    uint32_t free_lists[NUM_MUTEXES]; // Deleted nodes, reused first by inserts on the same stripe
+    pthread_mutex_t mutexes[NUM_MUTEXES];
+} ShmHeader;
+
+struct ShmHashTable {
+    ShmHeader* header;
+    uint32_t* buckets;  // num_buckets heads
+    ShmNode* nodes;     // capacity + 1 nodes
+    size_t map_size;
+};
+
+
+// ============================================================================================= //
+// =========================================== LAYOUT ========================================== //
+// ============================================================================================= //
+static size_t shm_buckets_offset(void) {
+    return (sizeof(ShmHeader) + 63) & ~(size_t)63;
+}
+
+static size_t shm_nodes_offset(uint64_t num_buckets) {
+    return (shm_buckets_offset() + num_buckets * sizeof(uint32_t) + 63) & ~(size_t)63;
+}
+
+static size_t shm_total_size(uint64_t num_buckets, uint64_t capacity) {
+    return shm_nodes_offset(num_buckets) + (capacity + 1) * sizeof(ShmNode);
+}
+
+static ShmHashTable* shm_attach(void* base, size_t map_size) {
+    ShmHashTable* table = malloc(sizeof(ShmHashTable));
+    if (!table) return NULL;
+
+    table->header = base;
+    table->buckets = (uint32_t*)((char*)base + shm_buckets_offset());
+    table->nodes = (ShmNode*)((char*)base + shm_nodes_offset(table->header->num_buckets));
+    table->map_size = map_size;
+    return table;
+}
+
+static size_t shm_hash(int key, uint64_t num_buckets) {
+    return (size_t)(((long long)key % (long long)num_buckets + (long long)num_buckets) % (long long)num_buckets);
+}
+
+// ============================================================================================= //
+// ========================================== RECOVERY ========================================= //
+// ============================================================================================= //
+// A process that died holding the mutex leaves it EOWNERDEAD: mark it usable again and the
+// segment dirty, so the stripe's state gets repaired before it is trusted.
+static pthread_mutex_t* shm_lock_raw(ShmHashTable* table, size_t stripe) {
+    pthread_mutex_t* mutex = &table->header->mutexes[stripe];
+    if (pthread_mutex_lock(mutex) == EOWNERDEAD) {
+        pthread_mutex_consistent(mutex);
+        atomic_store(&table->header->dirty, 1);
+    }
+    return mutex;
+}
+
+// Called with no stripe held. Locks every stripe, so no live process is mid-update, and
+// rebuilds what a dead one may have left inconsistent: nodes taken from or bound for a free
+// list but on no chain go back to the free lists, and the count is taken from the chains.
+static void shm_recover(ShmHashTable* table) {
+    ShmHeader* header = table->header;
+    for (size_t i = 0; i < NUM_MUTEXES; i++) shm_lock_raw(table, i);
+
+    if (atomic_load(&header->dirty)) {
+        uint64_t used = atomic_load(&header->next_unused) - 1; // A dead insert may have overshot
+        if (used > header->capacity) used = header->capacity;
+        atomic_store(&header->next_unused, used + 1);
+
+        uint8_t* linked = calloc(used / 8 + 1, 1);
+        size_t count = 0;
+        for (uint64_t b = 0; b < header->num_buckets; b++) {
+            size_t steps = 0; // Bounds the walk even if a chain was corrupted some other way
+            for (uint32_t i = table->buckets[b]; i != SHM_NIL && i <= used && steps <= used; i = table->nodes[i].next) {
+                if (linked) linked[i / 8] |= (uint8_t)(1u << (i % 8));
+                count++;
+                steps++;
+            }
+        }
+        atomic_store(&header->count, count);
+
+        if (linked) { // Out of memory: the count is right, but stray nodes stay lost
+            for (size_t stripe = 0; stripe < NUM_MUTEXES; stripe++) header->free_lists[stripe] = SHM_NIL;
+            for (uint64_t i = used; i >= 1; i--) { // Pushed in reverse, so lists start at low indices
+                if (linked[i / 8] & (1u << (i % 8))) continue;
+                table->nodes[i].next = header->free_lists[i % NUM_MUTEXES];
+                header->free_lists[i % NUM_MUTEXES] = (uint32_t)i;
+            }
+            free(linked);
+        }
+        atomic_store(&header->dirty, 0);
+    }
+
+    for (size_t i = NUM_MUTEXES; i-- > 0;) pthread_mutex_unlock(&header->mutexes[i]);
+}
+
+// Locks the bucket's stripe with no other stripe held, repairing the segment first if a
+// process died holding one
+static pthread_mutex_t* shm_lock_bucket(ShmHashTable* table, size_t bucket_index) {
+    for (;;) {
+        pthread_mutex_t* mutex = shm_lock_raw(table, bucket_index % NUM_MUTEXES);
+        if (!atomic_load_explicit(&table->header->dirty, memory_order_relaxed)) return mutex;
+        pthread_mutex_unlock(mutex);
+        shm_recover(table);
+    }
+}
+
+// Caller holds another stripe, so it cannot recover here: a dead owner just marks the segment
+// dirty and the stripe counts as busy
+static bool shm_trylock_stripe(ShmHashTable* table, size_t stripe) {
+    pthread_mutex_t* mutex = &table->header->mutexes[stripe];
+    int rc = pthread_mutex_trylock(mutex);
+    if (rc == EOWNERDEAD) {
+        pthread_mutex_consistent(mutex);
+        atomic_store(&table->header->dirty, 1);
+        pthread_mutex_unlock(mutex);
+        return false;
+    }
+    return rc == 0;
+}
+
+
+// ============================================================================================= //
+// ========================================= FREE LISTS ======================================== //
+// ============================================================================================= //
+
+// Caller holds the stripe's mutex
+static uint32_t shm_pop_free(ShmHashTable* table, size_t stripe) {
+    ShmHeader* header = table->header;
+    uint32_t index = header->free_lists[stripe];
+    if (index != SHM_NIL) __atomic_store_n(&header->free_lists[stripe], table->nodes[index].next, __ATOMIC_RELAXED);
+    return index;
+}
+
+// Caller holds the stripe's mutex
+static void shm_push_free(ShmHashTable* table, size_t stripe, uint32_t index) {
+    ShmHeader* header = table->header;
+    table->nodes[index].next = header->free_lists[stripe];
+    __atomic_store_n(&header->free_lists[stripe], index, __ATOMIC_RELAXED);
+}
+
+// Pool exhausted and the caller's own list empty: take a node freed on another stripe. The
+// caller holds its stripe, so other stripes are only tried (a blocking lock could deadlock
+// with a thread stealing the other way).
+static uint32_t shm_steal_node(ShmHashTable* table, size_t stripe) {
+    for (size_t i = 1; i < NUM_MUTEXES; i++) {
+        size_t victim = (stripe + i) % NUM_MUTEXES;
+        if (__atomic_load_n(&table->header->free_lists[victim], __ATOMIC_RELAXED) == SHM_NIL) continue;
+        if (!shm_trylock_stripe(table, victim)) continue;
+        uint32_t index = shm_pop_free(table, victim);
+        pthread_mutex_unlock(&table->header->mutexes[victim]);
+        if (index != SHM_NIL) return index;
+    }
+    return SHM_NIL;
+}
+
+// Called with no mutex held after shm_steal_node found every non-empty list busy: waits for
+// one such stripe, moves a node from it to `stripe`'s list. Both stripes are held (in
+// ascending order) for the move, so the node is never on no list with no lock held, which
+// shm_recover would take for a node a dead process dropped. Returns false if no list has one.
+static bool shm_refill_stripe(ShmHashTable* table, size_t stripe) {
+    ShmHeader* header = table->header;
+    for (size_t i = 1; i < NUM_MUTEXES; i++) {
+        size_t victim = (stripe + i) % NUM_MUTEXES;
+        if (__atomic_load_n(&header->free_lists[victim], __ATOMIC_RELAXED) == SHM_NIL) continue;
+
+        size_t low = victim < stripe ? victim : stripe, high = victim < stripe ? stripe : victim;
+        shm_lock_raw(table, low);
+        shm_lock_raw(table, high);
+        if (atomic_load(&header->dirty)) {
+            pthread_mutex_unlock(&header->mutexes[high]);
+            pthread_mutex_unlock(&header->mutexes[low]);
+            shm_recover(table);
+            return true; // Free lists were rebuilt: the caller looks again
+        }
+        uint32_t index = shm_pop_free(table, victim);
+        if (index != SHM_NIL) shm_push_free(table, stripe, index);
+        pthread_mutex_unlock(&header->mutexes[high]);
+        pthread_mutex_unlock(&header->mutexes[low]);
+        if (index != SHM_NIL) return true;
+    }
+    return false;
+}
+
+
+// ============================================================================================= //
+// ======================================= CREATE / OPEN ======================================= //
+// ============================================================================================= //
+// Creates the segment `name` (e.g. "/my_table") holding up to `capacity` entries spread over
+// `num_buckets` buckets. Fails if it already exists. Returns NULL on failure.
+ShmHashTable* ht_shm_create(const char* name, size_t num_buckets, size_t capacity) {
+    if (!name || num_buckets == 0 || capacity == 0 || capacity >= UINT32_MAX) return NULL;
+
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (fd < 0) return NULL;
+
+    size_t size = shm_total_size(num_buckets, capacity);
+    if (ftruncate(fd, (off_t)size) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+
+    void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        shm_unlink(name);
+        return NULL;
+    }
+
+    // ftruncate zero-fills: buckets and free lists start as SHM_NIL
+    ShmHeader* header = base;
+    header->magic = SHM_MAGIC;
+    header->num_buckets = num_buckets;
+    header->capacity = capacity;
+    atomic_init(&header->count, 0);
+    atomic_init(&header->dirty, 0);
+    atomic_init(&header->next_unused, 1); // Index 0 is NIL
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    for (int i = 0; i < NUM_MUTEXES; i++) pthread_mutex_init(&header->mutexes[i], &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    atomic_store_explicit(&header->ready, 1, memory_order_release);
+
+    ShmHashTable* table = shm_attach(base, size);
+    if (!table) {
+        munmap(base, size);
+        shm_unlink(name);
+    }
+    return table;
+}
+
+// Maps an existing segment created by ht_shm_create (possibly in another process)
+ShmHashTable* ht_shm_open(const char* name) {
+    if (!name) return NULL;
+
+    int fd = shm_open(name, O_RDWR, 0600);
+    if (fd < 0) return NULL;
+
+    // The creator may still be sizing the segment
+    struct stat st;
+    for (int tries = 0;; tries++) {
+        if (fstat(fd, &st) != 0 || tries == 1000) {
+            close(fd);
+            return NULL;
+        }
+        if ((size_t)st.st_size >= sizeof(ShmHeader)) break;
+        usleep(1000);
+    }
+
+    size_t size = (size_t)st.st_size;
+    void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+
+    ShmHeader* header = base;
+    for (int tries = 0; !atomic_load_explicit(&header->ready, memory_order_acquire); tries++) {
+        if (tries == 1000) {
+            munmap(base, size);
+            return NULL;
+        }
+        usleep(1000);
+    }
+    if (header->magic != SHM_MAGIC || shm_total_size(header->num_buckets, header->capacity) > size) {
+        munmap(base, size);
+        return NULL;
+    }
+
+    ShmHashTable* table = shm_attach(base, size);
+    if (!table) munmap(base, size);
+    return table;
+}
+
+// Unmaps the segment in this process; the table lives on until ht_shm_unlink
+void ht_shm_close(ShmHashTable* table) {
+    if (!table) return;
+    munmap(table->header, table->map_size);
+    free(table);
+}
+
+// Removes the segment name; memory is released once every process has closed it
+int ht_shm_unlink(const char* name) {
+    return shm_unlink(name) == 0 ? 1 : 0;
+}
+
+
+// ============================================================================================= //
+// ========================================= OPERATIONS ======================================== //
+// ============================================================================================= //
+// Returns 1 on success, 0 if the node pool is exhausted and no stripe has a freed node
+int ht_shm_insert(ShmHashTable* table, int key, int value) {
+    if (!table) return 0;
+
+    ShmHeader* header = table->header;
+    size_t bucket_index = shm_hash(key, header->num_buckets);
+    size_t stripe = bucket_index % NUM_MUTEXES;
+    pthread_mutex_t* mutex;
+    uint32_t index;
+    for (;;) {
+        mutex = shm_lock_bucket(table, bucket_index);
+
+        // Search if key already exists and update value if so
+        for (uint32_t i = table->buckets[bucket_index]; i != SHM_NIL; i = table->nodes[i].next) {
+            if (table->nodes[i].key == key) {
+                table->nodes[i].value = value;
+                pthread_mutex_unlock(mutex);
+                return 1;
+            }
+        }
+
+        // Reuse a node freed on this stripe, then a fresh one from the pool, then one freed
+        // on another stripe
+        index = shm_pop_free(table, stripe);
+        if (index != SHM_NIL) break;
+        uint64_t fresh = atomic_fetch_add(&header->next_unused, 1);
+        if (fresh <= header->capacity) {
+            index = (uint32_t)fresh;
+            break;
+        }
+        atomic_fetch_sub(&header->next_unused, 1);
+        index = shm_steal_node(table, stripe);
+        if (index != SHM_NIL) break;
+
+        pthread_mutex_unlock(mutex);
+        if (!shm_refill_stripe(table, stripe)) return 0; // Table full
+    }
+
+    ShmNode* node = &table->nodes[index];
+    node->key = key;
+    node->value = value;
+    node->next = table->buckets[bucket_index];
+    table->buckets[bucket_index] = index; // Single store publishes the node
+
+    atomic_fetch_add(&header->count, 1);
+    pthread_mutex_unlock(mutex);
+    return 1;
+}
+
+int ht_shm_get(ShmHashTable* table, int key_to_seek, int* seeked_value) {
+    if (!table) return 0;
+
+    size_t bucket_index = shm_hash(key_to_seek, table->header->num_buckets);
+    pthread_mutex_t* mutex = shm_lock_bucket(table, bucket_index);
+
+    for (uint32_t i = table->buckets[bucket_index]; i != SHM_NIL; i = table->nodes[i].next) {
+        if (table->nodes[i].key == key_to_seek) {
+            *seeked_value = table->nodes[i].value;
+            pthread_mutex_unlock(mutex);
+            return 1; // Found
+        }
+    }
+
+    pthread_mutex_unlock(mutex);
+    return 0; // Not found
+}
+
+void ht_shm_delete(ShmHashTable* table, int key) {
+    if (!table) return;
+
+    ShmHeader* header = table->header;
+    size_t bucket_index = shm_hash(key, header->num_buckets);
+    pthread_mutex_t* mutex = shm_lock_bucket(table, bucket_index);
+
+    uint32_t* link = &table->buckets[bucket_index];
+    while (*link != SHM_NIL) {
+        uint32_t index = *link;
+        ShmNode* node = &table->nodes[index];
+        if (node->key == key) {
+            *link = node->next; // Single store unlinks the node
+
+            shm_push_free(table, bucket_index % NUM_MUTEXES, index);
+
+            atomic_fetch_sub(&header->count, 1);
+            break;
+        }
+        link = &node->next;
+    }
+    pthread_mutex_unlock(mutex);
+}
+
+size_t ht_shm_count(const ShmHashTable* table) {
+    return table ? atomic_load(&table->header->count) : 0;
+}
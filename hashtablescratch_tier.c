@@ -0,0 +1,456 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "hashtablescratch.h"
+
+// Disk tier for cold entries: append-only segment files plus a compact in-memory index.
+//
+// - A segment is a file of 8-byte (key, value) records, written sequentially. Records are
+//   staged in the active segment's buffer and flushed TIER_FLUSH_RECORDS at a time, so an
+//   eviction costs no syscall of its own; reads of staged records come from the buffer.
+// - The index is an open-addressing table of 8-byte slots: the key itself (for int keys it
+//   is a perfect fingerprint, so a hit never needs a verifying read) and a 32-bit location
+//   (segment number, record number). That is all the RAM a spilled entry costs.
+// - Overwrites and removals only update the index and leave a dead record behind. The
+//   compaction thread rewrites segments that are mostly dead into the active segment and
+//   deletes their files, so disk use stays proportional to the live entries.
+//
+// One mutex guards everything; callers that also hold table stripes take it last.
+
+#define TIER_SEGMENT_BITS 20
+#define TIER_SEGMENT_RECORDS (1u << TIER_SEGMENT_BITS)   // 8 MB segments
+#define TIER_MAX_SEGMENTS ((1u << (32 - TIER_SEGMENT_BITS)) - 1) // 4095: the last segment number
+#define TIER_FLUSH_RECORDS 4096                                    // is left out for the sentinels
+#define TIER_SLOT_EMPTY UINT32_MAX
+#define TIER_SLOT_DELETED (UINT32_MAX - 1)
+_Static_assert(((uint64_t)TIER_MAX_SEGMENTS << TIER_SEGMENT_BITS) <= TIER_SLOT_DELETED,
+               "a record location must never equal a slot sentinel");
+#define TIER_COMPACT_DEAD 0.5   // Rewrite a sealed segment once this fraction is dead
+
+typedef struct {
+    int32_t key;
+    int32_t value;
+} TierRecord;
+
+typedef struct {
+    int32_t key;
+    uint32_t location;  // segment << TIER_SEGMENT_BITS | record, or TIER_SLOT_*
+} TierSlot;
+
+typedef struct {
+    int fd;             // -1 when the segment number is free
+    uint32_t records;   // Appended so far
+    uint32_t live;      // Still referenced by the index
+} TierSegment;
+
+struct TierStore {
+    pthread_mutex_t mutex;
+    char dir[1024];
+    unsigned id;                        // Distinguishes stores sharing a directory
+
+    TierSlot* slots;
+    size_t capacity;                    // Power of two
+    size_t used;                        // Live + deleted slots
+    size_t count;                       // Live entries
+
+    TierSegment segments[TIER_MAX_SEGMENTS];
+    uint32_t active;                    // Segment receiving appends
+    TierRecord staged[TIER_FLUSH_RECORDS];
+    uint32_t staged_from;               // Record number of staged[0] in the active segment
+    uint32_t staged_count;
+
+    pthread_t compactor;
+    pthread_cond_t wake;
+    bool stop;
+    bool io_error;                      // A write failed; puts are refused from then on
+};
+
+static atomic_uint next_store_id = 1;
+
+
+// ============================================================================================= //
+// ============================================ INDEX ========================================== //
+// ============================================================================================= //
+static size_t tier_slot_hash(int key, size_t capacity) {
+    uint64_t h = (uint64_t)(uint32_t)key * 0x9e3779b97f4a7c15ULL;
+    return (size_t)(h >> 32) & (capacity - 1);
+}
+
+// Slot holding key, or NULL
+static TierSlot* tier_find(TierStore* store, int key) {
+    for (size_t i = tier_slot_hash(key, store->capacity);; i = (i + 1) & (store->capacity - 1)) {
+        TierSlot* slot = &store->slots[i];
+        if (slot->location == TIER_SLOT_EMPTY) return NULL;
+        if (slot->location != TIER_SLOT_DELETED && slot->key == key) return slot;
+    }
+}
+
+static bool tier_index_grow(TierStore* store) {
+    size_t capacity = store->capacity;
+    if (store->count * 2 >= capacity) capacity *= 2; // Otherwise just purge deleted slots
+
+    TierSlot* slots = malloc(capacity * sizeof(TierSlot));
+    if (!slots) return false;
+    for (size_t i = 0; i < capacity; i++) slots[i].location = TIER_SLOT_EMPTY;
+
+    for (size_t i = 0; i < store->capacity; i++) {
+        TierSlot* old = &store->slots[i];
+        if (old->location >= TIER_SLOT_DELETED) continue;
+        size_t j = tier_slot_hash(old->key, capacity);
+        while (slots[j].location != TIER_SLOT_EMPTY) j = (j + 1) & (capacity - 1);
+        slots[j] = *old;
+    }
+    free(store->slots);
+    store->slots = slots;
+    store->capacity = capacity;
+    store->used = store->count;
+    return true;
+}
+
+static void tier_unreference(TierStore* store, uint32_t location) {
+    store->segments[location >> TIER_SEGMENT_BITS].live--;
+}
+
+
+// ============================================================================================= //
+// =========================================== SEGMENTS ======================================== //
+// ============================================================================================= //
+static void tier_segment_path(const TierStore* store, uint32_t segment, char* path, size_t len) {
+    snprintf(path, len, "%s/ht-tier-%d-%u-%u.seg", store->dir, (int)getpid(), store->id, segment);
+}
+
+// Writes the staged records. On failure they stay staged, so reads still find them.
+static bool tier_flush(TierStore* store) {
+    if (store->staged_count == 0) return true;
+
+    TierSegment* segment = &store->segments[store->active];
+    const char* data = (const char*)store->staged;
+    size_t len = store->staged_count * sizeof(TierRecord);
+    off_t offset = (off_t)store->staged_from * (off_t)sizeof(TierRecord);
+    while (len > 0) {
+        ssize_t n = pwrite(segment->fd, data, len, offset);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            store->io_error = true;
+            return false;
+        }
+        data += n;
+        len -= (size_t)n;
+        offset += n;
+    }
+    store->staged_from += store->staged_count;
+    store->staged_count = 0;
+    return true;
+}
+
+// Seals the active segment and opens a new one. If no segment can be opened (every number in
+// use, or open failed) the full segment stays active and a later append tries again, once
+// compaction may have freed a number.
+static bool tier_roll(TierStore* store) {
+    if (!tier_flush(store)) return false;
+
+    for (uint32_t s = 0; s < TIER_MAX_SEGMENTS; s++) {
+        if (store->segments[s].fd >= 0) continue;
+
+        char path[1200];
+        tier_segment_path(store, s, path, sizeof(path));
+        int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd < 0) return false;
+        store->segments[s] = (TierSegment){ fd, 0, 0 };
+        store->active = s;
+        store->staged_from = 0;
+        return true;
+    }
+    return false;
+}
+
+// Appends a record to the active segment and returns its location, or TIER_SLOT_EMPTY. The
+// record is staged and counted only after the flush or roll it needed succeeded, so a failed
+// append leaves records, live and the staging buffer as they were.
+static uint32_t tier_append(TierStore* store, int key, int value) {
+    if (store->io_error) return TIER_SLOT_EMPTY;
+    if (store->segments[store->active].records == TIER_SEGMENT_RECORDS && !tier_roll(store)) return TIER_SLOT_EMPTY;
+    if (store->staged_count == TIER_FLUSH_RECORDS && !tier_flush(store)) return TIER_SLOT_EMPTY;
+
+    TierSegment* segment = &store->segments[store->active];
+    store->staged[store->staged_count++] = (TierRecord){ key, value };
+    segment->live++;
+    return store->active << TIER_SEGMENT_BITS | segment->records++;
+}
+
+static bool tier_read(TierStore* store, uint32_t location, TierRecord* record) {
+    uint32_t s = location >> TIER_SEGMENT_BITS;
+    uint32_t r = location & (TIER_SEGMENT_RECORDS - 1);
+    if (s == store->active && r >= store->staged_from) {
+        *record = store->staged[r - store->staged_from];
+        return true;
+    }
+    ssize_t n;
+    do {
+        n = pread(store->segments[s].fd, record, sizeof(*record), (off_t)r * (off_t)sizeof(TierRecord));
+    } while (n < 0 && errno == EINTR);
+    return n == (ssize_t)sizeof(*record);
+}
+
+static void tier_drop_segment(TierStore* store, uint32_t s) {
+    char path[1200];
+    tier_segment_path(store, s, path, sizeof(path));
+    close(store->segments[s].fd);
+    unlink(path);
+    store->segments[s] = (TierSegment){ -1, 0, 0 };
+}
+
+
+// ============================================================================================= //
+// ========================================== COMPACTION ======================================= //
+// ============================================================================================= //
+// Caller holds the mutex. Moves the live records of mostly-dead sealed segments to the
+// active segment and deletes them. Returns the number of segments reclaimed.
+static size_t tier_compact_locked(TierStore* store) {
+    size_t reclaimed = 0;
+    for (uint32_t s = 0; s < TIER_MAX_SEGMENTS; s++) {
+        TierSegment* segment = &store->segments[s];
+        if (segment->fd < 0 || s == store->active || store->io_error) continue;
+        if (segment->live > segment->records * (1.0 - TIER_COMPACT_DEAD)) continue;
+
+        // The index knows which records are live; a slot scan avoids reading dead ones
+        for (size_t i = 0; i < store->capacity && segment->live > 0; i++) {
+            TierSlot* slot = &store->slots[i];
+            if (slot->location >= TIER_SLOT_DELETED || slot->location >> TIER_SEGMENT_BITS != s) continue;
+
+            TierRecord record;
+            if (!tier_read(store, slot->location, &record)) {
+                store->io_error = true;
+                break;
+            }
+            uint32_t location = tier_append(store, record.key, record.value);
+            if (location == TIER_SLOT_EMPTY) break;
+            tier_unreference(store, slot->location);
+            slot->location = location;
+        }
+        if (segment->live == 0) {
+            tier_drop_segment(store, s);
+            reclaimed++;
+        }
+    }
+    return reclaimed;
+}
+
+static void* tier_compactor_main(void* arg) {
+    TierStore* store = arg;
+    pthread_mutex_lock(&store->mutex);
+    while (!store->stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += 1;
+        pthread_cond_timedwait(&store->wake, &store->mutex, &deadline);
+        if (!store->stop) tier_compact_locked(store);
+    }
+    pthread_mutex_unlock(&store->mutex);
+    return NULL;
+}
+
+
+// ============================================================================================= //
+// ============================================ API ============================================ //
+// ============================================================================================= //
+// Creates an empty store whose segment files live in `dir`. Returns NULL on failure.
+TierStore* ht_tier_open(const char* dir) {
+    if (!dir || strlen(dir) >= sizeof(((TierStore*)0)->dir)) return NULL;
+
+    TierStore* store = calloc(1, sizeof(TierStore));
+    if (!store) return NULL;
+    strcpy(store->dir, dir);
+    store->id = atomic_fetch_add(&next_store_id, 1);
+    for (uint32_t s = 0; s < TIER_MAX_SEGMENTS; s++) store->segments[s].fd = -1;
+
+    store->capacity = 1024;
+    store->slots = malloc(store->capacity * sizeof(TierSlot));
+    bool ok = store->slots && pthread_mutex_init(&store->mutex, NULL) == 0;
+    if (ok) {
+        for (size_t i = 0; i < store->capacity; i++) store->slots[i].location = TIER_SLOT_EMPTY;
+        ok = tier_roll(store) && pthread_cond_init(&store->wake, NULL) == 0;
+        if (ok && pthread_create(&store->compactor, NULL, tier_compactor_main, store) != 0) {
+            pthread_cond_destroy(&store->wake);
+            ok = false;
+        }
+        if (!ok) {
+            if (store->segments[store->active].fd >= 0) tier_drop_segment(store, store->active);
+            pthread_mutex_destroy(&store->mutex);
+        }
+    }
+    if (!ok) {
+        free(store->slots);
+        free(store);
+        return NULL;
+    }
+    return store;
+}
+
+// Stops the compactor and deletes every segment file
+void ht_tier_close(TierStore* store) {
+    if (!store) return;
+
+    pthread_mutex_lock(&store->mutex);
+    store->stop = true;
+    pthread_cond_signal(&store->wake);
+    pthread_mutex_unlock(&store->mutex);
+    pthread_join(store->compactor, NULL);
+
+    for (uint32_t s = 0; s < TIER_MAX_SEGMENTS; s++) {
+        if (store->segments[s].fd >= 0) tier_drop_segment(store, s);
+    }
+    pthread_cond_destroy(&store->wake);
+    pthread_mutex_destroy(&store->mutex);
+    free(store->slots);
+    free(store);
+}
+
+// Stores key -> value, replacing any earlier record. Returns 1 on success, 0 on I/O failure.
+int ht_tier_put(TierStore* store, int key, int value) {
+    if (!store) return 0;
+
+    pthread_mutex_lock(&store->mutex);
+    if ((store->used + 1) * 10 > store->capacity * 7 && !tier_index_grow(store)) {
+        pthread_mutex_unlock(&store->mutex);
+        return 0;
+    }
+
+    uint32_t location = tier_append(store, key, value);
+    if (location == TIER_SLOT_EMPTY) {
+        pthread_mutex_unlock(&store->mutex);
+        return 0;
+    }
+
+    TierSlot* slot = tier_find(store, key);
+    if (slot) {
+        tier_unreference(store, slot->location);
+    } else {
+        size_t i = tier_slot_hash(key, store->capacity);
+        while (store->slots[i].location < TIER_SLOT_DELETED) i = (i + 1) & (store->capacity - 1);
+        slot = &store->slots[i];
+        if (slot->location == TIER_SLOT_EMPTY) store->used++;
+        slot->key = key;
+        store->count++;
+    }
+    slot->location = location;
+    pthread_mutex_unlock(&store->mutex);
+    return 1;
+}
+
+static int tier_lookup(TierStore* store, int key, int* value, bool take) {
+    if (!store) return 0;
+
+    pthread_mutex_lock(&store->mutex);
+    TierSlot* slot = tier_find(store, key);
+    TierRecord record;
+    bool found = slot && tier_read(store, slot->location, &record);
+    if (found) {
+        *value = record.value;
+        if (take) {
+            tier_unreference(store, slot->location);
+            slot->location = TIER_SLOT_DELETED;
+            store->count--;
+        }
+    }
+    pthread_mutex_unlock(&store->mutex);
+    return found ? 1 : 0;
+}
+
+// 1 = found (value set), 0 = not in the tier
+int ht_tier_get(TierStore* store, int key, int* value) {
+    return tier_lookup(store, key, value, false);
+}
+
+// 1 if the key is in the tier. Only the index is read, no segment.
+int ht_tier_contains(TierStore* store, int key) {
+    if (!store) return 0;
+
+    pthread_mutex_lock(&store->mutex);
+    bool found = tier_find(store, key) != NULL;
+    pthread_mutex_unlock(&store->mutex);
+    return found ? 1 : 0;
+}
+
+// Like ht_tier_get, and removes the entry (used to promote it back to memory)
+int ht_tier_take(TierStore* store, int key, int* value) {
+    return tier_lookup(store, key, value, true);
+}
+
+// Returns 1 if the key was present
+int ht_tier_remove(TierStore* store, int key) {
+    if (!store) return 0;
+
+    pthread_mutex_lock(&store->mutex);
+    TierSlot* slot = tier_find(store, key);
+    if (slot) {
+        tier_unreference(store, slot->location);
+        slot->location = TIER_SLOT_DELETED;
+        store->count--;
+    }
+    pthread_mutex_unlock(&store->mutex);
+    return slot ? 1 : 0;
+}
+
+size_t ht_tier_count(TierStore* store) {
+    if (!store) return 0;
+    pthread_mutex_lock(&store->mutex);
+    size_t count = store->count;
+    pthread_mutex_unlock(&store->mutex);
+    return count;
+}
+
+// Calls visit(key, arg) for every key, without touching the disk. visit must not call
+// back into the store.
+void ht_tier_keys(TierStore* store, void (*visit)(int key, void* arg), void* arg) {
+    if (!store) return;
+    pthread_mutex_lock(&store->mutex);
+    for (size_t i = 0; i < store->capacity; i++) {
+        if (store->slots[i].location < TIER_SLOT_DELETED) visit(store->slots[i].key, arg);
+    }
+    pthread_mutex_unlock(&store->mutex);
+}
+
+// Calls visit(key, value, arg) for every entry, reading values from the segments. Returns
+// 1 if every record could be read. visit must not call back into the store.
+int ht_tier_foreach(TierStore* store, void (*visit)(int key, int value, void* arg), void* arg) {
+    if (!store) return 1;
+    bool ok = true;
+    pthread_mutex_lock(&store->mutex);
+    for (size_t i = 0; i < store->capacity; i++) {
+        TierSlot* slot = &store->slots[i];
+        if (slot->location >= TIER_SLOT_DELETED) continue;
+        TierRecord record;
+        if (tier_read(store, slot->location, &record)) visit(record.key, record.value, arg);
+        else ok = false;
+    }
+    pthread_mutex_unlock(&store->mutex);
+    return ok ? 1 : 0;
+}
+
+// Compacts now instead of waiting for the background pass. Returns segments reclaimed.
+size_t ht_tier_compact(TierStore* store) {
+    if (!store) return 0;
+    pthread_mutex_lock(&store->mutex);
+    size_t reclaimed = tier_compact_locked(store);
+    pthread_mutex_unlock(&store->mutex);
+    return reclaimed;
+}
+
+// Blocks every other store call (including compaction) until ht_tier_resume, e.g. so a
+// fork() does not copy the mutex in a locked state. A forked child that inherited a paused
+// store calls ht_tier_resume before using it.
+void ht_tier_pause(TierStore* store) {
+    if (store) pthread_mutex_lock(&store->mutex);
+}
+
+void ht_tier_resume(TierStore* store) {
+    if (store) pthread_mutex_unlock(&store->mutex);
+}
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "hashtablescratch.h"
+
+// Operation traces: what a build compiled with -DHT_TRACE records, and what
+// hashtablescratch_replay plays back.
+//
+// - Every traced insert, get or delete (see TRACE_OP in hashtablescratch.c) appends one
+//   16-byte HtTraceRecord to a buffer owned by the calling thread; a full buffer is written
+//   out under one mutex, so the hot path takes no lock and makes one clock read. On x86 that
+//   read is the TSC (half the cost of clock_gettime); ht_trace_stop calibrates it against the
+//   clock and stores ns per tick in the file header, and ht_trace_load converts the stamps
+//   to ns.
+// - Buffers are registered globally and outlive their thread, so ht_trace_stop (also run at
+//   exit) writes whatever every thread left behind. Records in the file are grouped by
+//   buffer, not sorted; ht_trace_load sorts them by time.
+// - A thread marks its buffer active while appending and then rechecks that the trace it
+//   started with is still running. ht_trace_stop first ends the trace, then waits for every
+//   buffer to go inactive, and only then drains them, so it never touches a buffer that its
+//   owner is still writing.
+// - Setting HT_TRACE_FILE starts a trace on the first traced operation, so an existing
+//   program only needs relinking against the instrumented object.
+
+#define TRACE_MAGIC "HTTRACE1"
+
+typedef struct {
+    char magic[8];
+    double ns_per_tick;     // 0 until ht_trace_stop: the trace is incomplete
+} TraceHeader;
+#define TRACE_BUFFER_RECORDS 4096   // Records per thread between writes
+
+typedef struct TraceBuffer {
+    HtTraceRecord records[TRACE_BUFFER_RECORDS];
+    size_t used;
+    unsigned thread;
+    atomic_bool active;             // Owner is appending; ht_trace_stop waits for it
+    struct TraceBuffer* next;       // Registry of every thread's buffer
+} TraceBuffer;
+
+static pthread_mutex_t trace_control_mutex = PTHREAD_MUTEX_INITIALIZER; // One start/stop at a time
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER; // Guards the file and registry
+static FILE* trace_file;
+static _Atomic uint64_t trace_start_ticks; // 0 = not tracing
+static uint64_t trace_start_ns;
+static atomic_uint trace_generation;    // Bumped by every start: stale buffers re-register
+static TraceBuffer* trace_buffers;
+static unsigned trace_threads;
+
+static _Thread_local TraceBuffer* trace_local;
+static _Thread_local unsigned trace_local_generation;
+
+static uint64_t trace_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t trace_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return trace_now_ns();
+#endif
+}
+
+// Caller holds trace_mutex
+static void trace_write(TraceBuffer* buffer) {
+    if (trace_file && buffer->used) {
+        fwrite(buffer->records, sizeof(HtTraceRecord), buffer->used, trace_file);
+    }
+    buffer->used = 0;
+}
+
+// Caller holds trace_control_mutex
+static void trace_stop_locked(void) {
+    pthread_mutex_lock(&trace_mutex);
+    uint64_t start = atomic_exchange(&trace_start_ticks, 0); // No new appends from here on
+    TraceBuffer* buffers = trace_buffers;
+    pthread_mutex_unlock(&trace_mutex);
+
+    // Appends already past their check finish first. They may take trace_mutex to write out a
+    // full buffer, so it is not held while waiting. Buffers are never unlinked.
+    for (TraceBuffer* buffer = buffers; buffer; buffer = buffer->next) {
+        while (atomic_load(&buffer->active)) sched_yield();
+    }
+
+    pthread_mutex_lock(&trace_mutex);
+    for (TraceBuffer* buffer = trace_buffers; buffer; buffer = buffer->next) trace_write(buffer);
+    if (trace_file) {
+        uint64_t ticks = trace_ticks() - start, ns = trace_now_ns() - trace_start_ns;
+        TraceHeader header = { TRACE_MAGIC, ticks ? (double)ns / (double)ticks : 1.0 };
+        if (fseek(trace_file, 0, SEEK_SET) == 0) fwrite(&header, sizeof(header), 1, trace_file);
+        fclose(trace_file);
+        trace_file = NULL;
+    }
+    pthread_mutex_unlock(&trace_mutex);
+}
+
+// Starts writing a trace to path, replacing a trace in progress. Returns 1 on success.
+int ht_trace_start(const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return 0;
+
+    pthread_mutex_lock(&trace_control_mutex);
+    trace_stop_locked();
+    pthread_mutex_lock(&trace_mutex);
+    TraceHeader header = { TRACE_MAGIC, 0.0 };
+    fwrite(&header, sizeof(header), 1, file);
+    trace_file = file;
+    trace_threads = 0;
+    atomic_fetch_add(&trace_generation, 1);
+    trace_start_ns = trace_now_ns();
+    atomic_store(&trace_start_ticks, trace_ticks());
+    pthread_mutex_unlock(&trace_mutex);
+    pthread_mutex_unlock(&trace_control_mutex);
+    return 1;
+}
+
+// Ends the trace, writes every thread's pending records and closes the file. Operations that
+// race with the stop are either recorded in full or not at all.
+void ht_trace_stop(void) {
+    pthread_mutex_lock(&trace_control_mutex);
+    trace_stop_locked();
+    pthread_mutex_unlock(&trace_control_mutex);
+}
+
+static void trace_start_from_env(void) {
+    const char* path = getenv("HT_TRACE_FILE");
+    if (path && ht_trace_start(path)) atexit(ht_trace_stop);
+}
+
+// Called by the instrumented table for every traced operation
+void ht_trace_record(HtTraceOp op, int key, int value) {
+    static pthread_once_t env_once = PTHREAD_ONCE_INIT;
+    pthread_once(&env_once, trace_start_from_env);
+
+    uint64_t start = atomic_load_explicit(&trace_start_ticks, memory_order_acquire);
+    if (!start) return;
+
+    TraceBuffer* buffer = trace_local;
+    unsigned generation = atomic_load_explicit(&trace_generation, memory_order_relaxed);
+    if (!buffer || trace_local_generation != generation) {
+        pthread_mutex_lock(&trace_mutex);
+        // Stopped meanwhile: a stop no longer waits for this buffer, so it must stay untouched
+        if (atomic_load_explicit(&trace_start_ticks, memory_order_relaxed) != start) {
+            pthread_mutex_unlock(&trace_mutex);
+            return;
+        }
+        if (!buffer) {
+            buffer = calloc(1, sizeof(TraceBuffer));
+            if (!buffer) {
+                pthread_mutex_unlock(&trace_mutex);
+                return;
+            }
+            buffer->next = trace_buffers;
+            trace_buffers = buffer;
+        }
+        buffer->used = 0; // Left from an earlier trace (already written by its stop)
+        buffer->thread = trace_threads++ & HT_TRACE_THREAD_MASK;
+        pthread_mutex_unlock(&trace_mutex);
+        trace_local = buffer;
+        trace_local_generation = generation;
+    }
+
+    // Seen by ht_trace_stop before it drains, or this thread sees the trace has ended
+    atomic_store(&buffer->active, true);
+    if (atomic_load(&trace_start_ticks) != start) {
+        atomic_store_explicit(&buffer->active, false, memory_order_release);
+        return;
+    }
+
+    uint64_t elapsed = trace_ticks() - start;
+    buffer->records[buffer->used++] = (HtTraceRecord){
+        .stamp = elapsed << HT_TRACE_TIME_SHIFT | (uint64_t)buffer->thread << HT_TRACE_THREAD_SHIFT | (uint64_t)op,
+        .key = key,
+        .value = value,
+    };
+    if (buffer->used == TRACE_BUFFER_RECORDS) {
+        pthread_mutex_lock(&trace_mutex);
+        trace_write(buffer);
+        pthread_mutex_unlock(&trace_mutex);
+    }
+    atomic_store_explicit(&buffer->active, false, memory_order_release);
+}
+
+static int trace_compare(const void* a, const void* b) {
+    uint64_t x = ((const HtTraceRecord*)a)->stamp, y = ((const HtTraceRecord*)b)->stamp;
+    return (x > y) - (x < y);
+}
+
+// Reads a trace file, sorted by time, with stamps in ns. Returns NULL if it is missing, not a
+// trace, unfinished (no ht_trace_stop) or corrupt; the caller frees the array.
+HtTraceRecord* ht_trace_load(const char* path, size_t* count) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+
+    TraceHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TRACE_MAGIC, 8) != 0 ||
+        !(header.ns_per_tick > 0.0) || fseek(file, 0, SEEK_END) != 0) {
+        fclose(file);
+        return NULL;
+    }
+    long bytes = ftell(file) - (long)sizeof(header);
+    size_t n = bytes > 0 ? (size_t)bytes / sizeof(HtTraceRecord) : 0;
+    HtTraceRecord* records = malloc(n > 0 ? n * sizeof(HtTraceRecord) : 1);
+    if (!records || fseek(file, (long)sizeof(header), SEEK_SET) != 0 ||
+        fread(records, sizeof(HtTraceRecord), n, file) != n) {
+        free(records);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+
+    for (size_t i = 0; i < n; i++) {
+        if ((records[i].stamp & HT_TRACE_OP_MASK) > HT_TRACE_DELETE) {
+            free(records);
+            return NULL;
+        }
+        uint64_t ns = (uint64_t)((double)(records[i].stamp >> HT_TRACE_TIME_SHIFT) * header.ns_per_tick);
+        records[i].stamp = ns << HT_TRACE_TIME_SHIFT | (records[i].stamp & ((1u << HT_TRACE_TIME_SHIFT) - 1));
+    }
+    qsort(records, n, sizeof(HtTraceRecord), trace_compare);
+    *count = n;
+    return records;
+}